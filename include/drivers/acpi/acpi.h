@@ -1,6 +1,7 @@
 #pragma once
 
 #include "system/types.h"
+#include "system/param.h"
 
 #include "debug/kdebug.h"
 
@@ -228,6 +229,96 @@ namespace acpi
 		generic_addr_struct x_gpe_1_block;
 	}__attribute__((__packed__));
 
+	enum srat_entry_type : uint8_t
+	{
+		SRAT_ENTRY_LAPIC = 0,
+		SRAT_ENTRY_MEMORY = 1,
+		SRAT_ENTRY_X2APIC = 2,
+	};
+
+	constexpr const char* SIGNATURE_SRAT = "SRAT";
+	struct acpi_srat
+	{
+		acpi_desc_header header;
+		uint32_t reserved1;
+		uint64_t reserved2;
+		uint8_t table[0];
+	} __attribute__((__packed__));
+
+	struct srat_entry_header
+	{
+		srat_entry_type type;
+		uint8_t length;
+	} __attribute__((__packed__));
+
+	constexpr uint32_t SRAT_ENTRY_ENABLED = 1;
+
+	// 5.2.16.1
+	struct srat_lapic
+	{
+		uint8_t type;
+		uint8_t length;
+		uint8_t proximity_domain_low;
+		uint8_t apic_id;
+		uint32_t flags;
+		uint8_t sapic_eid;
+		uint8_t proximity_domain_high[3];
+		uint32_t clock_domain;
+	} __attribute__((__packed__));
+
+	// 5.2.16.2
+	struct srat_memory
+	{
+		uint8_t type;
+		uint8_t length;
+		uint32_t proximity_domain;
+		uint16_t reserved1;
+		uint64_t base;
+		uint64_t size;
+		uint32_t reserved2;
+		uint32_t flags;
+		uint64_t reserved3;
+	} __attribute__((__packed__));
+
+	// 5.2.16.3
+	struct srat_x2apic
+	{
+		uint8_t type;
+		uint8_t length;
+		uint16_t reserved1;
+		uint32_t proximity_domain;
+		uint32_t x2apic_id;
+		uint32_t flags;
+		uint32_t clock_domain;
+		uint32_t reserved2;
+	} __attribute__((__packed__));
+
+	constexpr const char* SIGNATURE_SLIT = "SLIT";
+	struct acpi_slit
+	{
+		acpi_desc_header header;
+		uint64_t locality_count;
+		uint8_t entry[0];
+	} __attribute__((__packed__));
+
+	// relative distances used by the SLIT, where a node is at 10 from itself
+	constexpr uint8_t NUMA_DISTANCE_LOCAL = 10;
+	constexpr uint8_t NUMA_DISTANCE_REMOTE = 20;
+
+	constexpr size_t NUMA_MEMORY_RANGE_COUNT_LIMIT = 32;
+
+	// a range of physical memory in a NUMA node
+	struct numa_memory_range
+	{
+		uintptr_t base;
+		size_t size;
+		size_t node;
+	};
+
+	static_assert(sizeof(srat_lapic) == 16, "Invalid SRAT processor affinity size");
+	static_assert(sizeof(srat_memory) == 40, "Invalid SRAT memory affinity size");
+	static_assert(sizeof(srat_x2apic) == 24, "Invalid SRAT x2APIC affinity size");
+
 	static_assert(sizeof(acpi_mcfg::header) == 36, "Invalid header size");
 	static_assert(sizeof(acpi_mcfg) == 44, "Invalid MCFG table size");
 
@@ -257,6 +348,14 @@ namespace acpi
 
 	acpi_fadt* get_fadt();
 
+	// NUMA nodes are numbered from 0 in the order the SRAT mentions their proximity domains.
+	// Without an SRAT, everything is in node 0
+	size_t get_numa_node_count();
+
+	size_t get_numa_memory_ranges(size_t bufsz, OUT numa_memory_range** buf);
+
+	uint8_t get_numa_distance(size_t from, size_t to);
+
 // instead of copy madt_lapic to cpus array, directly provide interface to get them
 
 } // namespace acpi
@@ -10,6 +10,9 @@
 
 #include "task/scheduler/scheduler.hpp"
 
+#include "memory/per_cpu_pages.hpp"
+#include "memory/tlb.hpp"
+
 #include "ktl/span.hpp"
 
 struct cpu_struct
@@ -20,6 +23,10 @@ struct cpu_struct
 	int nest_pushcli_depth{ 0 };    // Depth of pushcli nesting.
 	int intr_enable{ false };           // Were interrupts enabled before pushcli?
 	bool present{ false };              // Is this core available
+	size_t numa_node{ 0 };              // NUMA node this core belongs to
+	uint32_t core_id{ 0 };              // shared by the hardware threads of a core
+	uint32_t llc_id{ 0 };               // shared by the cores behind the same last level cache
+	int64_t tsc_offset{ 0 };            // added to the TSC to line it up with the boot processor's
 
 	// Cpu-local storage variables
 	void* local_fs{ nullptr };
@@ -28,6 +35,15 @@ struct cpu_struct
 	task::thread* idle{ nullptr };
 	task::scheduler* scheduler{ nullptr };
 
+	// single pages cached in front of the buddy allocator
+	memory::per_cpu_pages page_cache{};
+
+	// zeroed pages kept for page tables, which are zero again when they're freed
+	memory::per_cpu_pages pgtable_cache{};
+
+	// which page table this CPU uses, and whether a shootdown waits for it
+	memory::tlb_cpu_state tlb{};
+
 	task_state_segment tss{};
 	gdt_table gdt_table{};
 
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "system/types.h"
+#include "system/time.hpp"
+
+namespace clocksource
+{
+
+/// \brief calibrate the TSC against the PIT, and the local APIC timer against the TSC, then seed the wall clock
+/// from the RTC. Called once on the boot processor, after its local APIC timer is running
+PANIC void init_clocksource();
+
+/// \brief line up the TSC of the AP running it with that of the boot processor, which runs sync_ap for it meanwhile
+void init_ap_clocksource();
+
+/// \brief the boot processor's side of init_ap_clocksource, for an AP that was just started
+void sync_ap();
+
+/// \brief nanoseconds since the clock source was initialized, which agree across CPUs
+[[nodiscard]] time_type now();
+
+/// \brief nanoseconds between two local APIC timer ticks
+[[nodiscard]] duration_type tick_period();
+
+/// \brief the timer ticks until duration has passed, rounded up
+[[nodiscard]] uint64_t duration_to_ticks(duration_type duration);
+
+/// \brief nanoseconds since the epoch
+[[nodiscard]] time_type wall_time();
+
+/// \brief seconds since the epoch
+[[nodiscard]] timestamp_type wall_timestamp();
+
+} // namespace clocksource
@@ -28,10 +28,12 @@
 #include "object/dispatcher.hpp"
 
 #include "memory/fpage.hpp"
+#include "memory/page.hpp"
 
 #include "system/vmm.h"
 
 #include "kbl/data/list.hpp"
+#include "kbl/data/avl_tree.hpp"
 
 namespace memory
 {
@@ -43,6 +45,7 @@ enum [[clang::flag_enum]] VM_FLAGS : size_t
 	VM_EXEC = 0x00000004,
 	VM_STACK = 0x00000008,
 	VM_SHARE = 0x00000010,
+	VM_LARGE_PAGE = 0x00000020, // back 2MB-aligned parts with 2MB pages on fault
 };
 
 class address_space_segment final
@@ -50,6 +53,7 @@ class address_space_segment final
  public:
 	friend class address_space;
 	using link_type = kbl::list_link<address_space_segment, lock::spinlock>;
+	using tree_link_type = kbl::avl_interval_link<address_space_segment, uintptr_t>;
 
 	[[nodiscard]] address_space_segment(uintptr_t vm_start, uintptr_t vm_end, uint64_t vm_flags);
 	~address_space_segment();
@@ -60,6 +64,16 @@ class address_space_segment final
 
 	error_code resize(uintptr_t start, uintptr_t end);
 
+	// back [file_start, file_start + size) with image, which must stay resident in kernel memory.
+	// pages are filled from it on fault, and the rest of the segment is zero-filled
+	void set_backing(const uint8_t* image, uintptr_t file_start, size_t size);
+
+	// fill dst with the content of [va, va + len)
+	void fill(uintptr_t va, uint8_t* dst, size_t len) const;
+
+	// whether any byte of [va, va + len) comes from the image, otherwise the range is all zero
+	[[nodiscard]] bool backed(uintptr_t va, size_t len) const;
+
 	[[nodiscard]] uintptr_t start() const
 	{
 		return this->start_;
@@ -76,17 +90,26 @@ class address_space_segment final
 	}
 
  private:
+	struct file_backing
+	{
+		const uint8_t* image;
+		uintptr_t start;
+		size_t size;
+	};
 
 	uintptr_t start_{ 0 };
 	uintptr_t end_{ 0 };
 
 	uint64_t flags_{ 0 };
 
+	file_backing backing_{ nullptr, 0, 0 };
+
 	class address_space* parent_{ nullptr };
 
 	lock::spinlock lock_{ "ass" };
 
 	link_type link_{ this };
+	tree_link_type tree_link_{ this };
 };
 
 class address_space final
@@ -98,6 +121,11 @@ class address_space final
 	                                                                 &address_space_segment::link_,
 	                                                                 true>;
 
+	// indexes the segments by their range for O(log n) lookup, while the list keeps them in order for iteration
+	using segment_tree_type = kbl::avl_interval_tree<address_space_segment,
+	                                                 uintptr_t,
+	                                                 &address_space_segment::tree_link_>;
+
 	address_space();
 	address_space(address_space&& another);
 	~address_space();
@@ -109,6 +137,17 @@ class address_space final
 
 	error_code_with_result<address_space_segment*> map(uintptr_t addr, size_t len, uint64_t flags);
 
+	/// \brief map len bytes, a multiple of align, at the first free place in [USER_MMAP_BASE, USER_MMAP_END)
+	/// from hint, wrapping around once
+	error_code_with_result<address_space_segment*> map_anywhere(uintptr_t hint,
+		size_t len,
+		size_t align,
+		uint64_t flags);
+
+	/// \brief fault in every page of [start, end) that isn't present, with 2MB pages where the segment asks for them.
+	/// The range must be mapped
+	error_code populate(uintptr_t start, uintptr_t end);
+
 	error_code_with_result<address_space_segment*> mm_fpage_map(address_space* to,
 		const task::ipc::fpage& send,
 		const task::ipc::fpage& receive);
@@ -127,8 +166,20 @@ class address_space final
 
 	address_space_segment* find_vma(uintptr_t addr);
 
+	// guards the segments and the page table
+	using object::solo_dispatcher<address_space, 0>::get_lock;
+
+	/// \brief find_vma for callers holding get_lock(), like the fault handler, which keeps it from the lookup
+	/// until the page is in place so that an unmap from another thread can't free the segment meanwhile
+	address_space_segment* find_vma_locked(uintptr_t addr) TA_ASSERT(lock_);
+
 	address_space_segment* intersect_vma(uintptr_t start, uintptr_t end);
 
+	/// \brief move a 4K user page to the frame to, with the address space in its reverse mapping.
+	/// The page is write-protected while it's copied, and a write to it in the meantime fails the move.
+	/// \return ERROR_SUCCESS once no CPU maps from any longer, so that it can be freed
+	static error_code migrate_page(page* from, page* to);
+
 	[[nodiscard]] object::object_type get_type() const
 	{
 		return object::object_type::ADDR_SPACE;
@@ -183,14 +234,28 @@ class address_space final
 		return pgdir_;
 	}
 
+	vmm::pde_ptr_t pgdir_locked() TA_ASSERT(lock_)
+	{
+		return pgdir_;
+	}
+
  private:
+	// whether as is in the list of live address spaces. The caller holds the lock of the list
+	static bool is_live_locked(address_space* as);
+
 	void assert_segment_overlap(address_space_segment* prev, address_space_segment* next);
 
 	void insert_vma_locked(address_space_segment* vma) TA_ASSERT(lock_);
 
-	address_space_segment* find_vma_locked(uintptr_t addr) TA_ASSERT(lock_);
+	error_code_with_result<address_space_segment*> map_locked(uintptr_t start,
+		uintptr_t end,
+		uint64_t flags) TA_ASSERT(lock_);
+
+	void remove_vma_locked(address_space_segment* vma) TA_ASSERT(lock_);
 
-	error_code resize_locked(uintptr_t addr, size_t len) TA_ASSERT(lock_);
+	error_code unmap_locked(uintptr_t start, uintptr_t end, memory::tlb_batch& batch) TA_ASSERT(lock_);
+
+	error_code resize_locked(uintptr_t addr, size_t len, memory::tlb_batch& batch) TA_ASSERT(lock_);
 
 	uintptr_t uheap_ TA_GUARDED(lock_) { 0 };
 	uintptr_t uheap_begin_ TA_GUARDED(lock_) { 0 };
@@ -200,7 +265,11 @@ class address_space final
 
 	vmm::pde_ptr_t pgdir_ TA_GUARDED(lock_) { nullptr };
 
+	// in the list of live address spaces, which tells whether a reverse mapping still points to one
+	list_head live_link_{ nullptr, nullptr };
+
 	segment_list_type segments{};
+	segment_tree_type segment_tree_{};
 };
 
 }
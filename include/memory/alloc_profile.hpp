@@ -0,0 +1,52 @@
+#pragma once
+
+#include "system/types.h"
+#include "system/kmem.hpp"
+
+namespace memory
+{
+
+// call sites each CPU tracks, a power of two
+constexpr size_t ALLOC_PROFILE_SITE_COUNT = 256;
+
+// slots probed for a call site before its record is dropped
+constexpr size_t ALLOC_PROFILE_PROBE_LIMIT = 16;
+
+/// \brief allocations charged to a call site. cache is nullptr for kmalloc blocks that bypass the slab layer.
+/// Frees are charged to the site that made the allocation, which kmalloc keeps in its block header
+/// and kmem caches in an array next to the bufctls of each slab
+struct alloc_site
+{
+	uintptr_t caller;
+	kmem::kmem_cache* cache;
+
+	size_t allocs, frees;
+	size_t bytes_allocated, bytes_freed;
+};
+
+/// \brief whether the kernel was built with KERNEL_ENABLE_ALLOC_PROFILE, which makes kmalloc and kmem record call sites
+[[nodiscard]] constexpr bool alloc_profile_enabled()
+{
+#ifdef _KERNEL_ENABLE_ALLOC_PROFILE
+	return true;
+#else
+	return false;
+#endif
+}
+
+/// \brief charge bytes to a call site in the table of the current CPU. Neither sleeps nor allocates.
+void alloc_profile_alloc(uintptr_t caller, kmem::kmem_cache* cache, size_t bytes);
+void alloc_profile_free(uintptr_t caller, kmem::kmem_cache* cache, size_t bytes);
+
+/// \brief merge the tables of all CPUs into out, with the sites holding the most memory first
+/// \return count of sites written, at most n
+size_t alloc_profile_snapshot(alloc_site* out, size_t n);
+
+/// \brief count of records dropped because a table had no room for their call site
+[[nodiscard]] size_t alloc_profile_dropped();
+
+/// \brief print the call sites and the statistics of every kmem cache to the debug console. Reached from user mode
+/// through SYS_dump_alloc_profile
+void alloc_profile_dump();
+
+}
@@ -3,6 +3,8 @@
 #include "pmm_provider.hpp"
 #include "kbl/lock/spinlock.h"
 
+#include "system/param.h"
+
 #include "memory/page.hpp"
 
 namespace memory
@@ -13,11 +15,14 @@ class buddy_provider final
 {
  public:
 	static constexpr size_t MAX_ORDER = 12;
-	static constexpr size_t ZONE_COUNT_MAX = 8;
+	static constexpr size_t ZONE_COUNT_MAX = 32;
 
+	// zones of the same NUMA node share free lists
 	struct zone
 	{
 		page* base;
+		size_t size;
+		size_t node;
 	};
 
 	struct free_area
@@ -31,11 +36,44 @@ class buddy_provider final
 	buddy_provider();
 
 	void setup_for_base(page* base, size_t n) override;
+
+	/// \brief allocate from node 0, or the nodes nearest to it
 	[[nodiscard]] page* allocate(size_t n) override;
+
+	/// \brief allocate from the given node, or the nodes nearest to it
+	[[nodiscard]] page* allocate(size_t n, size_t node);
+
 	void free(page* base, size_t n) override;
 	[[nodiscard]] size_t free_count() const override;
+	[[nodiscard]] size_t free_count(size_t node) const;
 	[[nodiscard]] bool is_well_constructed() const override;
 
+	/// \brief allocate exactly one page, bypassing the rounding done by allocate()
+	/// \return the page, or nullptr if the provider runs out of memory
+	[[nodiscard]] page* allocate_single(size_t node);
+
+	/// \brief free one page obtained by allocate_single()
+	void free_single(page* pg);
+
+	/// \brief the index-th block of 2^order pages that is aligned inside its zone, counting zone by zone
+	/// \return the first page of the block, or nullptr past the last block
+	[[nodiscard]] page* block_at(size_t order, size_t index) const;
+
+	/// \brief whether pg heads a free block, whose order is then in pg->property
+	[[nodiscard]] static bool is_free_head(const page* pg);
+
+	/// \brief take every free block inside the aligned block of 2^order pages at base out of the free lists,
+	/// and mark its pages isolated. They come back with free()
+	/// \return count of pages taken
+	size_t isolate_free(page* base, size_t order);
+
+	/// \brief move the pages in [first, first + n) to the given node, splitting zones where they start or end.
+	/// The split points are rounded up to the largest block, so that no block crosses them
+	void assign_node(page* first, size_t n, size_t node);
+
+	/// \brief the nodes to allocate from, in order, when node is preferred. It comes first itself
+	void set_fallback(size_t node, const size_t* nodes, size_t count);
+
  private:
 	bool is_buddy_page(page* page, size_t order, size_t zone);
 	page* index_to_page(size_t zone_id, size_t index);
@@ -43,13 +81,23 @@ class buddy_provider final
 	size_t get_order(size_t n);
 
 	void do_free(page* base, size_t n);
-	[[nodiscard]] page* do_allocate(size_t n);
+	[[nodiscard]] page* do_allocate(size_t n, size_t node);
 
-	free_area free_areas_[MAX_ORDER + 1]{};
+	free_area* areas_of(const page* pg)
+	{
+		return free_areas_[zones_[pg->zone_id].node];
+	}
+
+	size_t split_zone(size_t zone_id, page* at);
+
+	free_area free_areas_[NUMA_NODE_COUNT_LIMIT][MAX_ORDER + 1]{};
 
 	zone zones_[ZONE_COUNT_MAX]{};
 	size_t zone_count_{ 0 };
 
+	size_t fallback_[NUMA_NODE_COUNT_LIMIT][NUMA_NODE_COUNT_LIMIT]{};
+	size_t fallback_count_[NUMA_NODE_COUNT_LIMIT]{};
+
 	bool well_constructed_{ false };
 };
 
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "system/types.h"
+#include "system/mmu.h"
+
+namespace memory
+{
+
+// compaction frees blocks of a 2MB page
+constexpr size_t COMPACTION_ORDER = 9;
+static_assert((1ull << COMPACTION_ORDER) == LARGE_PAGE_PAGES);
+
+// blocks looked at by each call from the idle loop
+constexpr size_t COMPACTION_SCAN_BUDGET = 64;
+
+/// \brief look at up to budget blocks of 2^order pages, resuming after the last one looked at,
+/// and migrate the user pages out of the first block that has no other pages in use.
+/// It must be called from a thread, because migrating waits for the other CPUs.
+/// It does nothing while another compaction runs.
+/// \return true if a block has been freed in one piece
+bool compact(size_t order, size_t budget);
+
+/// \brief note that an allocation of several pages has failed
+void compact_kick();
+
+/// \brief compact if it has been kicked, called when the CPU is idle
+void compact_if_needed();
+
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "system/types.h"
+#include "system/memlayout.h"
+
+namespace memory
+{
+
+// usable size of a kernel stack
+constexpr size_t KSTACK_SIZE = 4_MB;
+
+// a stack and the unmapped guard page below it
+constexpr size_t KSTACK_SLOT_SIZE = KSTACK_SIZE + PAGE_SIZE;
+
+// stacks that can be alive at a time
+constexpr size_t KSTACK_SLOT_COUNT = 8192;
+static_assert(KSTACK_SLOT_COUNT * KSTACK_SLOT_SIZE <= KSTACK_REGION_SIZE);
+
+// freed stacks each CPU keeps mapped for the next thread it creates
+constexpr size_t KSTACK_CACHE_SIZE = 2;
+
+/// \brief get a mapped kernel stack, from the cache of the current CPU when it has one
+/// \return the lowest address of the stack, or nullptr
+[[nodiscard]] void* kstack_allocate();
+
+/// \brief give back a stack returned by kstack_allocate. It stays mapped in the cache of the current CPU
+/// if there is room, otherwise the teardown thread unmaps it and frees its pages
+void kstack_free(void* stack);
+
+/// \brief register the shrinker that releases cached stacks
+void kstack_init();
+
+}
@@ -5,6 +5,13 @@
 
 #include "ktl/concepts.hpp"
 
+#include "kbl/atomic/atomic_ref.hpp"
+
+namespace memory
+{
+class address_space;
+}
+
 enum [[clang::flag_enum]] page_flags
 {
 	PHYSICAL_PAGE_FLAG_RESERVED = 0b01,
@@ -12,6 +19,8 @@ enum [[clang::flag_enum]] page_flags
 	PHYSICAL_PAGE_FLAG_ACTIVE = 0b100,
 	PHYSICAL_PAGE_FLAG_DIRTY = 0b1000,
 	PHYSICAL_PAGE_FLAG_SWAP = 0b1000,
+	PHYSICAL_PAGE_FLAG_SLAB = 0b10000,
+	PHYSICAL_PAGE_FLAG_ISOLATED = 0b100000, // taken out of the provider by compaction
 };
 
 // Physical memory pages
@@ -22,6 +31,11 @@ struct page
 	size_t property;
 	size_t zone_id;
 	list_head page_link;
+
+	// reverse mapping of a user page mapped by a single address space, used to migrate it.
+	// it may be stale, so users check the page table before trusting it
+	memory::address_space* rmap_owner;
+	uintptr_t rmap_va;
 };
 static_assert(ktl::is_standard_layout_v<page>);
 
@@ -39,3 +53,32 @@ static inline void page_clear_flag(page* pg, page_flags fl)
 {
 	pg->flags &= ~fl;
 }
+
+// page::ref counts the mappings of a page. Pages shared copy-on-write are mapped by
+// several address spaces at a time, so the count is changed atomically.
+static inline size_t page_ref_inc(page* pg)
+{
+	return ++kbl::integral_atomic_ref<size_t>{ pg->ref };
+}
+
+static inline size_t page_ref_dec(page* pg)
+{
+	return --kbl::integral_atomic_ref<size_t>{ pg->ref };
+}
+
+static inline size_t page_ref_count(page* pg)
+{
+	return kbl::integral_atomic_ref<size_t>{ pg->ref }.load();
+}
+
+static inline void page_set_rmap(page* pg, memory::address_space* owner, uintptr_t va)
+{
+	pg->rmap_owner = owner;
+	pg->rmap_va = va;
+}
+
+static inline void page_clear_rmap(page* pg)
+{
+	pg->rmap_owner = nullptr;
+	pg->rmap_va = 0;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "system/types.h"
+
+#include "kbl/data/pod_list.h"
+
+#include "memory/page.hpp"
+
+namespace memory
+{
+
+/// \brief per-CPU list of single pages sitting in front of the buddy allocator.
+/// Pages freed on this CPU are pushed to the hot end and handed out first,
+/// pages coming from a batch refill are appended to the cold end,
+/// and drains give back pages from the cold end.
+/// It must only be touched by its owner CPU with interrupts disabled.
+class per_cpu_pages final
+{
+ public:
+	// pages moved between this list and the buddy allocator at a time
+	static constexpr size_t BATCH = 16;
+
+	// drain down to HIGH - BATCH once more pages than this are cached
+	static constexpr size_t HIGH = BATCH * 4;
+
+	struct statistics
+	{
+		size_t alloc_hits;
+		size_t alloc_misses;
+		size_t free_hits;
+		size_t refills;
+		size_t drains;
+	};
+
+ public:
+	per_cpu_pages()
+	{
+		kbl::list_init(&pages_);
+	}
+
+	per_cpu_pages(const per_cpu_pages&) = delete;
+	per_cpu_pages& operator=(const per_cpu_pages&) = delete;
+
+	[[nodiscard]] bool empty() const
+	{
+		return count_ == 0;
+	}
+
+	[[nodiscard]] size_t count() const
+	{
+		return count_;
+	}
+
+	[[nodiscard]] bool above_high() const
+	{
+		return count_ > HIGH;
+	}
+
+	void push_hot(page* pg)
+	{
+		kbl::list_add(&pg->page_link, &pages_);
+		count_++;
+	}
+
+	void push_cold(page* pg)
+	{
+		kbl::list_add_tail(&pg->page_link, &pages_);
+		count_++;
+	}
+
+	[[nodiscard]] page* pop_hot()
+	{
+		if (empty())
+		{
+			return nullptr;
+		}
+
+		auto entry = pages_.next;
+		kbl::list_remove(entry);
+		count_--;
+
+		return list_entry(entry, page, page_link);
+	}
+
+	[[nodiscard]] page* pop_cold()
+	{
+		if (empty())
+		{
+			return nullptr;
+		}
+
+		auto entry = pages_.prev;
+		kbl::list_remove(entry);
+		count_--;
+
+		return list_entry(entry, page, page_link);
+	}
+
+	[[nodiscard]] statistics& stats()
+	{
+		return stats_;
+	}
+
+	[[nodiscard]] const statistics& stats() const
+	{
+		return stats_;
+	}
+
+ private:
+	list_head pages_{};
+	size_t count_{ 0 };
+
+	statistics stats_{};
+};
+
+}
@@ -9,10 +9,14 @@
 #include "memory/fpage.hpp"
 #include "memory/pmm_provider.hpp"
 #include "memory/buddy_provider.hpp"
+#include "memory/per_cpu_pages.hpp"
+#include "memory/zeroed_pages.hpp"
 
 namespace memory
 {
 
+class tlb_batch;
+
 class physical_memory_manager final
 	// we do not use singleton because it overwrite the ap_boot
 	//	: public kbl::singleton<physical_memory_manager>
@@ -46,25 +50,98 @@ class physical_memory_manager final
 		vmm::pde_ptr_t pgdir,
 		bool rewrite_if_exist);
 
+	/// \brief allocate pages filled with zero, from the pre-zeroed pool when it has them
+	[[nodiscard]] page* allocate_zeroed();
+	[[nodiscard]] page* allocate_zeroed(size_t n);
+	[[nodiscard]] error_code_with_result<page*> allocate_zeroed(uintptr_t addr,
+		uint64_t perm,
+		vmm::pde_ptr_t pgdir,
+		bool rewrite_if_exist);
+
 	void free(page* base);
 	void free(page* base, size_t n);
 
+	/// \brief pages free in the provider. Those in the per-CPU caches and the zeroed pool aren't counted
 	[[nodiscard]] size_t free_count() const;
+	[[nodiscard]] size_t free_count(size_t node) const;
+
+	/// \brief put the physical memory in [pa, pa + size) in the given NUMA node
+	void assign_node(uintptr_t pa, size_t size, size_t node);
+
+	/// \brief the nodes to allocate from when node is the one of the current CPU, nearest first
+	void set_node_fallback(size_t node, const size_t* nodes, size_t count);
+
+	/// \brief statistics of the given CPU's single-page cache
+	[[nodiscard]] per_cpu_pages::statistics per_cpu_statistics(cpu_num_type cpu_id) const;
+
+	/// \brief give all pages cached by the current CPU back to the provider
+	void drain_per_cpu();
+
+	/// \brief zero up to budget pages into the pre-zeroed pool with non-temporal stores.
+	/// A 2MB block is zeroed over several calls, and pooled once it's done. Only the zeroing thread calls it
+	/// \return true if the pool still wants more
+	bool refill_zeroed(size_t budget);
+
+	/// \brief give the pre-zeroed pool back to the provider
+	void drain_zeroed();
+
+	[[nodiscard]] zeroed_pages::statistics zeroed_statistics() const;
+
+	/// \brief the index-th block of 2^order pages that the provider can merge into one
+	/// \return its first page, or nullptr past the last block
+	[[nodiscard]] page* block_at(size_t order, size_t index) const;
+
+	/// \brief take the free pages of the block of 2^order pages at base out of the provider,
+	/// if each of its other pages is a user page mapped by a single address space
+	/// \return false if some page can't be migrated, or the block is free already
+	bool isolate_block(page* base, size_t order);
+
+	/// \brief give the isolated pages of the block back to the provider
+	/// \return true if they are the whole block, which is then free in one piece
+	bool release_block(page* base, size_t order);
 
 	error_code insert_page(page* page, uintptr_t va, uint64_t perm, vmm::pde_ptr_t pgdir, bool allow_rewrite);
+
+	/// \brief map page at va, leaving the invalidation of a replaced entry and its freeing to the batch
+	error_code insert_page(page* page,
+		uintptr_t va,
+		uint64_t perm,
+		vmm::pde_ptr_t pgdir,
+		bool allow_rewrite,
+		tlb_batch& batch);
 	void remove_page(uintptr_t va, vmm::pde_ptr_t pgdir);
 
-	// TODO: this should belong to VMM
+	/// \brief unmap the page at va, leaving the invalidation and the freeing to the batch
+	void remove_page(uintptr_t va, vmm::pde_ptr_t pgdir, tlb_batch& batch);
+
+	// invalidate va on every CPU that uses pgdir
 	void flush_tlb(vmm::pde_ptr_t pgdir, uintptr_t va);
 
  private:
 
-	void remove_from_pgdir(vmm::pde_ptr_t pde, vmm::pde_ptr_t pgdir, uintptr_t va);
+	void remove_from_pgdir(vmm::pde_ptr_t pde, uintptr_t va, tlb_batch& batch);
+
+	// the NUMA node of the current CPU
+	static size_t local_node();
 
+	page* allocate_no_reclaim(size_t n);
 	page* allocate_locked(size_t n);
 
+	page* allocate_per_cpu();
+	void free_per_cpu(page* pg);
+
+	void refill_locked(per_cpu_pages& pcp) TA_REQ(lock_);
+	void drain_locked(per_cpu_pages& pcp, size_t count) TA_REQ(lock_);
+
 	provider_type provider_{};
 	mutable lock::spinlock lock_{ "pmm" };
+
+	zeroed_pages zeroed_ TA_GUARDED(zeroed_lock_){};
+	mutable lock::spinlock zeroed_lock_{ "pmm_zeroed" };
+
+	// the 2MB block refill_zeroed is part way through, and how many of its pages are zero
+	page* zeroing_block_{ nullptr };
+	size_t zeroing_block_done_{ 0 };
 };
 
 }
\ No newline at end of file
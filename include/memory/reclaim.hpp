@@ -0,0 +1,44 @@
+#pragma once
+
+#include "system/types.h"
+
+#include "kbl/data/pod_list.h"
+
+namespace memory
+{
+
+// reclaim is due once the provider has fewer free pages than this, 4MB
+constexpr size_t RECLAIM_LOW_WATERMARK = 1024;
+
+// and frees memory until it has this many, 16MB
+constexpr size_t RECLAIM_HIGH_WATERMARK = 4096;
+
+/// \brief lets a subsystem give back memory it can rebuild, such as cached blocks.
+/// scan may be called from the allocation path of any context, so it must neither sleep nor allocate,
+/// and should skip whatever it can't lock right away.
+struct shrinker
+{
+	const char* name;
+
+	/// \return count of pages freed, up to target
+	size_t (* scan)(shrinker* self, size_t target);
+
+	list_head link;
+};
+
+void register_shrinker(shrinker* s);
+void unregister_shrinker(shrinker* s);
+
+/// \brief free up to target pages held by caches: the pre-zeroed pool, the per-CPU page cache,
+/// empty slabs of kmem caches, and the registered shrinkers, in this order.
+/// It does nothing while another reclaim runs.
+/// \return count of pages freed
+size_t reclaim(size_t target);
+
+/// \brief note that free memory has fallen below the low watermark
+void reclaim_kick();
+
+/// \brief reclaim up to the high watermark if it has been kicked, called when the CPU is idle
+void reclaim_if_needed();
+
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "system/types.h"
+#include "system/vmm.h"
+
+namespace memory
+{
+
+// pages dropped between two flushes of the teardown thread, after which it lets other threads run
+constexpr size_t TEARDOWN_BATCH_PAGES = 512;
+
+/// \brief hand the page table of an address space that is gone to the teardown thread,
+/// which drops the user pages mapped through it and frees its tables in batches.
+/// It neither sleeps nor allocates, so that exiting costs the same however large the process was.
+void teardown_defer(vmm::pde_ptr_t pgdir);
+
+/// \brief a range of the kernel page table waiting for the teardown thread to unmap it.
+/// It's kept in the first page of the range itself, so the range must have that page mapped
+struct kernel_range
+{
+	uintptr_t start;
+	uintptr_t end;
+
+	// called once the range is unmapped and its pages are freed, after which it may be handed out again
+	void (*release)(uintptr_t start, uintptr_t end);
+
+	list_head link;
+};
+
+/// \brief hand [start, end) of the kernel page table to the teardown thread, which unmaps it and calls release.
+/// Shooting down the kernel page table waits for every CPU, which deadlocks if the caller holds a lock another CPU
+/// spins on with interrupts off, so it's never done in place. Like teardown_defer, it neither sleeps nor allocates
+void teardown_defer_kernel_range(uintptr_t start, uintptr_t end, void (*release)(uintptr_t start, uintptr_t end));
+
+/// \brief wake the teardown thread if page tables were deferred while it couldn't be woken, called when the CPU is idle
+void teardown_wake_if_needed();
+
+/// \brief start the teardown thread, once the schedulers exist
+void teardown_init();
+
+}
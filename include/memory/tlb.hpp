@@ -0,0 +1,90 @@
+#pragma once
+
+#include "system/types.h"
+#include "system/vmm.h"
+
+#include "memory/page.hpp"
+
+namespace memory
+{
+
+/// \brief per-CPU state used by TLB shootdowns
+struct tlb_cpu_state
+{
+	// physical address of the page table loaded in CR3, only this CPU writes it
+	uintptr_t active_pgdir;
+
+	// set by the initiator of a shootdown, cleared by this CPU once it has invalidated the request
+	bool pending;
+};
+
+/// \brief collects the invalidations of one page table, and carries them out with a single
+/// IPI per batch to the other CPUs that have the page table loaded.
+/// Pages unmapped through the batch are only freed after every CPU has dropped its stale entries.
+/// Flushing waits for the other CPUs, so don't flush while holding a lock they may spin on
+/// with interrupts disabled.
+class tlb_batch final
+{
+ public:
+	// ranges kept before the batch degrades to a full flush
+	static constexpr size_t MAX_RANGES = 8;
+
+	// pages invalidated one by one before the batch degrades to a full flush
+	static constexpr size_t FULL_FLUSH_THRESHOLD = 32;
+
+	explicit tlb_batch(vmm::pde_ptr_t pgdir);
+	~tlb_batch();
+
+	tlb_batch(const tlb_batch&) = delete;
+	tlb_batch& operator=(const tlb_batch&) = delete;
+
+	/// \brief invalidate [start, end) when the batch is flushed
+	void add_range(uintptr_t start, uintptr_t end);
+
+	/// \brief free n pages starting from pg once the batch is flushed
+	void defer_free(page* pg, size_t n);
+
+	/// \brief give an empty page table that mapped [start, end) back to the page table allocator
+	/// once the batch is flushed, which drops the paging-structure caches that may still point to it
+	void defer_free_table(vmm::pde_ptr_t table, uintptr_t start, uintptr_t end);
+
+	/// \brief invalidate the collected ranges on every CPU that uses the page table,
+	/// and free the deferred pages. The batch can be reused afterwards.
+	void flush();
+
+	[[nodiscard]] bool empty() const
+	{
+		return range_count_ == 0 && !full_;
+	}
+
+ private:
+	struct range
+	{
+		uintptr_t start;
+		uintptr_t end;
+	};
+
+	vmm::pde_ptr_t pgdir_{ nullptr };
+
+	range ranges_[MAX_RANGES]{};
+	size_t range_count_{ 0 };
+	size_t page_count_{ 0 };
+	bool full_{ false };
+
+	// chained by page_link, with the count of each block in property
+	list_head free_list_{};
+
+	// page tables, chained by page_link
+	list_head table_list_{};
+};
+
+/// \brief register the shootdown IPI handler
+void tlb_init();
+
+/// \brief record that the current CPU is about to load pgdir into CR3
+void tlb_activate(vmm::pde_ptr_t pgdir);
+
+/// \brief invalidate a single page of pgdir on every CPU that uses it
+void tlb_flush_page(vmm::pde_ptr_t pgdir, uintptr_t va);
+
+}
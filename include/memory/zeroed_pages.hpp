@@ -0,0 +1,98 @@
+#pragma once
+
+#include "system/types.h"
+#include "system/mmu.h"
+
+#include "kbl/data/pod_list.h"
+
+#include "memory/page.hpp"
+
+namespace memory
+{
+
+/// \brief pages and 2MB blocks that are already filled with zero, taken out of the provider ahead of time.
+/// The zeroing thread refills it in the background, so that faults and process creation don't zero memory on their critical path.
+/// Callers serialize access to it.
+class zeroed_pages final
+{
+ public:
+	// single pages kept ready, 1MB
+	static constexpr size_t SMALL_TARGET = 256;
+
+	// 2MB blocks kept ready
+	static constexpr size_t LARGE_TARGET = 4;
+
+	struct statistics
+	{
+		size_t hits;
+		size_t misses;
+		size_t zeroed_pages;
+	};
+
+ public:
+	zeroed_pages()
+	{
+		kbl::list_init(&small_);
+		kbl::list_init(&large_);
+	}
+
+	zeroed_pages(const zeroed_pages&) = delete;
+	zeroed_pages& operator=(const zeroed_pages&) = delete;
+
+	[[nodiscard]] static bool pooled(size_t n)
+	{
+		return n == 1 || n == LARGE_PAGE_PAGES;
+	}
+
+	[[nodiscard]] size_t count(size_t n) const
+	{
+		return n == 1 ? small_count_ : large_count_;
+	}
+
+	[[nodiscard]] bool below_target(size_t n) const
+	{
+		return n == 1 ? small_count_ < SMALL_TARGET : large_count_ < LARGE_TARGET;
+	}
+
+	void push(page* pg, size_t n)
+	{
+		kbl::list_add(&pg->page_link, n == 1 ? &small_ : &large_);
+		(n == 1 ? small_count_ : large_count_)++;
+	}
+
+	[[nodiscard]] page* pop(size_t n)
+	{
+		auto head = n == 1 ? &small_ : &large_;
+		if (kbl::list_empty(head))
+		{
+			return nullptr;
+		}
+
+		auto entry = head->next;
+		kbl::list_remove(entry);
+		(n == 1 ? small_count_ : large_count_)--;
+
+		return list_entry(entry, page, page_link);
+	}
+
+	[[nodiscard]] statistics& stats()
+	{
+		return stats_;
+	}
+
+	[[nodiscard]] const statistics& stats() const
+	{
+		return stats_;
+	}
+
+ private:
+	list_head small_{};
+	list_head large_{};
+
+	size_t small_count_{ 0 };
+	size_t large_count_{ 0 };
+
+	statistics stats_{};
+};
+
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "system/types.h"
+
+namespace memory
+{
+
+// pages zeroed in one pass of the zeroing thread, before it lets the others run
+constexpr size_t ZEROING_BATCH_PAGES = 16;
+
+void zeroing_kick();
+
+void zeroing_wake_if_needed();
+
+void zeroing_init();
+
+}
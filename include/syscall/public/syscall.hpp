@@ -34,6 +34,23 @@ enum SYSCALL_NUMBER
 	SYS_ipc_accept,
 	SYS_ipc_call,
 	SYS_ipc_wait,
+
+	SYS_mmap,
+	SYS_munmap,
+
+	// print the allocation sites and the kmem caches to the debug console
+	SYS_dump_alloc_profile,
+};
+
+// flags of SYS_mmap
+enum MMAP_FLAGS : uint64_t
+{
+	MMAP_READ = 0x1,
+	MMAP_WRITE = 0x2,
+	MMAP_EXEC = 0x4,
+	MMAP_FIXED = 0x8, // map at the given address, which fails if something is there, instead of taking it as a hint
+	MMAP_POPULATE = 0x10, // fault the whole range in before returning
+	MMAP_HUGE = 0x20, // align the range to 2MB and back it with 2MB pages where possible
 };
 
 }
\ No newline at end of file
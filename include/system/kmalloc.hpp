@@ -17,6 +17,15 @@ namespace memory
 void* kmalloc(size_t sz, [[maybe_unused]] size_t flags);
 void kfree(void* ptr);
 
+// like kmalloc, but charges the block to caller when allocation profiling is enabled,
+// so that wrappers such as operator new don't show up as the call site of everything
+void* kmalloc_from(size_t sz, [[maybe_unused]] size_t flags, uintptr_t caller);
+
+// allocate sz bytes that are only virtually contiguous, so that it doesn't depend on a free buddy block as large.
+// the memory is page-aligned, with an unmapped guard page after it. don't use it for DMA.
+void* vmalloc(size_t sz);
+void vfree(void* ptr);
+
 template<typename T, size_t T_FLAGS = 0>
 struct kernel_stl_allocator
 {
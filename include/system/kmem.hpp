@@ -22,17 +22,64 @@ constexpr size_t KMEM_CACHE_NAME_MAXLEN = 32;
 
 constexpr size_t KMEM_MAX_SIZED_CACHE_SIZE = 10240;
 constexpr size_t KMEM_MIN_SIZED_CACHE_SIZE = 16;
-constexpr size_t KMEM_SIZED_CACHE_COUNT = log2p1(KMEM_MAX_SIZED_CACHE_SIZE / KMEM_MIN_SIZED_CACHE_SIZE);
+
+// object sizes of the caches behind kmalloc, ascending.
+// 16-byte steps up to 128, then four classes per power of two, so that no more than 25% of an object is wasted
+constexpr size_t KMEM_SIZE_CLASSES[] = {
+	16, 32, 48, 64, 80, 96, 112, 128,
+	160, 192, 224, 256,
+	320, 384, 448, 512,
+	640, 768, 896, 1024,
+	1280, 1536, 1792, 2048,
+	2560, 3072, 3584, 4096,
+	5120, 6144, 7168, 8192,
+	10240,
+};
+
+constexpr size_t KMEM_SIZED_CACHE_COUNT = sizeof(KMEM_SIZE_CLASSES) / sizeof(KMEM_SIZE_CLASSES[0]);
+
+static_assert(KMEM_SIZE_CLASSES[0] == KMEM_MIN_SIZED_CACHE_SIZE);
+static_assert(KMEM_SIZE_CLASSES[KMEM_SIZED_CACHE_COUNT - 1] == KMEM_MAX_SIZED_CACHE_SIZE);
+
+// a slab spans more pages until it can hold this many objects
+constexpr size_t KMEM_SLAB_MIN_OBJ_COUNT = 8;
+
+// objects a magazine holds
+constexpr size_t KMEM_MAGAZINE_SIZE = 15;
+
+// should be no less than CPU_COUNT_LIMIT, which is checked in kmem.cc
+constexpr size_t KMEM_CPU_CACHE_COUNT = 8;
 
 enum kmem_cache_flags
 {
 	KMEM_CACHE_4KALIGN = 0b1,
+	KMEM_CACHE_NOMAGAZINE = 0b10,
+};
+
+struct kmem_magazine;
+
+// only touched by its owner CPU with interrupts disabled
+struct kmem_cpu_cache
+{
+	kmem_magazine* loaded;
+	kmem_magazine* previous;
+
+	size_t alloc_hits, alloc_misses;
+	size_t free_hits, free_misses;
 };
 
 struct kmem_cache
 {
 	list_head full, partial, free;
+
+	// magazines that aren't loaded by any CPU, guarded by lock
+	list_head depot_full, depot_empty;
+	size_t depot_full_count, depot_empty_count;
+
+	kmem_cpu_cache cpu_caches[KMEM_CPU_CACHE_COUNT];
+
 	size_t obj_size, obj_count;
+	size_t slab_size;
 	size_t flags;
 	kmem_ctor_type ctor;
 	kmem_dtor_type dtor;
@@ -42,6 +89,19 @@ struct kmem_cache
 	lock::spinlock lock{ "kmem_cache" };
 };
 
+struct kmem_cache_statistics
+{
+	size_t obj_size, slab_size;
+	size_t slabs_full, slabs_partial, slabs_free;
+
+	// objects the slabs can hold, objects handed out, and objects parked in magazines
+	size_t objs_total, objs_inuse, objs_cached;
+
+	// summed over the CPUs
+	size_t alloc_hits, alloc_misses;
+	size_t free_hits, free_misses;
+};
+
 void kmem_init();
 kmem_cache* kmem_cache_create(const char* name,
 	size_t size,
@@ -52,9 +112,25 @@ kmem_cache* kmem_cache_create(const char* name,
 void* kmem_cache_alloc(kmem_cache* cache);
 void kmem_cache_destroy(kmem_cache* cache);
 void kmem_cache_free(kmem_cache* cache, void* obj);
+
+// free the empty slabs and the spare magazines of the cache, returns the count of pages freed
 size_t kmem_cache_shrink(kmem_cache* cache);
+
+// shrink every cache that isn't locked at the moment, returns the count of pages freed
 size_t kmem_cache_reap();
 
+// like kmem_cache_alloc, but charges the object to caller when allocation profiling is enabled
+void* kmem_cache_alloc_from(kmem_cache* cache, uintptr_t caller);
+
+// free an object without charging the free to the cache, for callers that charge it themselves
+void kmem_cache_free_untracked(kmem_cache* cache, void* obj);
+
+// takes the lock of the cache. magazine counters of other CPUs are read without it, so they may be slightly off
+void kmem_cache_stats(kmem_cache* cache, kmem_cache_statistics* st);
+
+// call fn for every cache, with the list of caches locked, so fn mustn't create or destroy caches
+void kmem_cache_for_each(void (* fn)(kmem_cache* cache, void* arg), void* arg);
+
 } // namespace kmem
 
 } // namespace memory
@@ -75,6 +75,21 @@ constexpr bool VALID_USER_REGION(uintptr_t start, uintptr_t end)
 // leave a page guard hole
 constexpr uintptr_t USER_STACK_TOP = USER_TOP - PAGE_SIZE;
 
+// anonymous mappings are placed here, well above the heap and below the stacks
+constexpr uintptr_t USER_MMAP_BASE = 0x0000100000000000;
+constexpr uintptr_t USER_MMAP_END = 0x0000700000000000;
+
+// kernel stacks, each with an unmapped guard page below it.
+// it takes a whole PML4 entry, which is filled at boot so that every address space shares its page tables
+constexpr uintptr_t KSTACK_VIRTUALBASE = 0xffffc90000000000;
+constexpr size_t KSTACK_REGION_SIZE = 512_GB;
+constexpr uintptr_t KSTACK_VIRTUALEND = KSTACK_VIRTUALBASE + KSTACK_REGION_SIZE;
+
+// virtually contiguous kernel allocations, backed by discontiguous frames. filled at boot like the stacks
+constexpr uintptr_t VMALLOC_VIRTUALBASE = 0xffffca0000000000;
+constexpr size_t VMALLOC_REGION_SIZE = 512_GB;
+constexpr uintptr_t VMALLOC_VIRTUALEND = VMALLOC_VIRTUALBASE + VMALLOC_REGION_SIZE;
+
 // for memory-mapped IO
 // TODO: dynamically map for memory-mapped IO
 constexpr uintptr_t DEVICE_VIRTUALBASE = 0xFFFFFFFF40000000;
@@ -4,7 +4,7 @@
 #error "This header is only for assemblies"
 #endif
 
-#define PMM_PAGE_SIZE 2097152
+#define PMM_PAGE_SIZE 4096
 
 #define USER_TOP 0x00007fffffffffff
 #define USER_STACK_TOP (USER_TOP - 2 * PMM_PAGE_SIZE)
\ No newline at end of file
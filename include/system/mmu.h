@@ -5,8 +5,6 @@
 constexpr size_t PDENTRIES_COUNT = 512;
 constexpr size_t PTENTRIES_COUNT = 512;
 
-constexpr bool PG_PS_ENABLE = true;
-
 constexpr size_t PG_SIZE = 4_KB;
 constexpr size_t PG_PS_SIZE = 2_MB;
 
@@ -15,13 +13,22 @@ constexpr size_t PDPT_SIZE = 1_GB;
 
 constexpr size_t PGTABLE_SIZE = 4_KB;
 
-constexpr size_t PAGE_SIZE = PG_PS_ENABLE ? PG_PS_SIZE : PG_SIZE;
+// 4K pages are the default granularity.
+constexpr size_t PAGE_SIZE = PG_SIZE;
+
+// 2MB mappings are kept as an opt-in for large, aligned regions
+constexpr size_t LARGE_PAGE_SIZE = PG_PS_SIZE;
+constexpr size_t LARGE_PAGE_PAGES = LARGE_PAGE_SIZE / PAGE_SIZE;
 
 constexpr size_t P4_SHIFT = 39;
 constexpr size_t P3_SHIFT = 30;
 constexpr size_t P2_SHIFT = 21;   // for 2mb paging, this is the lowest level.
+constexpr size_t P1_SHIFT = 12;
 constexpr size_t PX_MASK = 0x1FF; //9bit
 
+// the physical address bits of a page table entry
+constexpr size_t PTE_ADDR_MASK = 0x000FFFFFFFFFF000;
+
 static inline constexpr size_t P4X(size_t addr)
 {
 	return (addr >> P4_SHIFT) & PX_MASK;
@@ -37,6 +44,11 @@ static inline constexpr size_t P2X(size_t addr)
 	return (addr >> P2_SHIFT) & PX_MASK;
 }
 
+static inline constexpr size_t P1X(size_t addr)
+{
+	return (addr >> P1_SHIFT) & PX_MASK;
+}
+
 static inline constexpr size_t PAGE_ROUNDUP(size_t addr)
 {
 	return (((addr) + ((size_t)PAGE_SIZE - 1)) & ~((size_t)(PAGE_SIZE - 1)));
@@ -47,6 +59,16 @@ static inline constexpr size_t PAGE_ROUNDDOWN(size_t addr)
 	return (((addr)) & ~((size_t)(PAGE_SIZE - 1)));
 }
 
+static inline constexpr size_t LARGE_PAGE_ROUNDUP(size_t addr)
+{
+	return (((addr) + ((size_t)LARGE_PAGE_SIZE - 1)) & ~((size_t)(LARGE_PAGE_SIZE - 1)));
+}
+
+static inline constexpr size_t LARGE_PAGE_ROUNDDOWN(size_t addr)
+{
+	return (((addr)) & ~((size_t)(LARGE_PAGE_SIZE - 1)));
+}
+
 // Page table/directory entry flags_
 enum pde_flags
 {
@@ -59,6 +81,7 @@ enum pde_flags
 	PG_D = 0x040,   // Dirty
 	PG_PS = 0x080,  // Page Size
 	PG_MBZ = 0x180, // Bits must be zero
+	PG_COW = 0x200, // Available for software: shared copy-on-write
 };
 
 enum exception_type : uint32_t
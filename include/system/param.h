@@ -1 +1,6 @@
 #pragma once
+
+#include "system/types.h"
+
+// proximity domains beyond this share the last node
+constexpr size_t NUMA_NODE_COUNT_LIMIT = 4;
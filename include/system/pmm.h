@@ -43,10 +43,14 @@ extern size_t page_count;
 
 void init_pmm();
 
+// place the managed memory in the NUMA nodes described by ACPI
+void init_numa();
 
+
+// aligned to large pages, so that buddy blocks of large page order are naturally aligned
 static inline uintptr_t pavailable_start(void)
 {
-	return V2P(roundup((uintptr_t)(&pages[page_count]), PAGE_SIZE));
+	return V2P(roundup((uintptr_t)(&pages[page_count]), LARGE_PAGE_SIZE));
 }
 
 static inline size_t page_to_index(page* pg)
@@ -68,7 +72,7 @@ static inline uintptr_t page_to_va(page* pg)
 
 static inline page* pa_to_page(uintptr_t pa)
 {
-	size_t index = rounddown((pa - (V2P((uintptr_t)&pages[page_count]))), PAGE_SIZE) / PAGE_SIZE;
+	size_t index = rounddown((pa - pavailable_start()), PAGE_SIZE) / PAGE_SIZE;
 	KDEBUG_ASSERT(index < page_count);
 	return &pages[index];
 }
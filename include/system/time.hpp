@@ -13,6 +13,11 @@ using duration_type = int64_t;
 constexpr time_type TIME_INFINITE_PAST = INT64_MIN;
 constexpr time_type TIME_INFINITE = INT64_MAX;
 
+// time_type and duration_type count nanoseconds
+constexpr duration_type NSEC_PER_USEC = 1000;
+constexpr duration_type NSEC_PER_MSEC = 1000 * NSEC_PER_USEC;
+constexpr duration_type NSEC_PER_SEC = 1000 * NSEC_PER_MSEC;
+
 constexpr static inline time_type time_add_duration(time_type time, duration_type duration)
 {
 	time_type x = 0;
@@ -24,6 +24,11 @@
 
 #include "memory/fpage.hpp"
 
+namespace memory
+{
+class tlb_batch;
+}
+
 #include "kbl/lock/spinlock.h"
 
 namespace vmm
@@ -35,8 +40,10 @@ using pde_ptr_t = pde_t*;
 // paging.cc
 extern vmm::pde_ptr_t g_kpml4t;
 
+// a zeroed page for a page table, from the cache of the current CPU
 vmm::pde_ptr_t pgdir_entry_alloc();
 
+// the table must be all zero, so that it can be handed out again as it is
 void pgdir_entry_free(vmm::pde_ptr_t entry);
 
 // initialize the vmm
@@ -63,14 +70,25 @@ uintptr_t pde_to_pa(pde_ptr_t pde);
 
 pde_ptr_t walk_pgdir(pde_ptr_t pgdir, size_t va, bool create);
 
-// map/nmap or free memory ranges
+// walk to the page directory entry, which maps a 2MB page
+pde_ptr_t walk_pgdir_large(pde_ptr_t pgdir, size_t va, bool create);
+
+// map/nmap or free memory ranges, which are [start, end)
 error_code map_range(pde_ptr_t pgdir, uintptr_t va_start, uintptr_t pa_start, size_t len);
 
 void free_range(pde_ptr_t pgdir, uintptr_t start, uintptr_t end);
 
+// the freed tables are given back once the batch is flushed
+void free_range(pde_ptr_t pgdir, uintptr_t start, uintptr_t end, memory::tlb_batch& batch);
+
 void unmap_range(pde_ptr_t pgdir, uintptr_t start, uintptr_t end);
 
-void copy_range(pde_ptr_t from, pde_ptr_t to, uintptr_t start, uintptr_t end);
+// the stale entries are invalidated, and the pages freed, when the batch is flushed
+void unmap_range(pde_ptr_t pgdir, uintptr_t start, uintptr_t end, memory::tlb_batch& batch);
+
+// share the pages in the range with another page table, copy-on-write if they are writable.
+// the write access from loses is invalidated when the batch is flushed
+error_code copy_range(pde_ptr_t from, pde_ptr_t to, uintptr_t start, uintptr_t end, memory::tlb_batch& batch);
 
 } // namespace vmm
 
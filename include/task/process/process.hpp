@@ -48,7 +48,7 @@ enum process_flags
 class process_user_stack_state
 {
  public:
-	[[maybe_unused]]static constexpr size_t USTACK_PAGES_PER_THREAD = 8;
+	[[maybe_unused]]static constexpr size_t USTACK_PAGES_PER_THREAD = 64;
 	[[maybe_unused]]static constexpr size_t USTACK_GUARD_PAGES_PER_THREAD = 1;
 	[[maybe_unused]]static constexpr size_t
 		USTACK_TOTAL_PAGES_PER_THREAD = (USTACK_GUARD_PAGES_PER_THREAD + USTACK_PAGES_PER_THREAD);
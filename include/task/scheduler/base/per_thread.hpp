@@ -12,5 +12,8 @@ class scheduler_state_base
 	virtual bool nice_available() = 0;
 	virtual int32_t get_nice() = 0;
 	virtual void set_nice(int32_t nice) = 0;
+
+	// background threads only get what's left over by the others
+	virtual void set_background(bool background) = 0;
 };
 }
\ No newline at end of file
@@ -20,11 +20,6 @@ class fcfs_scheduler_class final
 	                                                                   &thread::run_queue_link,
 	                                                                   true>;
 
-	using zombie_queue_list_type = kbl::intrusive_list_with_default_trait<thread,
-	                                                                      lock::spinlock,
-	                                                                      &thread::zombie_queue_link,
-	                                                                      true>;
-
  public:
 	explicit fcfs_scheduler_class(class scheduler* pa) : parent_(pa)
 	{
@@ -36,7 +31,7 @@ class fcfs_scheduler_class final
 	fcfs_scheduler_class(fcfs_scheduler_class&&) = delete;
 	fcfs_scheduler_class& operator=(const fcfs_scheduler_class&) = delete;
 
-	thread* steal(cpu_struct* stealer_cpu) final;
+	thread* steal(cpu_struct* stealer_cpu, bool allow_hot) final;
 
 	void enqueue(thread* thread) final;
 
@@ -51,10 +46,8 @@ class fcfs_scheduler_class final
  private:
 	class scheduler* parent_{ nullptr };
 
-	run_queue_list_type run_queue_ TA_GUARDED(lock_);
-	zombie_queue_list_type zombie_queue_ TA_GUARDED(lock_);
-
-	mutable lock::spinlock lock_;
+	// guarded by the run queue lock of parent_
+	run_queue_list_type run_queue_;
 };
 
 }
\ No newline at end of file
@@ -25,6 +25,11 @@ class fcfs_scheduler_state_base
 	{
 		KDEBUG_GERNERALPANIC_CODE(ERROR_UNSUPPORTED);
 	}
+
+	void set_background([[maybe_unused]]bool background) override
+	{
+		// threads run in the order they come, there is no priority to lower
+	}
 };
 
 }
\ No newline at end of file
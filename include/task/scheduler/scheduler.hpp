@@ -12,6 +12,8 @@
 #include "kbl/data/list.hpp"
 
 #include "task/scheduler/scheduler_config.hpp"
+#include "task/scheduler/timer_wheel.hpp"
+#include "task/scheduler/topology.hpp"
 
 #if defined(_SCHEDULER_FCFS)
 #include "task/scheduler/fcfs/fcfs.hpp"
@@ -26,28 +28,32 @@
 namespace task
 {
 
-using scheduler_timer_callback = void (*)(struct scheduler_timer* timer, time_type time, void* arg);
-
-struct scheduler_timer
-{
-	int64_t expires{ 0 };
-	void* arg;
-	scheduler_timer_callback callback;
-
-	kbl::list_link<scheduler_timer, lock::spinlock> link{ this };
-};
-
 class scheduler
 {
  public:
 	using scheduler_class_type = USE_SCHEDULER_CLASS;
 
-	using timer_list_type = kbl::intrusive_list_with_default_trait<scheduler_timer,
-	                                                               lock::spinlock,
-	                                                               &scheduler_timer::link,
-	                                                               true>;
+	using zombie_queue_list_type = kbl::intrusive_list_with_default_trait<thread,
+	                                                                      lock::spinlock,
+	                                                                      &thread::zombie_queue_link,
+	                                                                      true>;
+
 	using size_type = size_t;
 
+	// ticks between two balancing passes at the SMT level, doubled for every level further
+	static constexpr uint64_t BALANCE_INTERVAL_MIN = 4;
+
+	// a level found balanced waits longer for the next pass, up to this many times its interval
+	static constexpr uint64_t BALANCE_BACKOFF_MAX = 8;
+
+	// how much busier, in percent, a CPU must be at each level before a thread is pulled from it
+	static constexpr size_type BALANCE_IMBALANCE_PERCENT[TOPOLOGY_LEVEL_COUNT] = { 10, 25, 50, 50 };
+
+	// a thread that ran this few ticks ago is left where its cache is, unless the level failed to balance
+	// this many times in a row because of such threads
+	static constexpr uint64_t CACHE_HOT_TICKS = 5;
+	static constexpr size_type BALANCE_FAILURES_MAX = 3;
+
 	friend class thread;
 
 	friend scheduler_class_type;
@@ -78,9 +84,16 @@ class scheduler
 	void insert(thread* t) TA_REQ(!global_thread_lock);
 	void insert_locked(thread* t) TA_REQ(global_thread_lock);
 
-	void add_timer(scheduler_timer* timer);
+	/// \brief arm timer on this CPU to fire in ticks timer ticks. Its callback is called from the timer tick,
+	/// without global_thread_lock held
+	void add_timer(scheduler_timer* timer, uint64_t ticks);
+
+	/// \brief disarm timer, on whichever CPU it is. If its callback is running, wait for it to return
+	/// \return whether the callback was kept from being called
+	static bool cancel_timer(scheduler_timer* timer);
 
-	void remove_timer(scheduler_timer* timer);
+	/// \brief move the timers of from, whose timer no longer ticks, to to
+	static void migrate_timers(scheduler* from, scheduler* to);
 
  public:
 
@@ -100,7 +113,7 @@ class scheduler
 
 		static void block_locked() TA_REQ(global_thread_lock);
 
-		static void timer_tick_handle() TA_REQ(!global_thread_lock, !timer_lock);
+		static void timer_tick_handle() TA_REQ(!global_thread_lock);
 
 		[[noreturn]]static void enter() TA_EXCL(global_thread_lock);
 	};
@@ -110,26 +123,67 @@ class scheduler
 
 	void schedule() TA_REQ(global_thread_lock);
 
-	void enqueue(thread* t);
-	void dequeue(thread* t);
-	thread* fetch();
-	thread* steal();
-	void tick(thread* t);
+	void enqueue(thread* t) TA_EXCL(run_queue_lock_);
+	void dequeue(thread* t) TA_EXCL(run_queue_lock_);
+	thread* fetch() TA_EXCL(run_queue_lock_);
+	void tick(thread* t) TA_REQ(!global_thread_lock, !run_queue_lock_);
+
+	/// \brief move a thread from the run queue of from to that of to.
+	/// Both run queue locks are taken in the order of the CPU ids, so that opposite migrations can't deadlock
+	/// \param allow_hot whether threads that just ran on from may be moved
+	/// \return whether a thread was moved
+	static bool migrate(scheduler* from, scheduler* to, bool allow_hot);
 
-	void check_timers_locked() TA_REQ(timer_lock);
+	/// \brief pull threads from busier CPUs, each topology level at its own interval. Called every tick by the owner
+	void balance() TA_EXCL(run_queue_lock_);
 
-	[[nodiscard]] size_type workload_size() const TA_REQ(!global_thread_lock);
-	[[nodiscard]] size_type workload_size_locked() const TA_REQ(global_thread_lock);
+	/// \brief pull a thread to this CPU, which is about to idle, from the closest CPU having one queued
+	void balance_idle() TA_EXCL(run_queue_lock_);
 
-	void timer_tick_handle() TA_REQ(!global_thread_lock, !timer_lock);
+	/// \brief the busiest CPU other than self sharing level with it, nullptr if none has a thread queued
+	static cpu_struct* find_busiest(cpu_struct* self, topology_level level, size_type& busiest_load);
+
+	/// \brief whether t ran on this CPU so recently that its cache is still there
+	[[nodiscard]] bool cache_hot(const thread* t) const;
+
+	/// \brief free the threads that died on this CPU, which are never the one running
+	void reap_zombies() TA_REQ(global_thread_lock);
+
+	/// \brief let the thread this CPU just switched away from run elsewhere, now that its context is saved
+	void finish_switch();
+
+	[[nodiscard]] size_type workload_size() const TA_EXCL(run_queue_lock_);
+
+	void timer_tick_handle() TA_REQ(!global_thread_lock);
 
 	cpu_struct* owner_cpu{ (cpu_struct*)INVALID_PTR_MAGIC };
 
-	scheduler_class_type scheduler_class{ this };
+	// the scheduler class is only called with run_queue_lock_ held. Unlike global_thread_lock,
+	// it is per CPU, so enqueueing, ticking and balancing on different CPUs don't contend
+	scheduler_class_type scheduler_class TA_GUARDED(run_queue_lock_){ this };
+
+	mutable lock::spinlock run_queue_lock_{ "run_queue" };
+
+	zombie_queue_list_type zombie_queue_ TA_GUARDED(global_thread_lock);
+
+	struct balance_state
+	{
+		uint64_t interval{ 0 };
+		uint64_t next_tick{ 0 };
+		size_type failures{ 0 };
+	};
+
+	// only touched by the owner CPU in its timer tick
+	balance_state balance_states_[TOPOLOGY_LEVEL_COUNT]{};
+
+	// the thread being switched away from, only touched by the owner with interrupts disabled
+	thread* switched_from_{ nullptr };
 
-	timer_list_type timer_list TA_GUARDED(timer_lock) {};
+	// timer ticks this CPU has taken, written by the owner and read by the CPUs stealing from it
+	uint64_t ticks_{ 0 };
 
-	mutable lock::spinlock timer_lock{ "scheduler_timer" };
+	// the timers armed on this CPU, advanced by its timer tick
+	timer_wheel timer_wheel_{};
 };
 
 }
\ No newline at end of file
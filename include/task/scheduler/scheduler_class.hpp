@@ -10,6 +10,7 @@ namespace task
 {
 class thread;
 
+// the methods are called with the run queue lock of the scheduler owning the class held
 class scheduler_class
 {
  public:
@@ -43,8 +44,9 @@ class scheduler_class
 	virtual void tick() = 0;
 
 	/// \brief get a thread, generally for migrating to another CPU's scheduler
+	/// \param allow_hot whether threads whose cache is still warm on this CPU may be taken
 	/// \return
-	virtual thread* steal(cpu_struct* stealer_cpu);
+	virtual thread* steal(cpu_struct* stealer_cpu, bool allow_hot);
 
 };
 
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "system/types.h"
+#include "system/time.hpp"
+
+#include "debug/thread_annotations.hpp"
+
+#include "kbl/lock/spinlock.h"
+#include "kbl/data/list.hpp"
+
+namespace task
+{
+
+using scheduler_timer_callback = void (*)(struct scheduler_timer* timer, time_type time, void* arg);
+
+struct scheduler_timer
+{
+	// the tick of its wheel the timer fires at, set when it's added
+	uint64_t expires{ 0 };
+	void* arg{ nullptr };
+	scheduler_timer_callback callback{ nullptr };
+
+	kbl::list_link<scheduler_timer, lock::spinlock> link{ this };
+
+	// the list the timer is on, so that it's cancelled without a search
+	class timer_wheel* wheel{ nullptr };
+	size_t level{ 0 };
+	size_t slot{ 0 };
+
+	// set by a cancel that raced with the callback. A callback waiting for a lock the canceller
+	// may hold gives up when it sees it
+	bool canceled{ false };
+};
+
+/// \brief per CPU hierarchical timing wheel. Each level has SLOTS buckets of SLOTS times the ticks of the level below.
+/// Timers are put into the closest level they fit in, and moved down a level when the wheel reaches their bucket
+class timer_wheel
+{
+ public:
+	using timer_list_type = kbl::intrusive_list_with_default_trait<scheduler_timer,
+	                                                               lock::spinlock,
+	                                                               &scheduler_timer::link,
+	                                                               false>;
+
+	static constexpr size_t LEVEL_BITS = 6;
+	static constexpr size_t SLOTS = 1ul << LEVEL_BITS;
+	static constexpr size_t LEVELS = 4;
+
+	// timers farther than this are put at the farthest bucket and placed again when it's reached
+	static constexpr uint64_t RANGE = 1ull << (LEVEL_BITS * LEVELS);
+
+	// the level of timers that are due and wait for their callbacks
+	static constexpr size_t LEVEL_EXPIRED = LEVELS;
+
+	timer_wheel() = default;
+
+	timer_wheel(const timer_wheel&) = delete;
+	timer_wheel& operator=(const timer_wheel&) = delete;
+
+	/// \brief arm timer to fire ticks ticks from now, at least one
+	void add(scheduler_timer* timer, uint64_t ticks) TA_EXCL(lock_);
+
+	/// \brief take timer off whichever wheel it's on. If its callback is running, wait for it to return
+	/// \return whether the timer was cancelled before its callback started
+	static bool cancel(scheduler_timer* timer);
+
+	/// \brief advance a tick, moving down the buckets that are reached, and run the callbacks of the due timers.
+	/// Only called by the owner CPU. The callbacks run without the wheel locked, so they may add and cancel timers
+	void advance(time_type time) TA_EXCL(lock_);
+
+	/// \brief move every pending timer of from to to, keeping the ticks they have left.
+	/// Both locks are taken in the order of the addresses, so that opposite migrations can't deadlock
+	static void migrate(timer_wheel* from, timer_wheel* to);
+
+ private:
+	void place_locked(scheduler_timer* timer) TA_REQ(lock_);
+	void unlink_locked(scheduler_timer* timer) TA_REQ(lock_);
+	void cascade_locked(size_t level) TA_REQ(lock_);
+
+	[[nodiscard]] timer_list_type& list_of(size_t level, size_t slot) TA_REQ(lock_)
+	{
+		return level == LEVEL_EXPIRED ? expired_ : slots_[level][slot];
+	}
+
+	uint64_t now_ TA_GUARDED(lock_){ 0 };
+
+	timer_list_type slots_[LEVELS][SLOTS] TA_GUARDED(lock_){};
+
+	timer_list_type expired_ TA_GUARDED(lock_){};
+
+	// the timer whose callback is running, cancelling it waits until it's cleared
+	scheduler_timer* running_ TA_GUARDED(lock_){ nullptr };
+
+	mutable lock::spinlock lock_{ "timer_wheel" };
+};
+
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "system/types.h"
+
+struct cpu_struct;
+
+namespace task
+{
+
+// the levels CPUs are balanced at, from the closest to the farthest
+enum topology_level : size_t
+{
+	// hardware threads of a core
+	TOPOLOGY_SMT,
+	// cores behind the same last level cache
+	TOPOLOGY_LLC,
+	// cores of a NUMA node
+	TOPOLOGY_NUMA,
+	// every core
+	TOPOLOGY_SYSTEM,
+
+	TOPOLOGY_LEVEL_COUNT,
+};
+
+/// \brief find the SMT siblings and the cores sharing the last level cache by CPUID and the local APIC IDs.
+/// The CPUs are assumed to be alike, so it's called once on the boot processor, after the NUMA nodes are known
+void topology_init();
+
+/// \brief whether a and b are in the same group at level
+[[nodiscard]] bool topology_shares(const cpu_struct* a, const cpu_struct* b, topology_level level);
+
+/// \brief whether a thread moved between CPUs that are only together at level leaves its cache behind
+[[nodiscard]] static inline constexpr bool topology_crosses_cache(topology_level level)
+{
+	return level > TOPOLOGY_LLC;
+}
+
+}
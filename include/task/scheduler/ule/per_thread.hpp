@@ -8,10 +8,15 @@ class ule_scheduler_state_base
 	: public scheduler_state_base
 {
  public:
+	friend class ule_scheduler_class;
+
 	using interactivity_score_type = uint64_t;
 	using nice_type = int32_t;
 	using priority_type = int32_t;
 
+	static constexpr nice_type NICE_MIN = -20;
+	static constexpr nice_type NICE_MAX = 19;
+
  public:
 	bool nice_available() override
 	{
@@ -26,27 +31,42 @@ class ule_scheduler_state_base
 		return nice_;
 	}
 
-	void set_nice(int32_t nice) override
+	void set_nice(int32_t nice) override;
+
+	void set_background(bool background) override
 	{
-		nice_ = nice;
+		background_ = background;
 	}
 
 	/// \brief calculate interactive score according to runtime and sleep time
-	/// \return
+	/// \return 0 for threads that only sleep up to INTERACT_MAX for ones that only run
 	[[nodiscard]]interactivity_score_type interactivity_score() const;
 
 	/// \brief calculate priority according to interactive score
-	/// \return
+	/// \return the run queue index, lower runs first
 	[[nodiscard]] priority_type priority() const;
 
  private:
+	/// \brief scale the history down once it covers more than HISTORY_MAX, so that the score follows recent behaviour
+	void decay_history();
+
 	nice_type nice_{ 0 };
-	interactivity_score_type interactivity_{ 0 };
 
-	size_t run_time_{ 0 };
+	// pinned to PRI_MAX_TIMESHARE, whatever its score
+	bool background_{ false };
 
+	// in ticks shifted by HISTORY_SHIFT, so that decaying keeps some precision
+	size_t run_time_{ 0 };
 	size_t sleep_time_{ 0 };
+
 	size_t sleep_tick_{ 0 };
+
+	// ticks left before the thread is preempted, refilled when it's queued with none left
+	size_t slice_left_{ 0 };
+
+	// where the thread is queued, the index of the run queue is -1 if it isn't
+	int32_t queued_run_queue_{ -1 };
+	priority_type queued_priority_{ 0 };
 };
 
-}
\ No newline at end of file
+}
@@ -7,14 +7,54 @@
 
 namespace task
 {
-class ule_scheduler_class
+
+class ule_scheduler_class final
 	: public scheduler_class
 {
  public:
+	friend class thread;
+	friend class scheduler;
+
+	using priority_type = ule_scheduler_state_base::priority_type;
+
+	using run_queue_list_type = kbl::intrusive_list_with_default_trait<thread,
+	                                                                   lock::spinlock,
+	                                                                   &thread::run_queue_link,
+	                                                                   false>;
+
+	// priorities are indices of the lists in a run queue, lower runs first
+	static constexpr priority_type PRIORITY_COUNT = 64;
+
+	struct run_queue
+	{
+		run_queue_list_type lists[PRIORITY_COUNT]{};
+
+		// bit i is set when lists[i] isn't empty
+		uint64_t bitmap{ 0 };
+		size_t count{ 0 };
+	};
+
+	static_assert(PRIORITY_COUNT <= sizeof(run_queue::bitmap) * 8);
+
 	static constexpr uint64_t INTERACT_MAX = 100;
 	static constexpr uint64_t INTERACT_HALF = INTERACT_MAX / 2;
 	static constexpr uint64_t INTERACT_THRESHOLD = 30;
 
+	// interactive threads take the upper half of the priorities, the others the lower half
+	static constexpr priority_type PRI_MIN_INTERACT = 0;
+	static constexpr priority_type PRI_MAX_INTERACT = PRIORITY_COUNT / 2 - 1;
+	static constexpr priority_type PRI_MIN_TIMESHARE = PRIORITY_COUNT / 2;
+	static constexpr priority_type PRI_MAX_TIMESHARE = PRIORITY_COUNT - 1;
+
+	// run and sleep time are kept in ticks shifted by this, and scaled down once they add up to HISTORY_MAX ticks
+	static constexpr size_t HISTORY_SHIFT = 10;
+	static constexpr size_t HISTORY_MAX = 500ul << HISTORY_SHIFT;
+
+	// time slices in timer ticks. the slice shrinks as the load grows, down to SLICE_DEFAULT / SLICE_MIN_DIVISOR
+	static constexpr size_t SLICE_DEFAULT = 10;
+	static constexpr size_t SLICE_MIN_DIVISOR = 5;
+	static constexpr size_t SLICE_MIN = SLICE_DEFAULT / SLICE_MIN_DIVISOR;
+
 	ule_scheduler_class() = delete;
 	~ule_scheduler_class() = default;
 	ule_scheduler_class(const ule_scheduler_class&) = delete;
@@ -26,16 +66,30 @@ class ule_scheduler_class
 	}
 
  public:
-	[[nodiscard]] size_type workload_size() const override;
-	void enqueue(thread* t) override;
-	void dequeue(thread* t) override;
-	thread* fetch() override;
-	void tick() override;
-	thread* steal(cpu_struct* stealer_cpu) override;
+	[[nodiscard]] size_type workload_size() const final;
+	void enqueue(thread* t) final;
+	void dequeue(thread* t) final;
+	thread* fetch() final;
+	void tick() final;
+	thread* steal(cpu_struct* stealer_cpu, bool allow_hot) final;
 
  private:
+	void run_queue_add(run_queue* rq, thread* t, priority_type pri);
+	void run_queue_remove(thread* t);
+
+	/// \brief take the thread of the highest priority out of rq
+	thread* run_queue_choose(run_queue* rq);
+
+	[[nodiscard]] size_t slice() const;
+
 	class scheduler* parent_{ nullptr };
-	mutable lock::spinlock lock_;
+
+	// guarded by the run queue lock of parent_.
+	// interactive threads are queued on current_ and the others on next_. once current_ runs out,
+	// the two are swapped, so that threads using up their slices don't starve, yet can't delay interactive ones
+	run_queue run_queues_[2]{};
+	run_queue* current_{ &run_queues_[0] };
+	run_queue* next_{ &run_queues_[1] };
 };
 
-}
\ No newline at end of file
+}
@@ -33,6 +33,7 @@
 #include "task/thread/ipc_state.hpp"
 
 #include "memory/address_space.hpp"
+#include "memory/kstack.hpp"
 
 #include <compare>
 
@@ -59,7 +60,7 @@ class kernel_stack final
 
 	friend class scheduler;
 
-	static constexpr size_t MAX_SIZE = 4_MB;
+	static constexpr size_t MAX_SIZE = memory::KSTACK_SIZE;
 	static constexpr size_t MAX_PAGE_COUNT = MAX_SIZE / PAGE_SIZE;
 
  public:
@@ -175,6 +176,7 @@ class scheduler_state
 {
  public:
 	friend class thread;
+	friend class scheduler;
 
 	scheduler_state() = delete;
 	scheduler_state(const scheduler_state&) = delete;
@@ -209,6 +211,14 @@ class scheduler_state
 
 	cpu_affinity affinity_{ CPU_NUM_INVALID, cpu_affinity_type::SOFT };
 	bool need_reschedule_{ false };
+
+	// the CPU the thread last ran on, and the tick count of that CPU when it stopped
+	cpu_num_type last_cpu_{ CPU_NUM_INVALID };
+	uint64_t last_ran_tick_{ 0 };
+
+	// set while a CPU runs the thread, until its context is saved by the switch away from it.
+	// global_thread_lock is dropped before that, so a CPU switching to the thread waits for it to clear
+	bool on_cpu_{ false };
 };
 
 class thread final
@@ -356,6 +366,8 @@ class thread final
 	thread_states state{ thread_states::INITIAL };
 
  private:
+	/// \brief switch from the current thread to this one. global_thread_lock is released before the switch
+	/// rather than handed over to this thread, and taken again once the current thread runs again
 	void switch_to(interrupt_saved_state_type state_to_restore) TA_REQ(global_thread_lock);
 
 	thread(process* parent, ktl::string_view name, cpu_affinity affinity);
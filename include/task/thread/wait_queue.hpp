@@ -26,6 +26,8 @@
 
 namespace task
 {
+// run queues have per-CPU locks in their schedulers, and a context switch drops this rather than handing it over.
+// It still guards thread states, wait queues and semaphores, until they get locks of their own (see docs/KNOWN_ISSUES.md)
 extern lock::spinlock global_thread_lock;
 
 class thread;
@@ -102,7 +104,7 @@ class wait_queue
 		return block_list_.size();
 	}
  private:
-	static void timeout_handle(struct scheduler_timer*, time_type now, void* arg) TA_REL(global_thread_lock);
+	static void timeout_handle(struct scheduler_timer*, time_type now, void* arg) TA_EXCL(global_thread_lock);
 
 	void dequeue(thread* t, error_code err) TA_REQ(global_thread_lock);
 
@@ -0,0 +1,186 @@
+#include "arch/amd64/cpu/string.hpp"
+#include "arch/amd64/cpu/cpuid.h"
+
+using namespace arch;
+
+// rep movsb beats rep movsq from this size on with ERMS, while its startup cost dominates below it
+constexpr size_t ERMS_MIN_SIZE = 128;
+
+// written once by string_init on the boot processor
+static bool has_erms{ false };
+static bool has_fsrm{ false };
+
+static inline void copy_movsb(void* dst, const void* src, size_t n)
+{
+	asm volatile("cld; rep movsb" : "+D"(dst), "+S"(src), "+c"(n) : : "memory", "cc");
+}
+
+static inline void copy_movsq(void* dst, const void* src, size_t n)
+{
+	size_t qwords = n / sizeof(uint64_t), bytes = n % sizeof(uint64_t);
+	asm volatile("cld; rep movsq" : "+D"(dst), "+S"(src), "+c"(qwords) : : "memory", "cc");
+	asm volatile("cld; rep movsb" : "+D"(dst), "+S"(src), "+c"(bytes) : : "memory", "cc");
+}
+
+static inline void copy_stream(void* dst, const void* src, size_t n)
+{
+	auto d = reinterpret_cast<uint64_t*>(dst);
+	auto s = reinterpret_cast<const uint8_t*>(src);
+
+	size_t qwords = n / sizeof(uint64_t);
+	for (size_t i = 0; i < qwords; i++)
+	{
+		uint64_t val = 0;
+		__builtin_memcpy(&val, s + i * sizeof(uint64_t), sizeof(val));
+		asm volatile("movnti %1, %0" : "=m"(d[i]) : "r"(val));
+	}
+
+	// the stores are weakly ordered, order them before whatever publishes the memory
+	asm volatile("sfence" : : : "memory");
+
+	copy_movsb(d + qwords, s + qwords * sizeof(uint64_t), n % sizeof(uint64_t));
+}
+
+static inline void set_stosb(void* dst, int c, size_t n)
+{
+	asm volatile("cld; rep stosb" : "+D"(dst), "+c"(n) : "a"(c) : "memory", "cc");
+}
+
+static inline uint64_t repeat_byte(int c)
+{
+	return 0x0101010101010101ull * (uint8_t)c;
+}
+
+static inline void set_stosq(void* dst, int c, size_t n)
+{
+	size_t qwords = n / sizeof(uint64_t), bytes = n % sizeof(uint64_t);
+	asm volatile("cld; rep stosq" : "+D"(dst), "+c"(qwords) : "a"(repeat_byte(c)) : "memory", "cc");
+	asm volatile("cld; rep stosb" : "+D"(dst), "+c"(bytes) : "a"(c) : "memory", "cc");
+}
+
+static inline void set_stream(void* dst, int c, size_t n)
+{
+	auto d = reinterpret_cast<uint64_t*>(dst);
+	auto val = repeat_byte(c);
+
+	size_t qwords = n / sizeof(uint64_t);
+	for (size_t i = 0; i < qwords; i++)
+	{
+		asm volatile("movnti %1, %0" : "=m"(d[i]) : "r"(val));
+	}
+
+	asm volatile("sfence" : : : "memory");
+
+	set_stosb(d + qwords, c, n % sizeof(uint64_t));
+}
+
+// copy from the end, for a destination overlapping the source from above.
+// the trap entries don't clear the direction flag, so the string instructions above clear it themselves,
+// and backward ones are off limits
+static inline void copy_backward(void* dst, const void* src, size_t n)
+{
+	auto d = reinterpret_cast<uint8_t*>(dst);
+	auto s = reinterpret_cast<const uint8_t*>(src);
+
+	while (n >= sizeof(uint64_t))
+	{
+		n -= sizeof(uint64_t);
+
+		uint64_t val = 0;
+		__builtin_memcpy(&val, s + n, sizeof(val));
+		__builtin_memcpy(d + n, &val, sizeof(val));
+	}
+
+	while (n > 0)
+	{
+		n--;
+		d[n] = s[n];
+	}
+}
+
+void arch::string_init()
+{
+	auto[max_leaf, ebx0, ecx0, edx0] = cpuid(CPUID_GETVENDORSTRING);
+	if (max_leaf < CPUID_GETEXTENDEDFEATURES)
+	{
+		return;
+	}
+
+	auto[eax, ebx, ecx, edx] = cpuid(CPUID_GETEXTENDEDFEATURES, 0);
+
+	has_erms = ebx & features::CPUID_EBX7_BIT_ERMS;
+	has_fsrm = edx & features::CPUID_EDX7_BIT_FSRM;
+}
+
+string_method arch::string_method_for(const void* dst, size_t n)
+{
+	if (n >= STRING_NONTEMPORAL_THRESHOLD && ((uintptr_t)dst % sizeof(uint64_t)) == 0)
+	{
+		return string_method::STREAM;
+	}
+
+	if (has_fsrm || (has_erms && n >= ERMS_MIN_SIZE))
+	{
+		return string_method::MOVSB;
+	}
+
+	return string_method::MOVSQ;
+}
+
+void arch::copy_with(string_method method, void* dst, const void* src, size_t n)
+{
+	switch (method)
+	{
+	case string_method::MOVSB:
+		copy_movsb(dst, src, n);
+		break;
+	case string_method::STREAM:
+		copy_stream(dst, src, n);
+		break;
+	case string_method::MOVSQ:
+	default:
+		copy_movsq(dst, src, n);
+		break;
+	}
+}
+
+void arch::set_with(string_method method, void* dst, int c, size_t n)
+{
+	switch (method)
+	{
+	case string_method::MOVSB:
+		set_stosb(dst, c, n);
+		break;
+	case string_method::STREAM:
+		set_stream(dst, c, n);
+		break;
+	case string_method::MOVSQ:
+	default:
+		set_stosq(dst, c, n);
+		break;
+	}
+}
+
+void* arch::fast_memcpy(void* dst, const void* src, size_t n)
+{
+	copy_with(string_method_for(dst, n), dst, src, n);
+	return dst;
+}
+
+void* arch::fast_memmove(void* dst, const void* src, size_t n)
+{
+	// unsigned, so that a destination below the source wraps around and copies forwards as well
+	if ((uintptr_t)dst - (uintptr_t)src >= n)
+	{
+		return fast_memcpy(dst, src, n);
+	}
+
+	copy_backward(dst, src, n);
+	return dst;
+}
+
+void* arch::fast_memset(void* dst, int c, size_t n)
+{
+	set_with(string_method_for(dst, n), dst, c, n);
+	return dst;
+}
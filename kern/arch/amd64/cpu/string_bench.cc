@@ -0,0 +1,77 @@
+#include "arch/amd64/cpu/string.hpp"
+#include "arch/amd64/cpu/intrinsics.hpp"
+
+#include "debug/kdebug.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace arch;
+
+// each size is copied this many times, and the best run is reported
+constexpr size_t BENCH_ROUNDS = 8;
+
+constexpr size_t bench_sizes[] = { 64, 4_KB, 64_KB, 2_MB };
+
+constexpr string_method bench_methods[] = { string_method::MOVSQ, string_method::MOVSB, string_method::STREAM };
+
+static const char* method_name(string_method method)
+{
+	switch (method)
+	{
+	case string_method::MOVSQ:
+		return "movsq";
+	case string_method::MOVSB:
+		return "movsb";
+	case string_method::STREAM:
+		return "stream";
+	default:
+		return "unknown";
+	}
+}
+
+template<typename TFunc>
+static size_t best_of(TFunc&& fn)
+{
+	size_t best = SIZE_MAX;
+	for (size_t i = 0; i < BENCH_ROUNDS; i++)
+	{
+		auto start = cycles();
+		fn();
+		best = std::min(best, cycles() - start);
+	}
+
+	return best;
+}
+
+void arch::string_benchmark(void* buf, size_t size)
+{
+	auto dst = reinterpret_cast<uint8_t*>(buf);
+
+	for (auto n: bench_sizes)
+	{
+		if (n * 2 > size)
+		{
+			break;
+		}
+
+		auto src = dst + n;
+
+		kdebug::kdebug_log("string functions, %lld bytes (picked %s):\n", n, method_name(string_method_for(dst, n)));
+
+		kdebug::kdebug_log("  libc: memcpy %lld memmove %lld memset %lld cycles\n",
+			best_of([&] { memcpy(dst, src, n); }),
+			best_of([&] { memmove(dst + 1, dst, n - 1); }),
+			best_of([&] { memset(dst, 0, n); }));
+
+		for (auto method: bench_methods)
+		{
+			kdebug::kdebug_log("  %s: copy %lld set %lld cycles\n", method_name(method),
+				best_of([&] { copy_with(method, dst, src, n); }),
+				best_of([&] { set_with(method, dst, 0, n); }));
+		}
+
+		kdebug::kdebug_log("  fast_memmove, overlapping: %lld cycles\n",
+			best_of([&] { fast_memmove(dst + 1, dst, n - 1); }));
+	}
+}
@@ -74,10 +74,24 @@ enum edx_bits
 
 
 /* Features in %ebx for level 7 sub-leaf 0 */
-//TODO
-//#define bit_FSGSBASE    0x00000001
-//#define bit_SMEP        0x00000080
-//#define bit_ENH_MOVSB   0x00000200
+enum ebx7_bits
+{
+	CPUID_EBX7_BIT_FSGSBASE = 0x00000001,
+	CPUID_EBX7_BIT_SMEP = 0x00000080,
+	CPUID_EBX7_BIT_ERMS = 0x00000200, // enhanced rep movsb and stosb
+};
+
+/* Features in %edx for level 7 sub-leaf 0 */
+enum edx7_bits
+{
+	CPUID_EDX7_BIT_FSRM = 0x00000010, // fast rep movsb for short copies
+};
+
+/* Features in %edx for level 0x80000007 */
+enum edx_power_bits
+{
+	CPUID_EDX_POWER_BIT_INVARIANT_TSC = 0x00000100, // ticks at a constant rate in every power state
+};
 }
 
 enum cpuid_requests
@@ -87,11 +101,16 @@ enum cpuid_requests
 	CPUID_GETTLB,
 	CPUID_GETSERIAL,
 
+	CPUID_GETCACHEPARAMS = 0x4,
+	CPUID_GETEXTENDEDFEATURES = 0x7,
+	CPUID_GETTOPOLOGY = 0xb,
+
 	CPUID_INTELEXTENDED = 0x80000000,
 	CPUID_INTELFEATURES,
 	CPUID_INTELBRANDSTRING,
 	CPUID_INTELBRANDSTRINGMORE,
 	CPUID_INTELBRANDSTRINGEND,
+	CPUID_INTELPOWERMANAGEMENT = 0x80000007,
 };
 
 struct cpuid_regs
@@ -109,3 +128,15 @@ struct cpuid_regs
 	: "a"(code));
 	return ret;
 }
+
+// for the leaves that take a sub-leaf in ecx
+[[clang::optnone]] static inline cpuid_regs cpuid(cpuid_requests req, uint32_t subleaf)
+{
+	cpuid_regs ret = { 0, 0, 0, 0 };
+	uint32_t code = (uint32_t)req;
+	asm volatile("cpuid"
+	: "=a"(ret.eax), "=b"(ret.ebx),
+	"=c"(ret.ecx), "=d"(ret.edx)
+	: "a"(code), "c"(subleaf));
+	return ret;
+}
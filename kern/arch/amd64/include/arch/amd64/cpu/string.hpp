@@ -0,0 +1,44 @@
+#pragma once
+
+#include "system/types.h"
+
+namespace arch
+{
+
+// copies and fills at least this large bypass the cache with non-temporal stores,
+// because they would evict more than they leave useful behind
+constexpr size_t STRING_NONTEMPORAL_THRESHOLD = 1_MB;
+
+enum class string_method
+{
+	// rep movsq and rep stosq, with the tail done byte by byte
+	MOVSQ,
+	// rep movsb and rep stosb, fast with ERMS, and for short copies as well with FSRM
+	MOVSB,
+	// movnti from general purpose registers, followed by sfence
+	STREAM,
+};
+
+/// \brief pick the methods by CPUID. Until then, the string functions use MOVSQ, which works everywhere
+void string_init();
+
+/// \brief the method used for copies and fills of n bytes to dst
+[[nodiscard]] string_method string_method_for(const void* dst, size_t n);
+
+// Kernel code is built without SSE, and the extended state of user threads isn't saved across
+// kernel entries, so these stick to general purpose registers and string instructions.
+
+void* fast_memcpy(void* dst, const void* src, size_t n);
+void* fast_memmove(void* dst, const void* src, size_t n);
+void* fast_memset(void* dst, int c, size_t n);
+
+/// \brief copy or fill with a given method, for the benchmark and for callers that know better than the size,
+/// like the zeroed page pool. STREAM wants dst 8-byte aligned
+void copy_with(string_method method, void* dst, const void* src, size_t n);
+void set_with(string_method method, void* dst, int c, size_t n);
+
+/// \brief time the methods against the C library on buf, which should be at least 4MB,
+/// and print the cycles each takes to the debug console
+void string_benchmark(void* buf, size_t size);
+
+}
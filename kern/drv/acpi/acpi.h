@@ -21,4 +21,13 @@ extern acpi_version_adapter acpiv2_adapter;
 
 [[nodiscard]] error_code acpi_mcfg_init(const acpi::acpi_mcfg* mcfg);
 
-[[nodiscard]] error_code acpi_fadt_init(const acpi::acpi_fadt* _fadt);
\ No newline at end of file
+[[nodiscard]] error_code acpi_fadt_init(const acpi::acpi_fadt* _fadt);
+
+// srat.cc, must run after the MADT is parsed, as it assigns the CPUs to nodes
+[[nodiscard]] error_code acpi_srat_init(const acpi::acpi_srat* srat);
+
+// the proximity domain of a NUMA node
+uint32_t acpi_srat_node_domain(size_t node);
+
+// slit.cc, must run after the SRAT is parsed
+[[nodiscard]] error_code acpi_slit_init(const acpi::acpi_slit* slit);
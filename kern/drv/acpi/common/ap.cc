@@ -28,6 +28,7 @@
 #include "drivers/apic/apic.h"
 #include "drivers/apic/traps.h"
 #include "drivers/apic/timer.h"
+#include "drivers/clocksource/clocksource.hpp"
 #include "drivers/console/console.h"
 #include "debug/kdebug.h"
 
@@ -88,6 +89,8 @@ constexpr uintptr_t AP_CODE_LOAD_ADDR = 0x7000;
 
 			local_apic::start_ap(core.apicid, V2P((uintptr_t)code));
 
+			clocksource::sync_ap();
+
 			while (core.started == 0u);
 		}
 	}
@@ -119,6 +122,9 @@ extern "C" [[clang::optnone]] void ap_enter(void)
 		// initialize apic timer
 		timer::init_apic_timer();
 
+		// line the TSC up with the boot processor's
+		clocksource::init_ap_clocksource();
+
 		// set registers converning syscall/sysret
 		syscall::system_call_init();
 	}
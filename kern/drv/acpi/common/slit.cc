@@ -0,0 +1,65 @@
+#include "../acpi.h"
+#include "../v1/acpi_v1.h"
+#include "../v2/acpi_v2.h"
+
+#include "system/memlayout.h"
+#include "system/mmu.h"
+#include "system/param.h"
+
+#include "drivers/acpi/acpi.h"
+#include "debug/kdebug.h"
+
+using namespace acpi;
+
+static uint8_t numa_distances[NUMA_NODE_COUNT_LIMIT][NUMA_NODE_COUNT_LIMIT] = {};
+
+[[nodiscard]] error_code acpi_slit_init(const acpi::acpi_slit* slit)
+{
+	const size_t nodes = get_numa_node_count();
+
+	for (size_t i = 0; i < nodes; i++)
+	{
+		for (size_t j = 0; j < nodes; j++)
+		{
+			numa_distances[i][j] = i == j ? NUMA_DISTANCE_LOCAL : NUMA_DISTANCE_REMOTE;
+		}
+	}
+
+	// every remote node is as far then
+	if (slit == nullptr)
+	{
+		return ERROR_SUCCESS;
+	}
+
+	if (slit->header.length < sizeof(*slit) ||
+		slit->header.length < sizeof(*slit) + slit->locality_count * slit->locality_count)
+	{
+		return -ERROR_INVALID;
+	}
+
+	if (!acpi_header_valid(&slit->header))
+	{
+		return -ERROR_INVALID;
+	}
+
+	// localities are indexed by proximity domain
+	for (size_t i = 0; i < nodes; i++)
+	{
+		for (size_t j = 0; j < nodes; j++)
+		{
+			uint64_t from = acpi_srat_node_domain(i), to = acpi_srat_node_domain(j);
+			if (from < slit->locality_count && to < slit->locality_count)
+			{
+				numa_distances[i][j] = slit->entry[from * slit->locality_count + to];
+			}
+		}
+	}
+
+	return ERROR_SUCCESS;
+}
+
+uint8_t acpi::get_numa_distance(size_t from, size_t to)
+{
+	KDEBUG_ASSERT(from < NUMA_NODE_COUNT_LIMIT && to < NUMA_NODE_COUNT_LIMIT);
+	return numa_distances[from][to];
+}
@@ -0,0 +1,188 @@
+#include "../acpi.h"
+#include "../v1/acpi_v1.h"
+#include "../v2/acpi_v2.h"
+
+#include "system/memlayout.h"
+#include "system/mmu.h"
+#include "system/param.h"
+
+#include "drivers/acpi/acpi.h"
+#include "drivers/acpi/cpu.h"
+#include "debug/kdebug.h"
+
+#include <cstring>
+#include <algorithm>
+
+using namespace acpi;
+
+static uint32_t node_domains[NUMA_NODE_COUNT_LIMIT] = {};
+static size_t node_count = 0;
+
+static numa_memory_range memory_ranges[NUMA_MEMORY_RANGE_COUNT_LIMIT] = {};
+static size_t memory_range_count = 0;
+
+static size_t node_of_domain(uint32_t domain)
+{
+	for (size_t i = 0; i < node_count; i++)
+	{
+		if (node_domains[i] == domain)
+		{
+			return i;
+		}
+	}
+
+	if (node_count == NUMA_NODE_COUNT_LIMIT)
+	{
+		return NUMA_NODE_COUNT_LIMIT - 1;
+	}
+
+	node_domains[node_count] = domain;
+	return node_count++;
+}
+
+static void assign_cpu(uint32_t apic_id, uint32_t domain)
+{
+	auto node = node_of_domain(domain);
+	for (size_t i = 0; i < cpu_count; i++)
+	{
+		if (cpus[i].apicid == apic_id)
+		{
+			cpus[i].numa_node = node;
+		}
+	}
+}
+
+[[nodiscard]] error_code acpi_srat_init(const acpi::acpi_srat* srat)
+{
+	// the machine isn't NUMA
+	if (srat == nullptr)
+	{
+		node_count = 1;
+		return ERROR_SUCCESS;
+	}
+
+	if (srat->header.length < sizeof(*srat))
+	{
+		return -ERROR_INVALID;
+	}
+
+	if (!acpi_header_valid(&srat->header))
+	{
+		return -ERROR_INVALID;
+	}
+
+	const srat_entry_header* begin = reinterpret_cast<decltype(begin)>(srat->table),
+		* end = reinterpret_cast<decltype(begin)>(srat->table + srat->header.length - sizeof(*srat));
+
+	auto next_entry = [](auto entry)
+	{
+	  return reinterpret_cast<decltype(entry)>((void*)(uintptr_t(entry) + entry->length));
+	};
+
+	for (auto entry = begin; entry < end; entry = next_entry(entry))
+	{
+		if (entry->length < sizeof(*entry))
+		{
+			return -ERROR_INVALID;
+		}
+
+		switch (entry->type)
+		{
+		case acpi::SRAT_ENTRY_LAPIC:
+		{
+			auto lapic = reinterpret_cast<const srat_lapic*>(entry);
+			if (sizeof(*lapic) != lapic->length)
+			{
+				return -ERROR_INVALID;
+			}
+
+			if (!(lapic->flags & SRAT_ENTRY_ENABLED))
+			{
+				break;
+			}
+
+			uint32_t domain = lapic->proximity_domain_low |
+				(uint32_t(lapic->proximity_domain_high[0]) << 8) |
+				(uint32_t(lapic->proximity_domain_high[1]) << 16) |
+				(uint32_t(lapic->proximity_domain_high[2]) << 24);
+
+			assign_cpu(lapic->apic_id, domain);
+			break;
+		}
+		case acpi::SRAT_ENTRY_X2APIC:
+		{
+			auto x2apic = reinterpret_cast<const srat_x2apic*>(entry);
+			if (sizeof(*x2apic) != x2apic->length)
+			{
+				return -ERROR_INVALID;
+			}
+
+			if (!(x2apic->flags & SRAT_ENTRY_ENABLED))
+			{
+				break;
+			}
+
+			assign_cpu(x2apic->x2apic_id, x2apic->proximity_domain);
+			break;
+		}
+		case acpi::SRAT_ENTRY_MEMORY:
+		{
+			auto memory = reinterpret_cast<const srat_memory*>(entry);
+			if (sizeof(*memory) != memory->length)
+			{
+				return -ERROR_INVALID;
+			}
+
+			if (!(memory->flags & SRAT_ENTRY_ENABLED) || memory->size == 0)
+			{
+				break;
+			}
+
+			// the memory beyond is left in the node it's in when nothing says otherwise
+			if (memory_range_count == NUMA_MEMORY_RANGE_COUNT_LIMIT)
+			{
+				break;
+			}
+
+			memory_ranges[memory_range_count++] = numa_memory_range{
+				.base = memory->base,
+				.size = memory->size,
+				.node = node_of_domain(memory->proximity_domain) };
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	node_count = std::max(node_count, size_t{ 1 });
+
+	return ERROR_SUCCESS;
+}
+
+uint32_t acpi_srat_node_domain(size_t node)
+{
+	KDEBUG_ASSERT(node < node_count);
+	return node_domains[node];
+}
+
+size_t acpi::get_numa_node_count()
+{
+	return node_count;
+}
+
+size_t acpi::get_numa_memory_ranges(size_t bufsz, OUT numa_memory_range** buf)
+{
+	if (buf == nullptr)
+	{
+		return memory_range_count;
+	}
+
+	size_t cpy_count = std::min(bufsz, memory_range_count);
+	for (size_t i = 0; i < cpy_count; i++)
+	{
+		buf[i] = &memory_ranges[i];
+	}
+
+	return cpy_count;
+}
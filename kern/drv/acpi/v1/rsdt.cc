@@ -30,6 +30,8 @@ error_code init_rsdt(const acpi::acpi_rsdp* rsdp)
 	acpi_madt* madt = nullptr;
 	acpi_mcfg* mcfg = nullptr;
 	acpi_fadt* fadt = nullptr;
+	acpi_srat* srat = nullptr;
+	acpi_slit* slit = nullptr;
 
 	for (size_t i = 0;
 		 i < (rsdt->header.length - sizeof(acpi_desc_header)) / sizeof(uint32_t);
@@ -48,6 +50,14 @@ error_code init_rsdt(const acpi::acpi_rsdp* rsdp)
 		{
 			fadt = reinterpret_cast<decltype(fadt)>(header);
 		}
+		else if (strncmp((char*)header->signature, acpi::SIGNATURE_SRAT, strlen(acpi::SIGNATURE_SRAT)) == 0)
+		{
+			srat = reinterpret_cast<decltype(srat)>(header);
+		}
+		else if (strncmp((char*)header->signature, acpi::SIGNATURE_SLIT, strlen(acpi::SIGNATURE_SLIT)) == 0)
+		{
+			slit = reinterpret_cast<decltype(slit)>(header);
+		}
 	}
 
 	auto ret = acpi_madt_init(madt);
@@ -71,5 +81,19 @@ error_code init_rsdt(const acpi::acpi_rsdp* rsdp)
 		return ret;
 	}
 
+	ret = acpi_srat_init(srat);
+
+	if (ret != ERROR_SUCCESS)
+	{
+		return ret;
+	}
+
+	ret = acpi_slit_init(slit);
+
+	if (ret != ERROR_SUCCESS)
+	{
+		return ret;
+	}
+
 	return ERROR_SUCCESS;
 }
\ No newline at end of file
@@ -29,7 +29,7 @@ error_code init_xsdt(const acpi::acpi_rsdp *rsdp)
 {
     acpi_xsdt *xsdt = reinterpret_cast<acpi_xsdt *>(P2V(rsdp->xsdt_addr_phys));
 
-    size_t entrycnt = (xsdt->header.length - sizeof(xsdt->header)) / 4;
+    size_t entrycnt = (xsdt->header.length - sizeof(xsdt->header)) / sizeof(xsdt->entry[0]);
 
     // KDEBUG_ASSERT(acpi_header_valid(&xsdt->header) == true);
     if (!acpi_header_valid(&xsdt->header))
@@ -38,15 +38,36 @@ error_code init_xsdt(const acpi::acpi_rsdp *rsdp)
     }
 
     acpi_madt *madt = nullptr;
+    acpi::acpi_srat *srat = nullptr;
+    acpi::acpi_slit *slit = nullptr;
     for (size_t i = 0; i < entrycnt; i++)
     {
         auto header = reinterpret_cast<acpi_desc_header *>(P2V(xsdt->entry[i]));
         if (strncmp((char *)header->signature, acpi::SIGNATURE_MADT, strlen(acpi::SIGNATURE_MADT)) == 0)
         {
             madt = reinterpret_cast<decltype(madt)>(header);
-            break;
         }
+        else if (strncmp((char *)header->signature, acpi::SIGNATURE_SRAT, strlen(acpi::SIGNATURE_SRAT)) == 0)
+        {
+            srat = reinterpret_cast<decltype(srat)>(header);
+        }
+        else if (strncmp((char *)header->signature, acpi::SIGNATURE_SLIT, strlen(acpi::SIGNATURE_SLIT)) == 0)
+        {
+            slit = reinterpret_cast<decltype(slit)>(header);
+        }
+    }
+
+    auto ret = acpi_madt_init(madt);
+    if (ret != ERROR_SUCCESS)
+    {
+        return ret;
+    }
+
+    ret = acpi_srat_init(srat);
+    if (ret != ERROR_SUCCESS)
+    {
+        return ret;
     }
 
-    return acpi_madt_init(madt);
+    return acpi_slit_init(slit);
 }
\ No newline at end of file
@@ -107,7 +107,8 @@ static inline error_code ahci_port_allocate(ahci_port* port)
 	ahci_port_stop(port);
 
 	// 2MB-sized page
-	auto page = physical_memory_manager::instance()->allocate();   //pmm::alloc_page();
+	// the kernel maps physical memory with 2MB pages, so take a whole one to make it uncached
+	auto page = physical_memory_manager::instance()->allocate(LARGE_PAGE_PAGES);
 
 	if (page == nullptr)
 	{
@@ -120,7 +121,7 @@ static inline error_code ahci_port_allocate(ahci_port* port)
 
 	memory::physical_memory_manager::instance()->flush_tlb(vmm::g_kpml4t, pmm::page_to_va(page));
 
-	memset(reinterpret_cast<void*>(pmm::page_to_va(page)), 0, PAGE_SIZE);
+	memset(reinterpret_cast<void*>(pmm::page_to_va(page)), 0, LARGE_PAGE_SIZE);
 
 	// command list , FIS buffer, command table should be 4K aligned
 	uint8_t* page_start = reinterpret_cast<uint8_t*>(pmm::page_to_va(page));
@@ -77,7 +77,17 @@ void timer::mask_cpu_local_timer(size_t cpuid, bool masked)
 
 	if (masked)
 	{
-		timer_mask.fetch_or(1ull << cpuid);
+		auto mask = timer_mask.fetch_or(1ull << cpuid) | (1ull << cpuid);
+
+		// the timers of a CPU that stopped ticking would never fire, so they go to one still ticking
+		for (auto& c: valid_cpus)
+		{
+			if (!(mask & (1ull << c.id)))
+			{
+				task::scheduler::migrate_timers(valid_cpus[cpuid].scheduler, c.scheduler);
+				break;
+			}
+		}
 	}
 	else
 	{
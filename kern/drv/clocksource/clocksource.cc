@@ -0,0 +1,251 @@
+#include "drivers/clocksource/clocksource.hpp"
+
+#include "arch/amd64/cpu/cpuid.h"
+#include "arch/amd64/cpu/interrupt.h"
+#include "arch/amd64/cpu/intrinsics.hpp"
+#include "arch/amd64/cpu/port_io.h"
+
+#include "drivers/acpi/cpu.h"
+#include "drivers/apic/local_apic.hpp"
+#include "drivers/cmos/rtc.hpp"
+
+#include "debug/kdebug.h"
+
+using namespace apic;
+
+// channel 2 of the PIT can be gated and polled through port 0x61, without an interrupt
+constexpr uint64_t PIT_FREQUENCY = 1193182;
+constexpr uint16_t PIT_CHANNEL2_DATA = 0x42;
+constexpr uint16_t PIT_COMMAND = 0x43;
+constexpr uint16_t PIT_CHANNEL2_CONTROL = 0x61;
+
+constexpr uint8_t PIT_CHANNEL2_GATE = 0x01;
+constexpr uint8_t PIT_SPEAKER_ENABLE = 0x02;
+constexpr uint8_t PIT_CHANNEL2_OUT = 0x20;
+
+// channel 2, low byte then high byte, mode 0 (interrupt on terminal count), binary
+constexpr uint8_t PIT_COMMAND_CHANNEL2_ONESHOT = 0xb0;
+
+constexpr uint64_t CALIBRATE_MS = 10;
+constexpr size_t CALIBRATE_ROUNDS = 3;
+
+// the local APIC timer is counted against the TSC for this long, short enough that it wraps at most once
+constexpr uint64_t LAPIC_CALIBRATE_MS = 1;
+
+constexpr size_t SYNC_ROUNDS = 8;
+
+// nanoseconds are (tsc * tsc_mult) >> TSC_SHIFT
+constexpr uint64_t TSC_SHIFT = 32;
+
+enum sync_states : uint32_t
+{
+	SYNC_IDLE,
+	SYNC_AP_READY,
+	SYNC_BSP_DONE,
+};
+
+static uint64_t tsc_frequency = 0;
+static uint64_t tsc_mult = 0;
+static uint64_t boot_tsc = 0;
+
+static duration_type tick_ns = 0;
+
+// the wall time at the TSC reading boot_tsc
+static time_type wall_base = 0;
+
+static volatile uint32_t sync_state = SYNC_IDLE;
+static volatile uint64_t sync_bsp_tsc = 0;
+
+static inline uint64_t tsc_to_ns(uint64_t tsc)
+{
+	return (uint64_t)(((unsigned __int128)tsc * tsc_mult) >> TSC_SHIFT);
+}
+
+static bool tsc_invariant()
+{
+	auto[max_leaf, ebx, ecx, edx] = cpuid(CPUID_INTELEXTENDED);
+	if (max_leaf < CPUID_INTELPOWERMANAGEMENT)
+	{
+		return false;
+	}
+
+	auto[eax7, ebx7, ecx7, edx7] = cpuid(CPUID_INTELPOWERMANAGEMENT);
+	return edx7 & features::CPUID_EDX_POWER_BIT_INVARIANT_TSC;
+}
+
+// TSC cycles for a single count down of the PIT
+static uint64_t pit_calibrate_once()
+{
+	constexpr uint64_t latch = PIT_FREQUENCY * CALIBRATE_MS / 1000;
+
+	// the gate on and the speaker off, then the count starts as its high byte is written
+	outb(PIT_CHANNEL2_CONTROL, (uint8_t)((inb(PIT_CHANNEL2_CONTROL) & ~PIT_SPEAKER_ENABLE) | PIT_CHANNEL2_GATE));
+
+	outb(PIT_COMMAND, PIT_COMMAND_CHANNEL2_ONESHOT);
+	outb(PIT_CHANNEL2_DATA, latch & 0xff);
+	outb(PIT_CHANNEL2_DATA, (latch >> 8) & 0xff);
+
+	auto start = arch::cycles();
+	while (!(inb(PIT_CHANNEL2_CONTROL) & PIT_CHANNEL2_OUT))
+	{
+		arch::cpu_yield();
+	}
+
+	return arch::cycles() - start;
+}
+
+static uint64_t pit_calibrate_tsc()
+{
+	// whatever delays the polling, like an SMI, only makes a round longer, so the shortest is the closest
+	uint64_t best = UINT64_MAX;
+	for (size_t i = 0; i < CALIBRATE_ROUNDS; i++)
+	{
+		auto cycles = pit_calibrate_once();
+		if (cycles < best)
+		{
+			best = cycles;
+		}
+	}
+
+	return best * 1000 / CALIBRATE_MS;
+}
+
+// the local APIC timer counts down from TIC_DEFUALT_VALUE periodically, at the bus frequency as it isn't divided
+static uint64_t calibrate_lapic_timer()
+{
+	auto window = tsc_frequency * LAPIC_CALIBRATE_MS / 1000;
+
+	auto start_count = local_apic::read_lapic<uint32_t>(local_apic::CURRENT_COUNT_ADDR);
+	auto start = arch::cycles();
+
+	while (arch::cycles() - start < window)
+	{
+		arch::cpu_yield();
+	}
+
+	auto end_count = local_apic::read_lapic<uint32_t>(local_apic::CURRENT_COUNT_ADDR);
+	auto elapsed = arch::cycles() - start;
+
+	uint64_t counted = start_count >= end_count ?
+		start_count - end_count :
+		start_count + local_apic::TIC_DEFUALT_VALUE - end_count;
+
+	return counted * tsc_frequency / elapsed;
+}
+
+PANIC void clocksource::init_clocksource()
+{
+	if (!tsc_invariant())
+	{
+		kdebug::kdebug_log("clocksource: the TSC isn't invariant, time drifts if the CPU frequency changes.\n");
+	}
+
+	tsc_frequency = pit_calibrate_tsc();
+	if (tsc_frequency == 0)
+	{
+		KDEBUG_RICHPANIC("The TSC doesn't advance.\n", "KERNEL PANIC: CLOCKSOURCE", false, "");
+	}
+
+	tsc_mult = ((uint64_t)NSEC_PER_SEC << TSC_SHIFT) / tsc_frequency;
+
+	auto lapic_frequency = calibrate_lapic_timer();
+	tick_ns = lapic_frequency ?
+		(duration_type)local_apic::TIC_DEFUALT_VALUE * NSEC_PER_SEC / (duration_type)lapic_frequency :
+		0;
+
+	boot_tsc = arch::cycles();
+
+	// the RTC only counts seconds, so the wall clock is off by up to one
+	wall_base = cmos::cmos_read_rtc_timestamp() * NSEC_PER_SEC;
+
+	kdebug::kdebug_log("clocksource: TSC at %lld kHz, a timer tick every %lld us.\n",
+		tsc_frequency / 1000,
+		tick_ns / NSEC_PER_USEC);
+}
+
+void clocksource::init_ap_clocksource()
+{
+	// the BSP's reading falls between t0 and t1 on this TSC. The round with the shortest trip pins it down best
+	int64_t best_offset = 0;
+	uint64_t best_trip = UINT64_MAX;
+
+	for (size_t i = 0; i < SYNC_ROUNDS; i++)
+	{
+		auto t0 = arch::cycles();
+		__atomic_store_n(&sync_state, SYNC_AP_READY, __ATOMIC_RELEASE);
+
+		while (__atomic_load_n(&sync_state, __ATOMIC_ACQUIRE) != SYNC_BSP_DONE)
+		{
+			arch::cpu_yield();
+		}
+
+		auto t1 = arch::cycles();
+		auto bsp = sync_bsp_tsc;
+
+		__atomic_store_n(&sync_state, SYNC_IDLE, __ATOMIC_RELEASE);
+
+		if (t1 - t0 < best_trip)
+		{
+			best_trip = t1 - t0;
+			best_offset = (int64_t)(bsp - (t0 + best_trip / 2));
+		}
+	}
+
+	// a skew within the uncertainty of the measurement is more likely made up by it
+	auto magnitude = best_offset < 0 ? -best_offset : best_offset;
+	cpu->tsc_offset = (uint64_t)magnitude <= best_trip / 2 ? 0 : best_offset;
+}
+
+void clocksource::sync_ap()
+{
+	for (size_t i = 0; i < SYNC_ROUNDS; i++)
+	{
+		while (__atomic_load_n(&sync_state, __ATOMIC_ACQUIRE) != SYNC_AP_READY)
+		{
+			arch::cpu_yield();
+		}
+
+		sync_bsp_tsc = arch::cycles() + cpu->tsc_offset;
+		__atomic_store_n(&sync_state, SYNC_BSP_DONE, __ATOMIC_RELEASE);
+	}
+
+	while (__atomic_load_n(&sync_state, __ATOMIC_ACQUIRE) != SYNC_IDLE)
+	{
+		arch::cpu_yield();
+	}
+}
+
+time_type clocksource::now()
+{
+	// the TSC and the offset must be of the same CPU
+	auto state = arch_interrupt_save();
+	auto tsc = arch::cycles() + cpu->tsc_offset;
+	arch_interrupt_restore(state);
+
+	return tsc > boot_tsc ? (time_type)tsc_to_ns(tsc - boot_tsc) : 0;
+}
+
+duration_type clocksource::tick_period()
+{
+	return tick_ns;
+}
+
+uint64_t clocksource::duration_to_ticks(duration_type duration)
+{
+	if (duration <= 0 || tick_ns == 0)
+	{
+		return 0;
+	}
+
+	return duration / tick_ns + (duration % tick_ns != 0);
+}
+
+time_type clocksource::wall_time()
+{
+	return time_add_duration(wall_base, now());
+}
+
+timestamp_type clocksource::wall_timestamp()
+{
+	return wall_time() / NSEC_PER_SEC;
+}
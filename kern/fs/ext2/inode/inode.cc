@@ -1,7 +1,7 @@
 #include "../include/inode.hpp"
 #include "../include/block.hpp"
 
-#include "drivers/cmos/rtc.hpp"
+#include "drivers/clocksource/clocksource.hpp"
 
 #include "fs/ext2/ext2.hpp"
 #include "fs/vfs/vfs.hpp"
@@ -64,7 +64,7 @@ error_code ext2_inode_write(file_system::fs_instance* fs,
 	IN  file_system::ext2_inode* inode)
 {
 
-	inode->atime = cmos::cmos_read_rtc_timestamp();
+	inode->atime = clocksource::wall_timestamp();
 
 	ext2_data* data = reinterpret_cast<ext2_data*>(fs->private_data);
 
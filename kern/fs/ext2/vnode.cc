@@ -6,7 +6,9 @@
 #include "fs/vfs/vfs.hpp"
 #include "fs/ext2/vnode.hpp"
 
-#include "drivers/cmos/rtc.hpp"
+#include "drivers/clocksource/clocksource.hpp"
+
+#include "arch/amd64/cpu/string.hpp"
 
 #include "kbl/lock/lock_guard.hpp"
 
@@ -291,7 +293,7 @@ error_code file_system::ext2_vnode::create(const char* filename, uid_type uid, g
 	}
 	auto new_inode_id = get_result(alloc_ret);
 
-	new_inode->mtime = new_inode->ctime = new_inode->atime = cmos::cmos_read_rtc_timestamp();
+	new_inode->mtime = new_inode->ctime = new_inode->atime = clocksource::wall_timestamp();
 
 	new_inode->uid = uid;
 	new_inode->gid = gid;
@@ -356,7 +358,7 @@ error_code file_system::ext2_vnode::make_directory(const char* name, uid_type ui
 		ino = get_result(ret);
 	}
 
-	inode->ctime = inode->atime = inode->mtime = cmos::cmos_read_rtc_timestamp();
+	inode->ctime = inode->atime = inode->mtime = clocksource::wall_timestamp();
 	inode->uid = uid;
 	inode->gid = gid;
 	inode->type = EXT2_IFDIR;
@@ -420,7 +422,7 @@ error_code file_system::ext2_vnode::truncate(size_t size)
 		return ret;
 	}
 
-	inode->mtime = cmos::cmos_read_rtc_timestamp();
+	inode->mtime = clocksource::wall_timestamp();
 
 	return ext2_inode_write(this->fs, this->inode_id, inode);
 }
@@ -482,7 +484,7 @@ error_code file_system::ext2_vnode::unlink()
 	}
 
 	inode->hard_link_count = 0;
-	inode->dtime = cmos::cmos_read_rtc_timestamp();
+	inode->dtime = clocksource::wall_timestamp();
 
 	if (auto ret = ext2_inode_write(fs, this->get_inode_id(), inode);ret != ERROR_SUCCESS)
 	{
@@ -603,7 +605,7 @@ error_code file_system::ext2_vnode::change_mode(size_t mode)
 	inode->flags = mode & 0xFFF;
 	this->mode = mode & 0xFFF;
 
-	inode->mtime = cmos::cmos_read_rtc_timestamp();
+	inode->mtime = clocksource::wall_timestamp();
 
 	if (auto ret = ext2_inode_write(fs, this->inode_id, inode);ret != ERROR_SUCCESS)
 	{
@@ -637,7 +639,7 @@ error_code file_system::ext2_vnode::change_ownership(uid_type uid, gid_type gid)
 	this->uid = uid;
 	this->gid = gid;
 
-	inode->mtime = cmos::cmos_read_rtc_timestamp();
+	inode->mtime = clocksource::wall_timestamp();
 
 	if (auto ret = ext2_inode_write(fs, this->inode_id, inode);ret != ERROR_SUCCESS)
 	{
@@ -711,7 +713,7 @@ error_code_with_result<size_t> file_system::ext2_vnode::read(file_system::file_o
 			return ret;
 		}
 
-		memmove(buf, block_buf + block_off, readable);
+		arch::fast_memcpy(buf, block_buf + block_off, readable);
 
 		buf += readable;
 		fd->pos += readable;
@@ -800,7 +802,7 @@ error_code_with_result<size_t> file_system::ext2_vnode::write(file_system::file_
 				return err;
 			}
 
-			memmove(block_buf + block_offset, buf + offset, writable);
+			arch::fast_memcpy(block_buf + block_offset, buf + offset, writable);
 
 			if (auto err = ext2_inode_write_block(ext2_fs, inode, block_buf, block_index);err != ERROR_SUCCESS)
 			{
@@ -822,7 +824,7 @@ error_code_with_result<size_t> file_system::ext2_vnode::write(file_system::file_
 		fd->pos += writable;
 	}
 
-	inode->mtime = cmos::cmos_read_rtc_timestamp();
+	inode->mtime = clocksource::wall_timestamp();
 
 	if (auto err = ext2_inode_write(ext2_fs, this->inode_id, inode);err != ERROR_SUCCESS)
 	{
@@ -1,4 +1,5 @@
 #include "arch/amd64/cpu/x86.h"
+#include "arch/amd64/cpu/string.hpp"
 #include "boot/multiboot2.h"
 
 #include "include/ramdisk.hpp"
@@ -16,6 +17,7 @@
 #include "drivers/simd/simd.hpp"
 #include "drivers/pci/pci.hpp"
 #include "drivers/cmos/rtc.hpp"
+#include "drivers/clocksource/clocksource.hpp"
 
 #include "system/kmalloc.hpp"
 #include "system/memlayout.h"
@@ -27,6 +29,9 @@
 #include "system/kernel_layout.hpp"
 #include "system/vmm.h"
 
+#include "memory/teardown.hpp"
+#include "memory/zeroing.hpp"
+
 #include "object/object_manager.hpp"
 
 #include "task/scheduler/scheduler.hpp"
@@ -84,6 +89,9 @@ extern "C" [[noreturn]] void kmain()
 	// task the multiboot information
 	multiboot::init_mbi();
 
+	// pick the string instructions the CPU is fast with, before the page allocator zeroes anything
+	arch::string_init();
+
 	// initialize physical memory
 	pmm::init_pmm();
 
@@ -99,6 +107,12 @@ extern "C" [[noreturn]] void kmain()
 	// initialize ACPI
 	acpi::init_acpi();
 
+	// split physical memory by the NUMA nodes found by ACPI
+	pmm::init_numa();
+
+	// group the CPUs by core and last level cache for load balancing
+	task::topology_init();
+
 	// initialize local APIC
 	apic::local_apic::init_lapic();
 
@@ -108,6 +122,9 @@ extern "C" [[noreturn]] void kmain()
 	// initialize rtc to acquire date and time
 	cmos::cmos_rtc_init();
 
+	// calibrate the TSC for deadlines, seeding the wall clock from the rtc
+	clocksource::init_clocksource();
+
 	// initialize I/O APIC
 	apic::io_apic::init_ioapic();
 
@@ -126,6 +143,20 @@ extern "C" [[noreturn]] void kmain()
 	// initialize user task manager
 	task::process_init();
 
+	// start freeing the memory of dead address spaces in the background
+	memory::teardown_init();
+
+	// zero pages ahead of the faults that will want them, with the CPU time nothing else takes
+	memory::zeroing_init();
+
+#ifdef _KERNEL_ENABLE_STRING_BENCHMARK
+	if (auto buf = memory::vmalloc(4_MB);buf != nullptr)
+	{
+		arch::string_benchmark(buf, 4_MB);
+		memory::vfree(buf);
+	}
+#endif
+
 	// boot other CPU cores
 	ap::init_ap();
 
@@ -1,6 +1,8 @@
 #include "system/kmalloc.hpp"
 #include "system/types.h"
 
+#include "compiler/compiler_extensions.hpp"
+
 #include "kbl/checker/allocate_checker.hpp"
 
 using align_val_t = std::align_val_t;
@@ -11,13 +13,13 @@ using nothrow_t = std::nothrow_t;
 [[nodiscard, deprecated("We can't handle exception right. This may cause kernel to terminate")]]void* operator new(
 	size_t len)
 {
-	return memory::kmalloc(len, 0);
+	return memory::kmalloc_from(len, 0, (uintptr_t)__GET_CALLER());
 }
 
 [[nodiscard, deprecated("We can't handle exception right. This may cause kernel to terminate")]]void* operator new[](
 	size_t len)
 {
-	return ::operator new(len);
+	return memory::kmalloc_from(len, 0, (uintptr_t)__GET_CALLER());
 }
 
 [[nodiscard, deprecated("We can't handle exception right. This may cause kernel to terminate")]]void* operator new(
@@ -25,7 +27,7 @@ using nothrow_t = std::nothrow_t;
 	align_val_t al)
 {
 	count = roundup(count, (size_t)al);
-	return ::operator new(count);
+	return memory::kmalloc_from(count, 0, (uintptr_t)__GET_CALLER());
 }
 
 [[nodiscard, deprecated("We can't handle exception right. This may cause kernel to terminate")]]void* operator new[](
@@ -33,33 +35,33 @@ using nothrow_t = std::nothrow_t;
 	align_val_t al)
 {
 	count = roundup(count, (size_t)al);
-	return ::operator new(count);
+	return memory::kmalloc_from(count, 0, (uintptr_t)__GET_CALLER());
 }
 
 // non-exception versions
 
 [[nodiscard]]void* operator new(size_t count, [[maybe_unused]]const nothrow_t& tag) noexcept
 {
-	return memory::kmalloc(count, 0);
+	return memory::kmalloc_from(count, 0, (uintptr_t)__GET_CALLER());
 }
 
 [[nodiscard]]void* operator new[](size_t count, [[maybe_unused]]const nothrow_t& tag) noexcept
 {
-	return ::operator new(count, tag);
+	return memory::kmalloc_from(count, 0, (uintptr_t)__GET_CALLER());
 }
 
 [[nodiscard]]void* operator new(size_t count,
 	align_val_t al, const nothrow_t& tag) noexcept
 {
 	count = roundup(count, (size_t)al);
-	return ::operator new(count, tag);
+	return memory::kmalloc_from(count, 0, (uintptr_t)__GET_CALLER());
 }
 
 [[nodiscard]]void* operator new[](size_t count,
 	align_val_t al, const nothrow_t& tag) noexcept
 {
 	count = roundup(count, (size_t)al);
-	return ::operator new(count, tag);
+	return memory::kmalloc_from(count, 0, (uintptr_t)__GET_CALLER());
 }
 
 // User-defined, they don't throw
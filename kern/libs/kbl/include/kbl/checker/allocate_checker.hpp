@@ -54,31 +54,32 @@ class allocate_checker final
 };
 }
 
-[[nodiscard]] inline void* operator new(size_t count, size_t flags, kbl::allocate_checker* ck) noexcept
+// always inlined, so that allocation profiling charges the block to the function that used new
+[[nodiscard]] __ALWAYS_INLINE inline void* operator new(size_t count, size_t flags, kbl::allocate_checker* ck) noexcept
 {
 	auto ret = memory::kmalloc(count, flags);
 	ck->arm(count, ret != nullptr);
 	return ret;
 }
 
-[[nodiscard]] inline void* operator new(size_t count, kbl::allocate_checker* ck) noexcept
+[[nodiscard]] __ALWAYS_INLINE inline void* operator new(size_t count, kbl::allocate_checker* ck) noexcept
 {
 	return ::operator new(count, 0, ck);
 }
 
-[[nodiscard]] inline void* operator new[](size_t count, size_t flags, kbl::allocate_checker* ck) noexcept
+[[nodiscard]] __ALWAYS_INLINE inline void* operator new[](size_t count, size_t flags, kbl::allocate_checker* ck) noexcept
 {
 	return ::operator new(count, flags, ck);
 }
 
-[[nodiscard]] inline void* operator new(size_t count,
+[[nodiscard]] __ALWAYS_INLINE inline void* operator new(size_t count,
 	std::align_val_t al, size_t flags, kbl::allocate_checker* ck) noexcept
 {
 	count = roundup(count, (size_t)al);
 	return ::operator new(count, flags, ck);
 }
 
-[[nodiscard]] inline void* operator new[](size_t count,
+[[nodiscard]] __ALWAYS_INLINE inline void* operator new[](size_t count,
 	std::align_val_t al, size_t flags, kbl::allocate_checker* ck) noexcept
 {
 	count = roundup(count, (size_t)al);
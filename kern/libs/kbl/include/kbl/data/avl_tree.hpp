@@ -2,6 +2,7 @@
 #include "system/types.h"
 
 #include <algorithm>
+#include <utility>
 
 using std::max;
 
@@ -323,4 +324,297 @@ class AVLTree
 	{
 		return m_size;
 	}
-};
\ No newline at end of file
+};
+namespace kbl
+{
+
+/// \brief node of avl_interval_tree, embedded in its parent as list_link does.
+/// The interval is half-open, [start_, end_), and mustn't be changed while the node is in a tree
+template<typename TParent, typename TKey>
+class avl_interval_link
+{
+ public:
+	avl_interval_link() = default;
+
+	explicit avl_interval_link(TParent* p) : parent_{ p }
+	{
+	}
+
+	avl_interval_link(const avl_interval_link&) = delete;
+	avl_interval_link& operator=(const avl_interval_link&) = delete;
+
+	TParent* parent_{ nullptr };
+
+	TKey start_{}, end_{};
+
+	// the max end_ in the subtree, which lets queries skip subtrees that can't overlap
+	TKey max_end_{};
+
+	size_t height_{ 0 };
+	avl_interval_link* left_{ nullptr }, * right_{ nullptr };
+};
+
+/// \brief intrusive AVL tree of intervals ordered by start, augmented with the max end of each subtree.
+/// No two intervals may share a start. Point and overlap queries take O(log n)
+template<typename TParent, typename TKey, avl_interval_link<TParent, TKey> TParent::*Link>
+class avl_interval_tree
+{
+ public:
+	using link_type = avl_interval_link<TParent, TKey>;
+
+	avl_interval_tree() = default;
+
+	avl_interval_tree(const avl_interval_tree&) = delete;
+	avl_interval_tree& operator=(const avl_interval_tree&) = delete;
+
+	avl_interval_tree(avl_interval_tree&& another) noexcept
+		: root_(std::exchange(another.root_, nullptr)),
+		  size_(std::exchange(another.size_, 0))
+	{
+	}
+
+	void insert(TParent* item, TKey start, TKey end)
+	{
+		auto link = &(item->*Link);
+
+		link->start_ = start;
+		link->end_ = end;
+		link->left_ = nullptr;
+		link->right_ = nullptr;
+		update(link);
+
+		root_ = insert(root_, link);
+		size_++;
+	}
+
+	void remove(TParent* item)
+	{
+		auto link = &(item->*Link);
+
+		root_ = remove(root_, link);
+		size_--;
+
+		link->left_ = nullptr;
+		link->right_ = nullptr;
+	}
+
+	/// \return the item whose interval contains point, or nullptr
+	TParent* find(TKey point) const
+	{
+		return first_overlap(point, point + 1);
+	}
+
+	/// \return the item with the lowest start among those overlapping [start, end), or nullptr
+	TParent* first_overlap(TKey start, TKey end) const
+	{
+		link_type* iter = root_;
+		while (iter != nullptr)
+		{
+			if (iter->left_ != nullptr && iter->left_->max_end_ > start)
+			{
+				// if nothing on the left overlaps, neither does anything from here on
+				iter = iter->left_;
+			}
+			else if (iter->start_ < end && start < iter->end_)
+			{
+				return iter->parent_;
+			}
+			else if (iter->start_ >= end)
+			{
+				return nullptr;
+			}
+			else
+			{
+				iter = iter->right_;
+			}
+		}
+
+		return nullptr;
+	}
+
+	/// \return the item with the greatest start no greater than key, or nullptr
+	TParent* floor(TKey key) const
+	{
+		link_type* iter = root_, * ret = nullptr;
+		while (iter != nullptr)
+		{
+			if (iter->start_ <= key)
+			{
+				ret = iter;
+				iter = iter->right_;
+			}
+			else
+			{
+				iter = iter->left_;
+			}
+		}
+
+		return ret != nullptr ? ret->parent_ : nullptr;
+	}
+
+	[[nodiscard]] size_t size() const
+	{
+		return size_;
+	}
+
+	[[nodiscard]] bool empty() const
+	{
+		return size_ == 0;
+	}
+
+ private:
+	static size_t height(link_type* n)
+	{
+		return n != nullptr ? n->height_ : 0;
+	}
+
+	static int balance_factor(link_type* n)
+	{
+		return n != nullptr ? (int)height(n->left_) - (int)height(n->right_) : 0;
+	}
+
+	// recompute height and the augmentation from the children
+	static void update(link_type* n)
+	{
+		n->height_ = std::max(height(n->left_), height(n->right_)) + 1;
+
+		n->max_end_ = n->end_;
+		if (n->left_ != nullptr && n->left_->max_end_ > n->max_end_)
+		{
+			n->max_end_ = n->left_->max_end_;
+		}
+		if (n->right_ != nullptr && n->right_->max_end_ > n->max_end_)
+		{
+			n->max_end_ = n->right_->max_end_;
+		}
+	}
+
+	static link_type* right_rotate(link_type* y)
+	{
+		link_type* x = y->left_;
+
+		y->left_ = x->right_;
+		x->right_ = y;
+
+		update(y);
+		update(x);
+
+		return x; // new root
+	}
+
+	static link_type* left_rotate(link_type* x)
+	{
+		link_type* y = x->right_;
+
+		x->right_ = y->left_;
+		y->left_ = x;
+
+		update(x);
+		update(y);
+
+		return y; // new root
+	}
+
+	static link_type* rebalance(link_type* n)
+	{
+		update(n);
+
+		auto factor = balance_factor(n);
+		if (factor > 1)
+		{
+			// left right
+			if (balance_factor(n->left_) < 0)
+			{
+				n->left_ = left_rotate(n->left_);
+			}
+			return right_rotate(n);
+		}
+		else if (factor < -1)
+		{
+			// right left
+			if (balance_factor(n->right_) > 0)
+			{
+				n->right_ = right_rotate(n->right_);
+			}
+			return left_rotate(n);
+		}
+
+		return n;
+	}
+
+	static link_type* insert(link_type* root, link_type* link)
+	{
+		if (root == nullptr)
+		{
+			return link;
+		}
+
+		if (link->start_ < root->start_)
+		{
+			root->left_ = insert(root->left_, link);
+		}
+		else
+		{
+			root->right_ = insert(root->right_, link);
+		}
+
+		return rebalance(root);
+	}
+
+	// detach the leftmost link of the subtree into min
+	static link_type* remove_min(link_type* root, link_type** min)
+	{
+		if (root->left_ == nullptr)
+		{
+			*min = root;
+			return root->right_;
+		}
+
+		root->left_ = remove_min(root->left_, min);
+		return rebalance(root);
+	}
+
+	static link_type* remove(link_type* root, link_type* link)
+	{
+		if (root == nullptr)
+		{
+			return nullptr;
+		}
+
+		if (root == link)
+		{
+			if (root->left_ == nullptr)
+			{
+				return root->right_;
+			}
+			else if (root->right_ == nullptr)
+			{
+				return root->left_;
+			}
+
+			link_type* successor = nullptr;
+			auto right = remove_min(root->right_, &successor);
+
+			successor->left_ = root->left_;
+			successor->right_ = right;
+
+			return rebalance(successor);
+		}
+
+		if (link->start_ < root->start_)
+		{
+			root->left_ = remove(root->left_, link);
+		}
+		else
+		{
+			root->right_ = remove(root->right_, link);
+		}
+
+		return rebalance(root);
+	}
+
+	link_type* root_{ nullptr };
+	size_t size_{ 0 };
+};
+
+}
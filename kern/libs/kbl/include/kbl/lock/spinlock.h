@@ -45,6 +45,11 @@ class TA_CAP("mutex") spinlock final
 	void unlock() noexcept
 	TA_REL();
 
+	/// \brief unlock, leaving interrupts disabled
+	/// \return the interrupt state unlock would have restored
+	interrupt_saved_state_type unlock_no_restore() noexcept
+	TA_REL();
+
 	/// \brief Try to lock
 	/// \return true if succeeded
 	bool try_lock() noexcept
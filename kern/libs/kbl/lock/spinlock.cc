@@ -1,4 +1,5 @@
 #include "arch/amd64/cpu/x86.h"
+#include "arch/amd64/cpu/intrinsics.hpp"
 
 #include "debug/backtrace.hpp"
 
@@ -96,13 +97,28 @@ bool lock::spinlock_holding(spinlock_struct* lock) TA_NO_THREAD_SAFETY_ANALYSIS
 
 void lock::spinlock::lock() noexcept
 {
-	state_ = arch_interrupt_save();
-
 	assert_not_held();
 
-	kdebug::kdebug_get_backtrace(spinlock_.pcs);
+	auto state = arch_interrupt_save();
+
+	// wait with the caller's interrupt state, so that a CPU spinning here still answers IPIs
+	// such as TLB shootdowns, which the holder of the lock may be waiting for.
+	while (arch_spinlock_try_lock(&spinlock_))
+	{
+		arch_interrupt_restore(state);
+
+		while (__atomic_load_n(&spinlock_.value, __ATOMIC_RELAXED) != 0)
+		{
+			arch::cpu_yield();
+		}
 
-	arch_spinlock_lock(&spinlock_);
+		state = arch_interrupt_save();
+	}
+
+	// only the holder may write the saved state
+	state_ = state;
+
+	kdebug::kdebug_get_backtrace(spinlock_.pcs);
 }
 
 void lock::spinlock::unlock() noexcept
@@ -116,9 +132,36 @@ void lock::spinlock::unlock() noexcept
 	arch_interrupt_restore(state_);
 }
 
+interrupt_saved_state_type lock::spinlock::unlock_no_restore() noexcept
+{
+	assert_held();
+
+	// only the holder may read the saved state
+	auto state = state_;
+
+	spinlock_.pcs[0] = 0;
+
+	arch_spinlock_unlock(&spinlock_);
+
+	return state;
+}
+
 bool lock::spinlock::try_lock() noexcept
 {
-	return !arch_spinlock_try_lock(&spinlock_);
+	auto state = arch_interrupt_save();
+
+	if (arch_spinlock_try_lock(&spinlock_))
+	{
+		arch_interrupt_restore(state);
+		return false;
+	}
+
+	// unlock() restores it like a lock taken by lock()
+	state_ = state;
+
+	kdebug::kdebug_get_backtrace(spinlock_.pcs);
+
+	return true;
 }
 bool lock::spinlock::holding() noexcept
 {
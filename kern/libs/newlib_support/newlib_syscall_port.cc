@@ -2,7 +2,7 @@
 #include "system/kmalloc.hpp"
 
 #include "debug/kdebug.h"
-#include "drivers/cmos/rtc.hpp"
+#include "drivers/clocksource/clocksource.hpp"
 #include "drivers/apic/timer.h"
 
 // Finished:
@@ -78,8 +78,9 @@ struct timezone
 
 extern "C" [[maybe_unused]] int gettimeofday(timeval* p, [[deprecated, maybe_unused]]timezone* z)
 {
-	p->tv_sec = cmos::cmos_read_rtc_timestamp();
-	p->tv_usec = p->tv_sec * 1000;
+	auto now = clocksource::wall_time();
+	p->tv_sec = now / NSEC_PER_SEC;
+	p->tv_usec = now % NSEC_PER_SEC / NSEC_PER_USEC;
 	return 0;
 }
 
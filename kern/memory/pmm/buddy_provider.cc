@@ -26,6 +26,8 @@
 
 #include "debug/kdebug.h"
 
+#include <algorithm>
+
 using namespace kbl;
 
 size_t memory::buddy_provider::get_order(size_t n)
@@ -51,40 +53,55 @@ void memory::buddy_provider::setup_for_base(page* base, size_t n)
 		p->property = 0;
 		p->ref = 0;
 		p->zone_id = zone_count_;
+		page_clear_rmap(p);
 	}
 
 	zones_[zone_count_].base = base;
+	zones_[zone_count_].size = n;
+	zones_[zone_count_].node = 0;
 	zone_count_++;
 
-	size_t order = MAX_ORDER, order_size = (1 << order);
+	auto areas = areas_of(base);
 
-	for (page* p = base + (n - 1); n != 0;)
+	// carve the range into naturally aligned blocks from its beginning,
+	// so that every block head is at an index that do_free() can merge from
+	for (size_t index = 0; index < n;)
 	{
-		while (n >= order_size)
+		size_t order = MAX_ORDER;
+		while (order > 0 && ((index & ((1ull << order) - 1)) != 0 || index + (1ull << order) > n))
 		{
-			page_set_flag(p, PHYSICAL_PAGE_FLAG_PROPERTY);
-			p->property = order;
-
-			list_add(&p->page_link, &free_areas_[order].freelist);
+			order--;
+		}
 
-			n -= order_size;
-			p -= order_size;
+		page* p = base + index;
+		page_set_flag(p, PHYSICAL_PAGE_FLAG_PROPERTY);
+		p->property = order;
 
-			free_areas_[order].free_count++;
-		}
+		list_add_tail(&p->page_link, &areas[order].freelist);
+		areas[order].free_count++;
 
-		order--;
-		order_size >>= 1;
+		index += (1ull << order);
 	}
 }
 
 page* memory::buddy_provider::allocate(size_t n)
+{
+	return allocate(n, 0);
+}
+
+page* memory::buddy_provider::allocate(size_t n, size_t node)
 {
 	KDEBUG_ASSERT(n > 0);
+	KDEBUG_ASSERT(node < NUMA_NODE_COUNT_LIMIT);
 
 	size_t order = get_order(n), order_size = (1 << order);
 
-	page* page = do_allocate(order);
+	page* page = nullptr;
+	for (size_t i = 0; i < fallback_count_[node] && page == nullptr; i++)
+	{
+		page = do_allocate(order, fallback_[node][i]);
+	}
+
 	if (page != nullptr && n != order_size)
 	{
 //		pmm::free_pages(page + n, order_size - n);
@@ -133,16 +150,205 @@ void memory::buddy_provider::free(page* base, size_t n)
 	}
 }
 
+page* memory::buddy_provider::allocate_single(size_t node)
+{
+	KDEBUG_ASSERT(node < NUMA_NODE_COUNT_LIMIT);
+
+	page* page = nullptr;
+	for (size_t i = 0; i < fallback_count_[node] && page == nullptr; i++)
+	{
+		page = do_allocate(0, fallback_[node][i]);
+	}
+
+	return page;
+}
+
+void memory::buddy_provider::free_single(page* pg)
+{
+	do_free(pg, 0);
+}
+
+page* memory::buddy_provider::block_at(size_t order, size_t index) const
+{
+	for (size_t i = 0; i < zone_count_; i++)
+	{
+		size_t blocks = zones_[i].size >> order;
+		if (index < blocks)
+		{
+			return zones_[i].base + (index << order);
+		}
+		index -= blocks;
+	}
+
+	return nullptr;
+}
+
+bool memory::buddy_provider::is_free_head(const page* pg)
+{
+	return !page_has_flag(pg, PHYSICAL_PAGE_FLAG_RESERVED) && page_has_flag(pg, PHYSICAL_PAGE_FLAG_PROPERTY);
+}
+
+size_t memory::buddy_provider::isolate_free(page* base, size_t order)
+{
+	KDEBUG_ASSERT((page_to_index(base) & ((1ull << order) - 1)) == 0);
+
+	// blocks are naturally aligned, so a free block overlapping the range either lies inside it or covers it
+	size_t ret = 0;
+	for (page* p = base; p < base + (1ull << order);)
+	{
+		if (!is_free_head(p))
+		{
+			p++;
+			continue;
+		}
+
+		size_t block_order = p->property, block_size = 1ull << block_order;
+		if (block_order > order)
+		{
+			// the range is part of a larger free block
+			break;
+		}
+
+		areas_of(p)[block_order].free_count--;
+		list_remove(&p->page_link);
+		page_clear_flag(p, PHYSICAL_PAGE_FLAG_PROPERTY);
+
+		for (page* q = p; q != p + block_size; q++)
+		{
+			page_set_flag(q, PHYSICAL_PAGE_FLAG_ISOLATED);
+		}
+
+		ret += block_size;
+		p += block_size;
+	}
+
+	return ret;
+}
+
 size_t memory::buddy_provider::free_count() const
+{
+	size_t ret = 0;
+	for (size_t node = 0; node < NUMA_NODE_COUNT_LIMIT; node++)
+	{
+		ret += free_count(node);
+	}
+	return ret;
+}
+
+size_t memory::buddy_provider::free_count(size_t node) const
 {
 	size_t ret = 0;
 	for (size_t order = 0; order <= MAX_ORDER; order++)
 	{
-		ret += free_areas_[order].free_count * (1 << order);
+		ret += free_areas_[node][order].free_count * (1 << order);
 	}
 	return ret;
 }
 
+size_t memory::buddy_provider::split_zone(size_t zone_id, page* at)
+{
+	KDEBUG_ASSERT(zone_count_ < ZONE_COUNT_MAX);
+
+	auto& old = zones_[zone_id];
+	KDEBUG_ASSERT(old.base < at && at < old.base + old.size);
+	KDEBUG_ASSERT(((at - old.base) & ((1ull << MAX_ORDER) - 1)) == 0);
+
+	size_t id = zone_count_++;
+	zones_[id] = zone{
+		.base = at,
+		.size = old.size - (at - old.base),
+		.node = old.node };
+
+	old.size = at - old.base;
+
+	// no block crosses at, and the offset keeps the alignment of those after it
+	for (page* p = at; p != at + zones_[id].size; p++)
+	{
+		p->zone_id = id;
+	}
+
+	return id;
+}
+
+void memory::buddy_provider::assign_node(page* first, size_t n, size_t node)
+{
+	KDEBUG_ASSERT(node < NUMA_NODE_COUNT_LIMIT);
+
+	page* last = first + n;
+
+	// zones split off are appended, and looked at again without effect
+	for (size_t z = 0; z < zone_count_; z++)
+	{
+		page* zone_begin = zones_[z].base, * zone_end = zone_begin + zones_[z].size;
+		if (last <= zone_begin || zone_end <= first)
+		{
+			continue;
+		}
+
+		auto align = [zone_begin](page* p)
+		{
+		  return zone_begin + roundup(size_t(p - zone_begin), 1ull << MAX_ORDER);
+		};
+
+		page* start = first <= zone_begin ? zone_begin : align(first);
+		page* stop = last >= zone_end ? zone_end : std::min(align(last), zone_end);
+		if (start >= stop)
+		{
+			continue;
+		}
+
+		size_t target = z;
+		if (start != zone_begin)
+		{
+			target = split_zone(z, start);
+		}
+
+		if (stop != zone_end)
+		{
+			split_zone(target, stop);
+		}
+
+		const size_t old_node = zones_[target].node;
+		if (old_node == node)
+		{
+			continue;
+		}
+
+		for (page* p = start; p < stop;)
+		{
+			if (!is_free_head(p))
+			{
+				p++;
+				continue;
+			}
+
+			size_t order = p->property;
+
+			list_remove(&p->page_link);
+			free_areas_[old_node][order].free_count--;
+
+			list_add(&p->page_link, &free_areas_[node][order].freelist);
+			free_areas_[node][order].free_count++;
+
+			p += 1ull << order;
+		}
+
+		zones_[target].node = node;
+	}
+}
+
+void memory::buddy_provider::set_fallback(size_t node, const size_t* nodes, size_t count)
+{
+	KDEBUG_ASSERT(node < NUMA_NODE_COUNT_LIMIT);
+	KDEBUG_ASSERT(count <= NUMA_NODE_COUNT_LIMIT);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		fallback_[node][i] = nodes[i];
+	}
+	fallback_count_[node] = count;
+}
+
 bool memory::buddy_provider::is_buddy_page(page* page, size_t order, size_t zone)
 {
 
@@ -181,9 +387,11 @@ void memory::buddy_provider::do_free(page* base, size_t order)
 
 		p->flags = 0;
 		p->ref = 0;
+		page_clear_rmap(p);
 	}
 
 	size_t zone_id = base->zone_id;
+	auto areas = areas_of(base);
 	while (order < MAX_ORDER)
 	{
 		buddy_index = page_index ^ (1 << order);
@@ -194,7 +402,7 @@ void memory::buddy_provider::do_free(page* base, size_t order)
 			break;
 		}
 
-		free_areas_[order].free_count--;
+		areas[order].free_count--;
 
 		list_remove(&buddy->page_link);
 		page_clear_flag(buddy, PHYSICAL_PAGE_FLAG_PROPERTY);
@@ -207,23 +415,25 @@ void memory::buddy_provider::do_free(page* base, size_t order)
 
 	page->property = order;
 	page_set_flag(page, PHYSICAL_PAGE_FLAG_PROPERTY);
-	free_areas_[order].free_count++;
-	list_add(&page->page_link, &free_areas_[order].freelist);
+	areas[order].free_count++;
+	list_add(&page->page_link, &areas[order].freelist);
 }
 
-page* memory::buddy_provider::do_allocate(size_t order)
+page* memory::buddy_provider::do_allocate(size_t order, size_t node)
 {
 	KDEBUG_ASSERT(order <= MAX_ORDER);
 
+	auto areas = free_areas_[node];
+
 	for (size_t cur_order = order; cur_order <= MAX_ORDER; cur_order++)
 	{
-		if (!list_empty(&free_areas_[cur_order].freelist))
+		if (!list_empty(&areas[cur_order].freelist))
 		{
 
-			auto entry = free_areas_[cur_order].freelist.next;
+			auto entry = areas[cur_order].freelist.next;
 			page* pg = list_entry(entry, page, page_link);
 
-			free_areas_[cur_order].free_count--;
+			areas[cur_order].free_count--;
 
 			list_remove(entry);
 
@@ -239,9 +449,9 @@ page* memory::buddy_provider::do_allocate(size_t order)
 
 				page_set_flag(buddy, PHYSICAL_PAGE_FLAG_PROPERTY);
 
-				free_areas_[cur_order].free_count++;
+				areas[cur_order].free_count++;
 
-				list_add(&buddy->page_link, &free_areas_[cur_order].freelist);
+				list_add(&buddy->page_link, &areas[cur_order].freelist);
 			}
 
 			page_clear_flag(pg, PHYSICAL_PAGE_FLAG_PROPERTY);
@@ -254,10 +464,20 @@ page* memory::buddy_provider::do_allocate(size_t order)
 
 memory::buddy_provider::buddy_provider()
 {
-	for (size_t i = 0; i <= MAX_ORDER; i++)
+	for (size_t node = 0; node < NUMA_NODE_COUNT_LIMIT; node++)
 	{
-		list_init(&free_areas_[i].freelist);
-		free_areas_[i].free_count = 0;
+		for (size_t i = 0; i <= MAX_ORDER; i++)
+		{
+			list_init(&free_areas_[node][i].freelist);
+			free_areas_[node][i].free_count = 0;
+		}
+
+		// nearest first is unknown until the SLIT is read
+		fallback_count_[node] = NUMA_NODE_COUNT_LIMIT;
+		for (size_t i = 0; i < NUMA_NODE_COUNT_LIMIT; i++)
+		{
+			fallback_[node][i] = (node + i) % NUMA_NODE_COUNT_LIMIT;
+		}
 	}
 
 	well_constructed_ = true;
@@ -0,0 +1,105 @@
+#include "memory/compaction.hpp"
+#include "memory/pmm.hpp"
+#include "memory/address_space.hpp"
+
+#include "system/pmm.h"
+
+using namespace memory;
+
+// set when an allocation of several pages fails, cleared once a block is freed
+static bool compaction_due{ false };
+
+static bool compacting{ false };
+
+// the next block to look at, so that successive calls go over the whole memory
+static size_t cursor{ 0 };
+
+// move every page still in use out of the isolated block
+static bool migrate_block(page* base, size_t order)
+{
+	auto pmm = physical_memory_manager::instance();
+
+	for (page* p = base; p != base + (1ull << order); p++)
+	{
+		// the free pages, and those unmapped since the block was isolated
+		if (page_has_flag(p, PHYSICAL_PAGE_FLAG_ISOLATED) || p->rmap_owner == nullptr)
+		{
+			continue;
+		}
+
+		auto to = pmm->allocate();
+		if (to == nullptr)
+		{
+			return false;
+		}
+
+		if (address_space::migrate_page(p, to) != ERROR_SUCCESS)
+		{
+			pmm->free(to);
+			return false;
+		}
+
+		page_set_flag(p, PHYSICAL_PAGE_FLAG_ISOLATED);
+	}
+
+	return true;
+}
+
+bool memory::compact(size_t order, size_t budget)
+{
+	if (__atomic_exchange_n(&compacting, true, __ATOMIC_ACQUIRE))
+	{
+		return false;
+	}
+
+	auto pmm = physical_memory_manager::instance();
+
+	// pages cached by this CPU are in use as far as the provider knows
+	pmm->drain_per_cpu();
+
+	bool ret = false;
+	for (size_t i = 0; i < budget && !ret; i++)
+	{
+		auto base = pmm->block_at(order, cursor++);
+		if (base == nullptr)
+		{
+			cursor = 0;
+			base = pmm->block_at(order, cursor++);
+			if (base == nullptr)
+			{
+				break;
+			}
+		}
+
+		if (!pmm->isolate_block(base, order))
+		{
+			continue;
+		}
+
+		// a block that fails keeps the pages moved so far elsewhere, which doesn't hurt
+		migrate_block(base, order);
+		ret = pmm->release_block(base, order);
+	}
+
+	__atomic_store_n(&compacting, false, __ATOMIC_RELEASE);
+
+	return ret;
+}
+
+void memory::compact_kick()
+{
+	__atomic_store_n(&compaction_due, true, __ATOMIC_RELAXED);
+}
+
+void memory::compact_if_needed()
+{
+	if (!__atomic_load_n(&compaction_due, __ATOMIC_RELAXED))
+	{
+		return;
+	}
+
+	if (compact(COMPACTION_ORDER, COMPACTION_SCAN_BUDGET))
+	{
+		__atomic_store_n(&compaction_due, false, __ATOMIC_RELAXED);
+	}
+}
@@ -21,14 +21,22 @@
 #include "system/kmem.hpp"
 #include "system/pmm.h"
 
+#include "compiler/compiler_extensions.hpp"
+
+#include "drivers/acpi/cpu.h"
 #include "drivers/console/console.h"
 #include "debug/kdebug.h"
 
 #include "memory/pmm.hpp"
+#include "memory/alloc_profile.hpp"
 
 #include "kbl/lock/lock_guard.hpp"
 
+#include <algorithm>
 #include <cstring>
+#include <utility>
+
+#include <gsl/util>
 
 using namespace memory;
 using namespace memory::kmem;
@@ -51,37 +59,88 @@ struct slab
 	list_head slab_link{};
 };
 
+// a stack of constructed objects which a CPU can allocate from without locking
+struct kmem_magazine
+{
+	size_t rounds{};
+	void* objs[KMEM_MAGAZINE_SIZE]{};
+
+	list_head magazine_link{};
+};
+
+static_assert(KMEM_CPU_CACHE_COUNT >= CPU_COUNT_LIMIT, "each CPU should have its kmem_cpu_cache");
+
 list_head cache_head;
 spinlock cache_head_lock{ "kmem_cache_head" };
 
 kmem_cache* sized_caches[KMEM_SIZED_CACHE_COUNT];
 kmem_cache cache_cache;
 
-static inline constexpr size_t cache_obj_count(kmem_cache* cache, size_t obj_size)
+kmem_cache* magazine_cache = nullptr;
+
+#ifdef _KERNEL_ENABLE_ALLOC_PROFILE
+// the call site of each object follows the bufctls, so that its free is charged to the site that allocated it
+constexpr size_t SLAB_OBJ_OVERHEAD = sizeof(kmem_bufctl) + sizeof(uintptr_t);
+#else
+constexpr size_t SLAB_OBJ_OVERHEAD = sizeof(kmem_bufctl);
+#endif
+
+// the offset of the first object in a slab that holds obj_count objects
+static inline size_t slab_obj_offset(kmem_cache* cache, size_t obj_count)
 {
-	// return PMM_PAGE_SIZE / (sizeof(kmem_bufctl) + obj_size);
-	size_t header_size = (sizeof(kmem_bufctl) + obj_size);
+	size_t offset = sizeof(slab) + SLAB_OBJ_OVERHEAD * obj_count + 16;
 	if (cache->flags & memory::kmem::KMEM_CACHE_4KALIGN)
 	{
-		header_size = roundup(header_size, (uintptr_t)4_KB);
+		offset = roundup(offset, (size_t)4_KB);
+	}
+
+	return offset;
+}
+
+static inline size_t cache_obj_count(kmem_cache* cache, size_t slab_size)
+{
+	size_t count = (slab_size - sizeof(slab) - 16) / (SLAB_OBJ_OVERHEAD + cache->obj_size);
+
+	// the alignment padding may push the last objects out of the slab
+	while (count > 0 && slab_obj_offset(cache, count) + count * cache->obj_size > slab_size)
+	{
+		count--;
+	}
+
+	return count;
+}
+
+// A slab takes up a power-of-two count of pages, which is allocated from the buddy allocator
+// and thus aligned to its size. It grows until it holds KMEM_SLAB_MIN_OBJ_COUNT objects
+static inline void cache_layout(kmem_cache* cache)
+{
+	cache->slab_size = PAGE_SIZE;
+	cache->obj_count = cache_obj_count(cache, cache->slab_size);
+
+	while (cache->obj_count < KMEM_SLAB_MIN_OBJ_COUNT && cache->slab_size < LARGE_PAGE_SIZE)
+	{
+		cache->slab_size *= 2;
+		cache->obj_count = cache_obj_count(cache, cache->slab_size);
 	}
 
-	return PAGE_SIZE / header_size;
+	KDEBUG_ASSERT(cache->obj_count > 0);
 }
 
 static inline void* slab_cache_grow(kmem_cache* cache)
 {
 	cache->lock.assert_held();
 
-	auto page = memory::physical_memory_manager::instance()->allocate(); //alloc_page();
-
-	auto block = (void*)pmm::page_to_va(page);
+	auto page = memory::physical_memory_manager::instance()->allocate(cache->slab_size / PAGE_SIZE);
 
-	if (block == nullptr)
+	if (page == nullptr)
 	{
-		return block;
+		return nullptr;
 	}
 
+	page_set_flag(page, PHYSICAL_PAGE_FLAG_SLAB);
+
+	auto block = (void*)pmm::page_to_va(page);
+
 	auto slb = new(block) slab{};  //reinterpret_cast<decltype(slb)>(block);
 	lock::lock_guard g{ slb->lock };
 
@@ -93,14 +152,7 @@ static inline void* slab_cache_grow(kmem_cache* cache)
 
 	slb->freelist = reinterpret_cast<decltype(slb->freelist)>(((char*)block) + sizeof(slab));
 
-	uintptr_t
-		after_freelist_addr = (uintptr_t)(((char*)block) + sizeof(slab) + sizeof(kmem_bufctl) * cache->obj_count + 16);
-	if (cache->flags & memory::kmem::KMEM_CACHE_4KALIGN)
-	{
-		after_freelist_addr = roundup(after_freelist_addr, (uintptr_t)4_KB);
-	}
-
-	slb->obj_ptr = reinterpret_cast<decltype(slb->obj_ptr)>(after_freelist_addr);
+	slb->obj_ptr = reinterpret_cast<decltype(slb->obj_ptr)>(((char*)block) + slab_obj_offset(cache, cache->obj_count));
 
 	void* obj = slb->obj_ptr;
 	for (size_t i = 0; i < cache->obj_count; i++)
@@ -132,46 +184,325 @@ static inline void slab_destory(kmem_cache* cache, slab* slb)
 		{
 			cache->dtor(obj, cache, cache->obj_size);
 		}
+
+		obj = (void*)((char*)obj + cache->obj_size);
 	}
 
 	list_remove(&slb->slab_link);
 
 	uintptr_t va = (uintptr_t)slb;
 
-	physical_memory_manager::instance()->free((page*)(pmm::va_to_page(va)));
-//	free_page((page*)(pmm::va_to_page(va)));
+	auto page = pmm::va_to_page(va);
+	page_clear_flag(page, PHYSICAL_PAGE_FLAG_SLAB);
+
+	physical_memory_manager::instance()->free(page, cache->slab_size / PAGE_SIZE);
 }
 
-// ATTENTION: BE CAUTIOUS FOR RACE CONDITION
-// This function should not be a critial section because there's no modifying
+// A slab is aligned to its size and its header is at the beginning,
+// so the owning slab of an object is found by masking, no matter how many slabs the cache has
 static inline slab* slab_find(kmem_cache* cache, void* obj)
 {
-	list_head* heads[] = { &cache->partial, &cache->full };
-	slab* slb = nullptr;
+	auto slb = reinterpret_cast<slab*>(rounddown((uintptr_t)obj, cache->slab_size));
+
+	KDEBUG_ASSERT(page_has_flag(pmm::va_to_page((uintptr_t)slb), PHYSICAL_PAGE_FLAG_SLAB));
+	KDEBUG_ASSERT(slb->cache == cache);
+
+	return slb;
+}
+
+#ifdef _KERNEL_ENABLE_ALLOC_PROFILE
+// only the owner of the object writes its slot, so no lock is needed
+static inline uintptr_t* slab_obj_caller(kmem_cache* cache, void* obj)
+{
+	auto slb = slab_find(cache, obj);
+	auto callers = reinterpret_cast<uintptr_t*>(slb->freelist + cache->obj_count);
+
+	return &callers[((uintptr_t)obj - (uintptr_t)slb->obj_ptr) / cache->obj_size];
+}
+#endif
+
+static inline void* slab_alloc_locked(kmem_cache* cache)
+{
+	cache->lock.assert_held();
+
+	list_head* entry = nullptr;
+	if (!list_empty(&cache->partial))
+	{
+		entry = cache->partial.next;
+	}
+	else
+	{
+		if (list_empty(&cache->free) && slab_cache_grow(cache) == nullptr)
+		{
+			return nullptr;
+		}
+
+		entry = cache->free.next;
+	}
+
+	KDEBUG_ASSERT(entry != nullptr);
+
+	list_remove(entry);
+	slab* slb = list_entry(entry, slab, slab_link);
+	lock_guard g{ slb->lock };
+
+	void* ret = (void*)(((uint8_t*)slb->obj_ptr) + slb->next_free * cache->obj_size);
+
+	slb->inuse++;
+	slb->next_free = slb->freelist[slb->next_free];
+
+	if (slb->inuse == cache->obj_count)
+	{
+		list_add(entry, &cache->full);
+	}
+	else
+	{
+		list_add(entry, &cache->partial);
+	}
 
+	if (cache->flags & KMEM_CACHE_4KALIGN)
+	{
+		KDEBUG_ASSERT((((uintptr_t)ret) % 4_KB) == 0);
+	}
+
+	return ret;
+}
+
+static inline void slab_free_locked(kmem_cache* cache, void* obj)
+{
+	cache->lock.assert_held();
+
+	slab* slb = slab_find(cache, obj);
+	KDEBUG_ASSERT(slb != nullptr);
+	lock_guard g{ slb->lock };
+
+	size_t offset = (((uintptr_t)obj) - ((uintptr_t)slb->obj_ptr)) / cache->obj_size;
+
+	list_remove(&slb->slab_link);
+	slb->freelist[offset] = slb->next_free;
+	slb->next_free = offset;
+	slb->inuse--;
+
+	if (slb->inuse == 0)
+	{
+		list_add(&slb->slab_link, &cache->free);
+	}
+	else
+	{
+		list_add(&slb->slab_link, &cache->partial);
+	}
+}
+
+// Magazine layer, as is described in Bonwick's
+// "Magazines and Vmem: Extending the Slab Allocator to Many CPUs and Arbitrary Resources"
+// Each CPU holds a loaded and a previous magazine. Only when both of them run empty (or full)
+// does it exchange magazines with the depot, and only when the depot can't help
+// does it reach the slab lists.
+
+static inline bool use_magazine(kmem_cache* cache)
+{
+	return !(cache->flags & KMEM_CACHE_NOMAGAZINE) && magazine_cache != nullptr && cpu.is_valid();
+}
+
+static inline kmem_magazine* magazine_create()
+{
+	auto mem = kmem_cache_alloc(magazine_cache);
+	if (mem == nullptr)
+	{
+		return nullptr;
+	}
+
+	return new(mem) kmem_magazine{};
+}
+
+static inline void magazine_destroy(kmem_magazine* mag)
+{
+	KDEBUG_ASSERT(mag->rounds == 0);
+	kmem_cache_free(magazine_cache, mag);
+}
+
+// return all rounds to the slab layer
+static inline void magazine_flush_locked(kmem_cache* cache, kmem_magazine* mag)
+{
+	cache->lock.assert_held();
+
+	while (mag->rounds > 0)
+	{
+		slab_free_locked(cache, mag->objs[--mag->rounds]);
+	}
+}
+
+static inline void depot_flush_locked(kmem_cache* cache)
+{
+	cache->lock.assert_held();
+
+	list_head* heads[] = { &cache->depot_full, &cache->depot_empty };
 	for (auto head : heads)
 	{
-		list_head* iter = nullptr;
-		list_for(iter, head)
+		while (!list_empty(head))
 		{
-			slab* s = list_entry(iter, slab, slab_link);
-			uintptr_t begin = (uintptr_t)s->obj_ptr;
-			uintptr_t end = (uintptr_t)(((char*)s->obj_ptr) + cache->obj_size * cache->obj_count);
-			if (((uintptr_t)obj) >= begin && ((uintptr_t)obj) < end)
-			{
-				slb = s;
-				break;
-			}
+			auto mag = list_entry(head->next, kmem_magazine, magazine_link);
+			list_remove(&mag->magazine_link);
+
+			magazine_flush_locked(cache, mag);
+			magazine_destroy(mag);
 		}
 	}
 
-	return slb;
+	cache->depot_full_count = 0;
+	cache->depot_empty_count = 0;
+}
+
+// return the rounds in the depot to the slab layer, as they pin their slabs. The emptied magazines stay in the depot,
+// so nothing is freed to the magazine cache, whose lock this CPU may hold when reclaim runs from its allocation path
+static inline void depot_drain_locked(kmem_cache* cache)
+{
+	cache->lock.assert_held();
+
+	while (!list_empty(&cache->depot_full))
+	{
+		auto mag = list_entry(cache->depot_full.next, kmem_magazine, magazine_link);
+		list_remove(&mag->magazine_link);
+
+		magazine_flush_locked(cache, mag);
+		list_add(&mag->magazine_link, &cache->depot_empty);
+	}
+
+	cache->depot_empty_count += cache->depot_full_count;
+	cache->depot_full_count = 0;
+}
+
+// move the empty magazines of the depot to mags, which are freed by magazines_release after the lock is dropped
+static inline void depot_take_empty_locked(kmem_cache* cache, list_head* mags)
+{
+	cache->lock.assert_held();
+
+	while (!list_empty(&cache->depot_empty))
+	{
+		auto mag = list_entry(cache->depot_empty.next, kmem_magazine, magazine_link);
+		list_remove(&mag->magazine_link);
+		list_add(&mag->magazine_link, mags);
+	}
+
+	cache->depot_empty_count = 0;
+}
+
+static inline void magazines_release(list_head* mags)
+{
+	while (!list_empty(mags))
+	{
+		auto mag = list_entry(mags->next, kmem_magazine, magazine_link);
+		list_remove(&mag->magazine_link);
+
+		magazine_destroy(mag);
+	}
+}
+
+static inline void* magazine_alloc(kmem_cache* cache)
+{
+	auto cc = &cache->cpu_caches[cpu->id];
+
+	if (cc->loaded != nullptr && cc->loaded->rounds > 0)
+	{
+		cc->alloc_hits++;
+		return cc->loaded->objs[--cc->loaded->rounds];
+	}
+
+	if (cc->previous != nullptr && cc->previous->rounds > 0)
+	{
+		std::swap(cc->loaded, cc->previous);
+
+		cc->alloc_hits++;
+		return cc->loaded->objs[--cc->loaded->rounds];
+	}
+
+	cc->alloc_misses++;
+
+	lock_guard g{ cache->lock };
+
+	if (list_empty(&cache->depot_full))
+	{
+		return slab_alloc_locked(cache);
+	}
+
+	auto full = list_entry(cache->depot_full.next, kmem_magazine, magazine_link);
+	list_remove(&full->magazine_link);
+	cache->depot_full_count--;
+
+	// both magazines are empty here, keep one of them.
+	if (cc->previous != nullptr)
+	{
+		list_add(&cc->previous->magazine_link, &cache->depot_empty);
+		cache->depot_empty_count++;
+	}
+
+	cc->previous = cc->loaded;
+	cc->loaded = full;
+
+	return cc->loaded->objs[--cc->loaded->rounds];
+}
+
+static inline void magazine_free(kmem_cache* cache, void* obj)
+{
+	auto cc = &cache->cpu_caches[cpu->id];
+
+	if (cc->loaded != nullptr && cc->loaded->rounds < KMEM_MAGAZINE_SIZE)
+	{
+		cc->free_hits++;
+		cc->loaded->objs[cc->loaded->rounds++] = obj;
+		return;
+	}
+
+	if (cc->previous != nullptr && cc->previous->rounds == 0)
+	{
+		std::swap(cc->loaded, cc->previous);
+
+		cc->free_hits++;
+		cc->loaded->objs[cc->loaded->rounds++] = obj;
+		return;
+	}
+
+	cc->free_misses++;
+
+	kmem_magazine* empty = nullptr;
+	{
+		lock_guard g{ cache->lock };
+
+		if (!list_empty(&cache->depot_empty))
+		{
+			empty = list_entry(cache->depot_empty.next, kmem_magazine, magazine_link);
+			list_remove(&empty->magazine_link);
+			cache->depot_empty_count--;
+		}
+	}
+
+	// the magazine cache has no magazines, so this never recurses.
+	if (empty == nullptr && (empty = magazine_create()) == nullptr)
+	{
+		lock_guard g{ cache->lock };
+		slab_free_locked(cache, obj);
+		return;
+	}
+
+	lock_guard g{ cache->lock };
+
+	// loaded is full, and previous, if any, is full as well.
+	if (cc->previous != nullptr)
+	{
+		list_add(&cc->previous->magazine_link, &cache->depot_full);
+		cache->depot_full_count++;
+	}
+
+	cc->previous = cc->loaded;
+	cc->loaded = empty;
+
+	cc->loaded->objs[cc->loaded->rounds++] = obj;
 }
 
 void memory::kmem::kmem_init()
 {
 	cache_cache.obj_size = sizeof(decltype(cache_cache));
-	cache_cache.obj_count = cache_obj_count(&cache_cache, cache_cache.obj_size);
+	cache_layout(&cache_cache);
 	cache_cache.ctor = nullptr;
 	cache_cache.dtor = nullptr;
 
@@ -182,27 +513,40 @@ void memory::kmem::kmem_init()
 	list_init(&cache_cache.partial);
 	list_init(&cache_cache.free);
 
+	list_init(&cache_cache.depot_full);
+	list_init(&cache_cache.depot_empty);
+
 	list_init(&cache_head);
 	list_add(&cache_cache.cache_link, &cache_head);
 
+	magazine_cache = kmem_cache_create("magazine", sizeof(kmem_magazine), nullptr, nullptr, KMEM_CACHE_NOMAGAZINE);
+
 	char sized_cache_name[KMEM_CACHE_NAME_MAXLEN];
 	size_t sized_cache_count = 0;
-	for (size_t sz = KMEM_MIN_SIZED_CACHE_SIZE; sz <= KMEM_MAX_SIZED_CACHE_SIZE; sz *= 2)
+	for (auto sz: KMEM_SIZE_CLASSES)
 	{
-
 		memset(sized_cache_name, 0, sizeof(sized_cache_name));
 
-		sized_cache_name[0] = 's';
-		sized_cache_name[1] = 'i';
-		sized_cache_name[2] = 'z';
-		sized_cache_name[3] = 'e';
-		sized_cache_name[4] = '_';
-		sized_cache_name[5] = '0' + char(sz);
+		// size_<sz>
+		constexpr char prefix[] = "size_";
+		memmove(sized_cache_name, prefix, sizeof(prefix) - 1);
+
+		char digits[20]{};
+		size_t digit_count = 0;
+		for (size_t val = sz; val; val /= 10)
+		{
+			digits[digit_count++] = char('0' + val % 10);
+		}
+
+		for (size_t i = 0; i < digit_count; i++)
+		{
+			sized_cache_name[sizeof(prefix) - 1 + i] = digits[digit_count - 1 - i];
+		}
 
 		sized_caches[sized_cache_count++] = kmem_cache_create(sized_cache_name, sz, nullptr, nullptr);
 	}
 
-	KDEBUG_ASSERT(sized_cache_count == sized_cache_count);
+	KDEBUG_ASSERT(sized_cache_count == KMEM_SIZED_CACHE_COUNT);
 }
 
 kmem_cache* memory::kmem::kmem_cache_create(const char* name,
@@ -211,26 +555,30 @@ kmem_cache* memory::kmem::kmem_cache_create(const char* name,
 	kmem_dtor_type dtor,
 	size_t flags)
 {
-	KDEBUG_ASSERT(size < PAGE_SIZE - sizeof(kmem_bufctl));
+	KDEBUG_ASSERT(size <= KMEM_MAX_SIZED_CACHE_SIZE);
 	kmem_cache* ret =
 		new(kmem_cache_alloc(&cache_cache))kmem_cache{}; //reinterpret_cast<decltype(ret)>(kmem_cache_alloc(&cache_cache));
 
 	if (ret != nullptr)
 	{
-		ret->obj_size = size;
-		ret->obj_count = cache_obj_count(ret, size);
+		ret->flags = flags;
+
+		// every object, not only the first, should be aligned
+		ret->obj_size = (flags & KMEM_CACHE_4KALIGN) ? roundup(size, (size_t)4_KB) : size;
+		cache_layout(ret);
 
 		ret->ctor = ctor;
 		ret->dtor = dtor;
 
-		ret->flags = flags;
-
 		strncpy(ret->name, name, KMEM_CACHE_NAME_MAXLEN);
 
 		list_init(&ret->full);
 		list_init(&ret->partial);
 		list_init(&ret->free);
 
+		list_init(&ret->depot_full);
+		list_init(&ret->depot_empty);
+
 		{
 			lock_guard gcache{ cache_head_lock };
 
@@ -246,58 +594,71 @@ kmem_cache* memory::kmem::kmem_cache_create(const char* name,
 	return ret;
 }
 
-void* memory::kmem::kmem_cache_alloc(kmem_cache* cache)
+static inline void* cache_alloc(kmem_cache* cache)
 {
-	lock_guard g1{ cache->lock };
-
-	list_head* entry = nullptr;
-	if (!list_empty(&cache->partial))
-	{
-		entry = cache->partial.next;
-	}
-	else
+	if (!use_magazine(cache))
 	{
-		if (list_empty(&cache->free) && slab_cache_grow(cache) == nullptr)
-		{
-			return nullptr;
-		}
-
-		entry = cache->free.next;
+		lock_guard g{ cache->lock };
+		return slab_alloc_locked(cache);
 	}
 
-	KDEBUG_ASSERT(entry != nullptr);
+	auto state = arch_interrupt_save();
+	auto _ = gsl::finally([&state]()
+	{
+	  arch_interrupt_restore(state);
+	});
 
-	list_remove(entry);
-	slab* slb = list_entry(entry, slab, slab_link);
-	lock_guard g{ slb->lock };
+	return magazine_alloc(cache);
+}
 
-	void* ret = (void*)(((uint8_t*)slb->obj_ptr) + slb->next_free * cache->obj_size);
+void* memory::kmem::kmem_cache_alloc(kmem_cache* cache)
+{
+	return kmem_cache_alloc_from(cache, (uintptr_t)__GET_CALLER());
+}
 
-	slb->inuse++;
-	slb->next_free = slb->freelist[slb->next_free];
+void* memory::kmem::kmem_cache_alloc_from(kmem_cache* cache, [[maybe_unused]] uintptr_t caller)
+{
+	auto ret = cache_alloc(cache);
 
-	if (slb->inuse == cache->obj_count)
+#ifdef _KERNEL_ENABLE_ALLOC_PROFILE
+	if (ret != nullptr)
 	{
-		list_add(entry, &cache->full);
-	}
-	else
-	{
-		list_add(entry, &cache->partial);
-	}
-
-	if (cache->flags & KMEM_CACHE_4KALIGN)
-	{
-		KDEBUG_ASSERT((((uintptr_t)ret) % 4_KB) == 0);
+		*slab_obj_caller(cache, ret) = caller;
+		alloc_profile_alloc(caller, cache, cache->obj_size);
 	}
+#endif
 
 	return ret;
 }
 
 void memory::kmem::kmem_cache_destroy(kmem_cache* cache)
 {
+	{
+		lock_guard gcache{ cache_head_lock };
+		list_remove(&cache->cache_link);
+	}
+
 	{
 		lock_guard g1{ cache->lock };
 
+		// nobody should be using the cache now, so take back magazines of all CPUs
+		for (auto& cc:cache->cpu_caches)
+		{
+			kmem_magazine* mags[] = { cc.loaded, cc.previous };
+			for (auto mag : mags)
+			{
+				if (mag != nullptr)
+				{
+					magazine_flush_locked(cache, mag);
+					magazine_destroy(mag);
+				}
+			}
+
+			cc.loaded = cc.previous = nullptr;
+		}
+
+		depot_flush_locked(cache);
+
 		list_head* heads[] = { &cache->full, &cache->partial, &cache->free };
 		for (auto head : heads)
 		{
@@ -318,33 +679,38 @@ void memory::kmem::kmem_cache_free(kmem_cache* cache, void* obj)
 {
 	KDEBUG_ASSERT(obj != nullptr && cache != nullptr);
 
-	slab* slb = slab_find(cache, obj);
-	KDEBUG_ASSERT(slb != nullptr);
-	lock_guard g{ slb->lock };
+#ifdef _KERNEL_ENABLE_ALLOC_PROFILE
+	alloc_profile_free(*slab_obj_caller(cache, obj), cache, cache->obj_size);
+#endif
 
-	size_t offset = (((uintptr_t)obj) - ((uintptr_t)slb->obj_ptr)) / cache->obj_size;
-
-	lock_guard g1{ cache->lock };
+	kmem_cache_free_untracked(cache, obj);
+}
 
-	list_remove(&slb->slab_link);
-	slb->freelist[offset] = slb->next_free;
-	slb->next_free = offset;
-	slb->inuse--;
+void memory::kmem::kmem_cache_free_untracked(kmem_cache* cache, void* obj)
+{
+	KDEBUG_ASSERT(obj != nullptr && cache != nullptr);
 
-	if (slb->inuse == 0)
+	if (!use_magazine(cache))
 	{
-		list_add(&slb->slab_link, &cache->free);
+		lock_guard g{ cache->lock };
+		slab_free_locked(cache, obj);
+		return;
 	}
-	else
+
+	auto state = arch_interrupt_save();
+	auto _ = gsl::finally([&state]()
 	{
-		list_add(&slb->slab_link, &cache->partial);
-	}
+	  arch_interrupt_restore(state);
+	});
 
+	magazine_free(cache, obj);
 }
 
-size_t memory::kmem::kmem_cache_shrink(kmem_cache* cache)
+static size_t cache_shrink_locked(kmem_cache* cache)
 {
-	lock_guard g1{ cache->lock };
+	cache->lock.assert_held();
+
+	depot_drain_locked(cache);
 
 	size_t count = 0;
 	auto entry = cache->free.next;
@@ -355,19 +721,113 @@ size_t memory::kmem::kmem_cache_shrink(kmem_cache* cache)
 		auto slb = list_entry(entry, slab, slab_link);
 		entry = entry->next;
 		slab_destory(cache, slb);
-		count++;
+		count += cache->slab_size / PAGE_SIZE;
+	}
+
+	return count;
+}
+
+size_t memory::kmem::kmem_cache_shrink(kmem_cache* cache)
+{
+	list_head mags{};
+	list_init(&mags);
+
+	size_t count = 0;
+	{
+		lock_guard g1{ cache->lock };
+		count = cache_shrink_locked(cache);
+		depot_take_empty_locked(cache, &mags);
 	}
 
+	magazines_release(&mags);
+
 	return count;
 }
 
 size_t memory::kmem::kmem_cache_reap()
 {
 	size_t count = 0;
+
+	lock_guard g{ cache_head_lock };
+
 	list_head* iter = nullptr;
 	list_for(iter, &cache_head)
 	{
-		count += kmem_cache_shrink(list_entry(iter, kmem_cache, cache_link));
+		auto cache = list_entry(iter, kmem_cache, cache_link);
+
+		// reaping may run from the allocation path of a cache, even on this CPU, so skip the busy ones
+		if (!cache->lock.try_lock())
+		{
+			continue;
+		}
+
+		count += cache_shrink_locked(cache);
+
+		cache->lock.unlock();
 	}
+
 	return count;
 }
+
+void memory::kmem::kmem_cache_stats(kmem_cache* cache, kmem_cache_statistics* st)
+{
+	*st = kmem_cache_statistics{ .obj_size = cache->obj_size, .slab_size = cache->slab_size };
+
+	lock_guard g{ cache->lock };
+
+	list_head* iter = nullptr;
+	list_for(iter, &cache->full)
+	{
+		st->slabs_full++;
+		st->objs_inuse += cache->obj_count;
+	}
+
+	list_for(iter, &cache->partial)
+	{
+		st->slabs_partial++;
+		st->objs_inuse += list_entry(iter, slab, slab_link)->inuse;
+	}
+
+	list_for(iter, &cache->free)
+	{
+		st->slabs_free++;
+	}
+
+	st->objs_total = (st->slabs_full + st->slabs_partial + st->slabs_free) * cache->obj_count;
+
+	list_for(iter, &cache->depot_full)
+	{
+		st->objs_cached += list_entry(iter, kmem_magazine, magazine_link)->rounds;
+	}
+
+	for (auto& cc: cache->cpu_caches)
+	{
+		kmem_magazine* mags[] = { cc.loaded, cc.previous };
+		for (auto mag: mags)
+		{
+			if (mag != nullptr)
+			{
+				st->objs_cached += mag->rounds;
+			}
+		}
+
+		st->alloc_hits += cc.alloc_hits;
+		st->alloc_misses += cc.alloc_misses;
+		st->free_hits += cc.free_hits;
+		st->free_misses += cc.free_misses;
+	}
+
+	// the slab layer counts objects sitting in magazines as allocated
+	st->objs_inuse -= std::min(st->objs_inuse, st->objs_cached);
+}
+
+void memory::kmem::kmem_cache_for_each(void (* fn)(kmem_cache* cache, void* arg), void* arg)
+{
+	lock_guard g{ cache_head_lock };
+
+	list_head* iter = nullptr;
+	list_for(iter, &cache_head)
+	{
+		fn(list_entry(iter, kmem_cache, cache_link), arg);
+	}
+}
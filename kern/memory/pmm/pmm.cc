@@ -1,15 +1,23 @@
 #include "memory/pmm.hpp"
+#include "memory/tlb.hpp"
+#include "memory/reclaim.hpp"
+#include "memory/compaction.hpp"
+#include "memory/zeroing.hpp"
 
 #include "arch/amd64/cpu/x86.h"
+#include "arch/amd64/cpu/string.hpp"
 
 #include "system/mmu.h"
 #include "system/pmm.h"
 
+#include "drivers/acpi/cpu.h"
+
 #include "debug/kdebug.h"
 
 #include "kbl/lock/lock_guard.hpp"
 
 #include <algorithm>
+#include <cstring>
 #include <utility>
 
 #include <gsl/util>
@@ -58,13 +66,251 @@ page* physical_memory_manager::allocate()
 
 page* memory::physical_memory_manager::allocate(size_t n)
 {
+	auto pg = allocate_no_reclaim(n);
+
+	// free_count only sees the provider, so the pages this CPU and the zeroed pool hold are given back first.
+	// otherwise memory looks lower than it is, and reclaim is asked for more than it needs to take
+	if (pg == nullptr && cpu.is_valid())
+	{
+		// single pages of the pool are freed through the per-CPU cache, so it's drained after the pool
+		drain_zeroed();
+		drain_per_cpu();
+
+		pg = allocate_no_reclaim(n);
+	}
+
+	// take memory back from caches before failing
+	if (pg == nullptr && cpu.is_valid())
+	{
+		auto free = free_count();
+		size_t target = std::max(n, free < RECLAIM_HIGH_WATERMARK ? RECLAIM_HIGH_WATERMARK - free : 0);
+
+		if (reclaim(target) > 0)
+		{
+			pg = allocate_no_reclaim(n);
+		}
+
+		// there are pages enough, but not in one piece
+		if (pg == nullptr && n > 1)
+		{
+			compact_kick();
+		}
+	}
+
+	return pg;
+}
+
+page* physical_memory_manager::allocate_no_reclaim(size_t n)
+{
+	// single pages are served by the per-cpu cache once cpu local storage is ready
+	if (n == 1 && cpu.is_valid())
+	{
+		return allocate_per_cpu();
+	}
+
 	lock_guard g{ lock_ };
 	return allocate_locked(n);
 }
 
+size_t physical_memory_manager::local_node()
+{
+	return cpu.is_valid() ? cpu->numa_node : 0;
+}
+
 page* physical_memory_manager::allocate_locked(size_t n)
 {
-	return provider_.allocate(n);
+	auto pg = provider_.allocate(n, local_node());
+
+	if (provider_.free_count() < RECLAIM_LOW_WATERMARK)
+	{
+		reclaim_kick();
+	}
+
+	return pg;
+}
+
+page* physical_memory_manager::allocate_zeroed()
+{
+	return allocate_zeroed(1);
+}
+
+page* physical_memory_manager::allocate_zeroed(size_t n)
+{
+	if (zeroed_pages::pooled(n))
+	{
+		lock_guard g{ zeroed_lock_ };
+
+		if (auto pg = zeroed_.pop(n);pg != nullptr)
+		{
+			zeroed_.stats().hits++;
+
+			if (zeroed_.below_target(n))
+			{
+				zeroing_kick();
+			}
+
+			return pg;
+		}
+
+		zeroed_.stats().misses++;
+		zeroing_kick();
+	}
+
+	auto pg = allocate(n);
+	if (pg != nullptr)
+	{
+		// the caller is about to touch it, so zero it through the cache
+		memset(reinterpret_cast<void*>(pmm::page_to_va(pg)), 0, n * PAGE_SIZE);
+	}
+
+	return pg;
+}
+
+error_code_with_result<page*> physical_memory_manager::allocate_zeroed(uintptr_t va,
+	uint64_t perm,
+	vmm::pde_ptr_t pgdir,
+	bool rewrite_if_exist)
+{
+	KDEBUG_ASSERT(pgdir != nullptr);
+	KDEBUG_ASSERT(va != 0);
+
+	const size_t n = (perm & PG_PS) ? LARGE_PAGE_PAGES : 1;
+
+	page* page = allocate_zeroed(n);
+	if (page == nullptr)
+	{
+		return -ERROR_MEMORY_ALLOC;
+	}
+
+	if (auto ret = insert_page(page, va, perm, pgdir, rewrite_if_exist);ret != ERROR_SUCCESS)
+	{
+		// it is still zero, keep it for the next caller
+		lock_guard g{ zeroed_lock_ };
+		zeroed_.push(page, n);
+
+		return ret;
+	}
+
+	return page;
+}
+
+bool physical_memory_manager::refill_zeroed(size_t budget)
+{
+	// large blocks are only set aside while there is plenty of memory left
+	constexpr size_t LARGE_RESERVE = zeroed_pages::LARGE_TARGET * LARGE_PAGE_PAGES * 4;
+
+	for (size_t done = 0; done < budget;)
+	{
+		// memory set aside here would only be reclaimed again
+		auto free_pages = free_count();
+		if (free_pages < RECLAIM_LOW_WATERMARK)
+		{
+			if (zeroing_block_ != nullptr)
+			{
+				free(zeroing_block_, LARGE_PAGE_PAGES);
+				zeroing_block_ = nullptr;
+			}
+
+			return false;
+		}
+
+		// a 2MB block is more than a pass may zero, so it's finished a budget at a time
+		if (zeroing_block_ != nullptr)
+		{
+			auto n = std::min<size_t>(budget - done, LARGE_PAGE_PAGES - zeroing_block_done_);
+			auto va = pmm::page_to_va(zeroing_block_) + zeroing_block_done_ * PAGE_SIZE;
+
+			arch::set_with(arch::string_method::STREAM, reinterpret_cast<void*>(va), 0, n * PAGE_SIZE);
+
+			zeroing_block_done_ += n;
+			done += n;
+
+			if (zeroing_block_done_ == LARGE_PAGE_PAGES)
+			{
+				lock_guard g{ zeroed_lock_ };
+				zeroed_.push(zeroing_block_, LARGE_PAGE_PAGES);
+				zeroed_.stats().zeroed_pages += LARGE_PAGE_PAGES;
+
+				zeroing_block_ = nullptr;
+			}
+
+			continue;
+		}
+
+		size_t n = 0;
+		{
+			lock_guard g{ zeroed_lock_ };
+
+			if (zeroed_.below_target(1))
+			{
+				n = 1;
+			}
+			else if (zeroed_.below_target(LARGE_PAGE_PAGES) && free_pages > LARGE_RESERVE)
+			{
+				n = LARGE_PAGE_PAGES;
+			}
+		}
+
+		if (n == 0)
+		{
+			return false;
+		}
+
+		auto pg = allocate_no_reclaim(n);
+		if (pg == nullptr)
+		{
+			return false;
+		}
+
+		if (n == LARGE_PAGE_PAGES)
+		{
+			zeroing_block_ = pg;
+			zeroing_block_done_ = 0;
+			continue;
+		}
+
+		// zeroed memory may wait a long time before it's used, don't let it evict the working set
+		arch::set_with(arch::string_method::STREAM, reinterpret_cast<void*>(pmm::page_to_va(pg)), 0, PAGE_SIZE);
+
+		{
+			lock_guard g{ zeroed_lock_ };
+			zeroed_.push(pg, 1);
+			zeroed_.stats().zeroed_pages++;
+		}
+
+		done++;
+	}
+
+	return true;
+}
+
+void physical_memory_manager::drain_zeroed()
+{
+	const size_t sizes[] = { 1, LARGE_PAGE_PAGES };
+	for (auto n: sizes)
+	{
+		for (;;)
+		{
+			page* pg = nullptr;
+			{
+				lock_guard g{ zeroed_lock_ };
+				pg = zeroed_.pop(n);
+			}
+
+			if (pg == nullptr)
+			{
+				break;
+			}
+
+			free(pg, n);
+		}
+	}
+}
+
+zeroed_pages::statistics physical_memory_manager::zeroed_statistics() const
+{
+	lock_guard g{ zeroed_lock_ };
+	return zeroed_.stats();
 }
 
 void physical_memory_manager::free(page* base)
@@ -74,16 +320,230 @@ void physical_memory_manager::free(page* base)
 
 void memory::physical_memory_manager::free(page* base, size_t n)
 {
+	if (n == 1 && cpu.is_valid())
+	{
+		return free_per_cpu(base);
+	}
+
 	lock_guard g{ lock_ };
 	return provider_.free(base, n);
 }
 
+page* physical_memory_manager::allocate_per_cpu()
+{
+	auto state = arch_interrupt_save();
+	auto _ = gsl::finally([&state]()
+	{
+	  arch_interrupt_restore(state);
+	});
+
+	auto& pcp = cpu->page_cache;
+
+	if (pcp.empty())
+	{
+		pcp.stats().alloc_misses++;
+
+		lock_guard g{ lock_ };
+		refill_locked(pcp);
+	}
+	else
+	{
+		pcp.stats().alloc_hits++;
+	}
+
+	return pcp.pop_hot();
+}
+
+void physical_memory_manager::free_per_cpu(page* pg)
+{
+	KDEBUG_ASSERT(!page_has_flag(pg, PHYSICAL_PAGE_FLAG_RESERVED));
+	KDEBUG_ASSERT(!page_has_flag(pg, PHYSICAL_PAGE_FLAG_PROPERTY));
+
+	pg->flags = 0;
+	pg->ref = 0;
+	page_clear_rmap(pg);
+
+	auto state = arch_interrupt_save();
+	auto _ = gsl::finally([&state]()
+	{
+	  arch_interrupt_restore(state);
+	});
+
+	auto& pcp = cpu->page_cache;
+
+	pcp.push_hot(pg);
+	pcp.stats().free_hits++;
+
+	if (pcp.above_high())
+	{
+		lock_guard g{ lock_ };
+		drain_locked(pcp, per_cpu_pages::BATCH);
+	}
+}
+
+void physical_memory_manager::refill_locked(per_cpu_pages& pcp)
+{
+	lock_.assert_held();
+
+	for (size_t i = 0; i < per_cpu_pages::BATCH; i++)
+	{
+		auto pg = provider_.allocate_single(local_node());
+		if (pg == nullptr)
+		{
+			break;
+		}
+
+		pcp.push_cold(pg);
+	}
+
+	if (provider_.free_count() < RECLAIM_LOW_WATERMARK)
+	{
+		reclaim_kick();
+	}
+
+	pcp.stats().refills++;
+}
+
+void physical_memory_manager::drain_locked(per_cpu_pages& pcp, size_t count)
+{
+	lock_.assert_held();
+
+	for (size_t i = 0; i < count; i++)
+	{
+		auto pg = pcp.pop_cold();
+		if (pg == nullptr)
+		{
+			break;
+		}
+
+		provider_.free_single(pg);
+	}
+
+	pcp.stats().drains++;
+}
+
+void physical_memory_manager::drain_per_cpu()
+{
+	if (!cpu.is_valid())
+	{
+		return;
+	}
+
+	auto state = arch_interrupt_save();
+	auto _ = gsl::finally([&state]()
+	{
+	  arch_interrupt_restore(state);
+	});
+
+	auto& pcp = cpu->page_cache;
+
+	lock_guard g{ lock_ };
+	drain_locked(pcp, pcp.count());
+}
+
+per_cpu_pages::statistics physical_memory_manager::per_cpu_statistics(cpu_num_type cpu_id) const
+{
+	KDEBUG_ASSERT(cpu_id < CPU_COUNT_LIMIT);
+	return cpus[cpu_id].page_cache.stats();
+}
+
 size_t memory::physical_memory_manager::free_count() const
 {
 	lock_guard g{ lock_ };
 	return provider_.free_count();
 }
 
+size_t physical_memory_manager::free_count(size_t node) const
+{
+	lock_guard g{ lock_ };
+	return provider_.free_count(node);
+}
+
+void physical_memory_manager::assign_node(uintptr_t pa, size_t size, size_t node)
+{
+	// only the memory described by the pages array is managed
+	uintptr_t start = PAGE_ROUNDUP(std::max(pa, pavailable_start()));
+	uintptr_t end = PAGE_ROUNDDOWN(std::min(pa + size, pavailable_start() + page_count * PAGE_SIZE));
+	if (start >= end)
+	{
+		return;
+	}
+
+	lock_guard g{ lock_ };
+	provider_.assign_node(pa_to_page(start), (end - start) / PAGE_SIZE, node);
+}
+
+void physical_memory_manager::set_node_fallback(size_t node, const size_t* nodes, size_t count)
+{
+	lock_guard g{ lock_ };
+	provider_.set_fallback(node, nodes, count);
+}
+
+page* physical_memory_manager::block_at(size_t order, size_t index) const
+{
+	return provider_.block_at(order, index);
+}
+
+bool physical_memory_manager::isolate_block(page* base, size_t order)
+{
+	lock_guard g{ lock_ };
+
+	for (page* p = base; p < base + (1ull << order);)
+	{
+		if (buddy_provider::is_free_head(p))
+		{
+			if (p->property >= order)
+			{
+				return false;
+			}
+
+			p += 1ull << p->property;
+		}
+		else if (p->rmap_owner != nullptr &&
+			page_ref_count(p) == 1 &&
+			!page_has_flag(p, PHYSICAL_PAGE_FLAG_RESERVED) &&
+			!page_has_flag(p, PHYSICAL_PAGE_FLAG_SLAB))
+		{
+			p++;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	provider_.isolate_free(base, order);
+	return true;
+}
+
+bool physical_memory_manager::release_block(page* base, size_t order)
+{
+	lock_guard g{ lock_ };
+
+	// pages whose owner unmapped them while they were being migrated are back in the provider
+	provider_.isolate_free(base, order);
+
+	const size_t size = 1ull << order;
+	if (std::all_of(base, base + size, [](const page& p)
+	{
+	  return page_has_flag(&p, PHYSICAL_PAGE_FLAG_ISOLATED);
+	}))
+	{
+		provider_.free(base, size);
+		return true;
+	}
+
+	for (page* p = base; p != base + size; p++)
+	{
+		if (page_has_flag(p, PHYSICAL_PAGE_FLAG_ISOLATED))
+		{
+			provider_.free(p, 1);
+		}
+	}
+
+	return false;
+}
+
 bool memory::physical_memory_manager::is_well_constructed() const
 {
 	return provider_.is_well_constructed();
@@ -141,12 +601,15 @@ error_code_with_result<page*> physical_memory_manager::allocate(uintptr_t va,
 	KDEBUG_ASSERT(pgdir != nullptr);
 	KDEBUG_ASSERT(va != 0);
 
-	page* page = memory::physical_memory_manager::instance()->allocate(); //alloc_page();
+	// PG_PS asks for a 2MB page
+	const size_t n = (perm & PG_PS) ? LARGE_PAGE_PAGES : 1;
+
+	page* page = memory::physical_memory_manager::instance()->allocate(n);
 	if (page != nullptr)
 	{
 		if (auto ret = insert_page(page, va, perm, pgdir, rewrite_if_exist);ret != ERROR_SUCCESS)
 		{
-			physical_memory_manager::instance()->free(page);
+			physical_memory_manager::instance()->free(page, n);
 
 			return ret;
 		}
@@ -160,66 +623,101 @@ error_code physical_memory_manager::insert_page(page* page,
 	vmm::pde_ptr_t pgdir,
 	bool allow_rewrite)
 {
-	auto pde = vmm::walk_pgdir(pgdir, va, true);
+	// a new entry can't be cached by any TLB, only a replaced one is invalidated, once the new one is in place
+	tlb_batch batch{ pgdir };
+	return insert_page(page, va, perm, pgdir, allow_rewrite, batch);
+}
+
+error_code physical_memory_manager::insert_page(page* page,
+	uintptr_t va,
+	uint64_t perm,
+	vmm::pde_ptr_t pgdir,
+	bool allow_rewrite,
+	tlb_batch& batch)
+{
+	// PG_PS in perm maps the LARGE_PAGE_PAGES pages starting from page as a 2MB page.
+	// the reference is counted on the first page only
+	const bool large = (perm & PG_PS) != 0;
+	KDEBUG_ASSERT(!large || (va % LARGE_PAGE_SIZE) == 0);
+
+	auto pde = large ? vmm::walk_pgdir_large(pgdir, va, true) : vmm::walk_pgdir(pgdir, va, true);
 	if (pde == nullptr)
 	{
 		return -ERROR_MEMORY_ALLOC;
 	}
 
-	++page->ref;
+	// a 2MB page and a page table can't replace each other in place
+	if ((*pde & PG_P) && large != ((*pde & PG_PS) != 0))
+	{
+		return -ERROR_REWRITE;
+	}
+
+	page_ref_inc(page);
 
 	if (*pde != 0)
 	{
 		if ((!allow_rewrite) && (pde_to_page(pde) != page))
 		{
+			page_ref_dec(page);
 			return -ERROR_REWRITE;
 		}
 
 		if ((*pde & PG_P) && pde_to_page(pde) == page)
 		{
-			--page->ref;
+			page_ref_dec(page);
+			batch.add_range(PAGE_ROUNDDOWN(va), PAGE_ROUNDDOWN(va) + (large ? LARGE_PAGE_SIZE : PAGE_SIZE));
 		}
 		else
 		{
-			remove_from_pgdir(pde, pgdir, va);
+			remove_from_pgdir(pde, va, batch);
 		}
 	}
 
-	*pde = page_to_pa(page) | PG_PS | PG_P | perm;
-	memory::physical_memory_manager::instance()->flush_tlb(pgdir, va);
+	*pde = page_to_pa(page) | PG_P | perm;
 
 	return ERROR_SUCCESS;
 }
 
 void physical_memory_manager::flush_tlb(vmm::pde_ptr_t pgdir, uintptr_t va)
 {
-	if (rcr3() == V2P((uintptr_t)pgdir))
-	{
-		invlpg((void*)va);
-	}
+	tlb_flush_page(pgdir, va);
 }
 
-void physical_memory_manager::remove_from_pgdir(vmm::pde_ptr_t pde, vmm::pde_ptr_t pgdir, uintptr_t va)
+void physical_memory_manager::remove_from_pgdir(vmm::pde_ptr_t pde, uintptr_t va, tlb_batch& batch)
 {
 	if ((*pde) & PG_P)
 	{
+		bool large = (*pde) & PG_PS;
 		auto page = pmm::pde_to_page(pde);
-		if ((--page->ref) == 0)
+
+		*pde = 0;
+
+		if (large)
 		{
-			physical_memory_manager::instance()->free(page);
+			va = LARGE_PAGE_ROUNDDOWN(va);
 		}
-		*pde = 0;
+		batch.add_range(va, va + (large ? LARGE_PAGE_SIZE : PAGE_SIZE));
 
-		memory::physical_memory_manager::instance()->flush_tlb(pgdir, va);
+		// other CPUs may still reach the page until the batch is flushed
+		if (page_ref_dec(page) == 0)
+		{
+			batch.defer_free(page, large ? LARGE_PAGE_PAGES : 1);
+		}
 	}
 }
 
 void physical_memory_manager::remove_page(uintptr_t va, vmm::pde_ptr_t pgdir)
+{
+	tlb_batch batch{ pgdir };
+	remove_page(va, pgdir, batch);
+}
+
+void physical_memory_manager::remove_page(uintptr_t va, vmm::pde_ptr_t pgdir, tlb_batch& batch)
 {
 	auto pde = vmm::walk_pgdir(pgdir, va, false);
 	if (pde != nullptr)
 	{
-		remove_from_pgdir(pde, pgdir, va);
+		remove_from_pgdir(pde, va, batch);
 	}
 }
 
@@ -33,6 +33,7 @@
 #include "system/vmm.h"
 #include "system/segmentation.hpp"
 
+#include "drivers/acpi/acpi.h"
 #include "drivers/apic/traps.h"
 #include "drivers/console/console.h"
 #include "debug/kdebug.h"
@@ -76,7 +77,7 @@ The memory layout for kernel:
 | memory        |
 |               |
 -------------------------- pavailable_start()
-(align to 4K)
+(align to 2M)
 --------------------------
 |               |
 | pages of pmm  |
@@ -86,7 +87,7 @@ The memory layout for kernel:
 |               |
 -------------------------- end+4MB
 | Two           |
-| physical      |
+| large         |
 | pages for     |
 | multiboot     |
 | information   |
@@ -104,19 +105,23 @@ static inline void init_physical_mem()
 	span<multiboot_mmap_entry> entries{ memtag->entries,
 	                                    (memtag->size - sizeof(multiboot_tag_mmap)) / memtag->entry_size };
 
-	uintptr_t max_pa = entries.begin()->addr;
+	uintptr_t max_pa = 0;
 
+	// only available memory is managed, so high reserved regions don't inflate the pages array
 	for (const auto& entry:entries)
 	{
-		max_pa = max((uintptr_t)(entry.addr + entry.len), max_pa);
+		if (entry.type == MULTIBOOT_MEMORY_AVAILABLE)
+		{
+			max_pa = max((uintptr_t)(entry.addr + entry.len), max_pa);
+		}
 	}
 
 	page_count = max_pa / PAGE_SIZE;
 
 	// FIXME: We may not need to do this ?
-	// The page management structure is placed a page after kernel
+	// The page management structure is placed two large pages after kernel
 	// So as to protect the multiboot info
-	pages = (page*)roundup((uintptr_t)(end + PAGE_SIZE * 2), PAGE_SIZE);
+	pages = (page*)roundup((uintptr_t)(end + LARGE_PAGE_SIZE * 2), LARGE_PAGE_SIZE);
 
 	for (size_t i = 0; i < page_count; i++)
 	{
@@ -135,9 +140,17 @@ static inline void init_physical_mem()
 
 		if (entry.type == MULTIBOOT_MEMORY_AVAILABLE)
 		{
-			physical_memory_manager::instance()->setup_for_base(pmm::pa_to_page(max((uintptr_t)entry.addr,
-				pmm::pavailable_start())),
-				PAGE_ROUNDDOWN(entry.len) / PAGE_SIZE);
+			// zones start at large page boundaries so that buddy blocks are physically aligned
+			uintptr_t start = LARGE_PAGE_ROUNDUP(max((uintptr_t)entry.addr, pmm::pavailable_start()));
+			uintptr_t stop = PAGE_ROUNDDOWN(entry.addr + entry.len);
+
+			if (stop <= start)
+			{
+				continue;
+			}
+
+			physical_memory_manager::instance()->setup_for_base(pmm::pa_to_page(start),
+				(stop - start) / PAGE_SIZE);
 		}
 	}
 
@@ -175,3 +188,33 @@ void pmm::init_pmm()
 
 }
 
+void pmm::init_numa()
+{
+	auto pmm = physical_memory_manager::instance();
+
+	acpi::numa_memory_range* ranges[acpi::NUMA_MEMORY_RANGE_COUNT_LIMIT] = {};
+	size_t range_count = acpi::get_numa_memory_ranges(acpi::NUMA_MEMORY_RANGE_COUNT_LIMIT, ranges);
+
+	for (size_t i = 0; i < range_count; i++)
+	{
+		pmm->assign_node(ranges[i]->base, ranges[i]->size, ranges[i]->node);
+	}
+
+	// each node falls back to the others from the nearest
+	const size_t node_count = acpi::get_numa_node_count();
+	for (size_t node = 0; node < node_count; node++)
+	{
+		size_t order[NUMA_NODE_COUNT_LIMIT] = {};
+		for (size_t i = 0; i < node_count; i++)
+		{
+			order[i] = i;
+		}
+
+		std::stable_sort(order, order + node_count, [node](size_t a, size_t b)
+		{
+		  return acpi::get_numa_distance(node, a) < acpi::get_numa_distance(node, b);
+		});
+
+		pmm->set_node_fallback(node, order, node_count);
+	}
+}
@@ -0,0 +1,129 @@
+// Copyright (c) 2021 SmartPolarBear
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "memory/reclaim.hpp"
+#include "memory/pmm.hpp"
+
+#include "system/kmem.hpp"
+
+#include "kbl/lock/spinlock.h"
+#include "kbl/lock/lock_guard.hpp"
+
+using namespace memory;
+using namespace lock;
+
+static list_head shrinker_head{ &shrinker_head, &shrinker_head };
+static spinlock shrinker_lock{ "shrinker" };
+
+// set when free memory falls below the low watermark, cleared by the reclaim that answers it
+static bool reclaim_due{ false };
+
+// one reclaim at a time, which also keeps a shrinker that allocates from recursing
+static bool reclaiming{ false };
+
+void memory::register_shrinker(shrinker* s)
+{
+	lock_guard g{ shrinker_lock };
+	kbl::list_add_tail(&s->link, &shrinker_head);
+}
+
+void memory::unregister_shrinker(shrinker* s)
+{
+	lock_guard g{ shrinker_lock };
+	kbl::list_remove(&s->link);
+}
+
+size_t memory::reclaim(size_t target)
+{
+	if (__atomic_exchange_n(&reclaiming, true, __ATOMIC_ACQUIRE))
+	{
+		return 0;
+	}
+
+	auto pmm = physical_memory_manager::instance();
+
+	const size_t start = pmm->free_count();
+	auto freed = [pmm, start]()
+	{
+	  auto now = pmm->free_count();
+	  return now > start ? now - start : 0;
+	};
+
+	// cheapest first: these pages are only cached, nobody loses anything
+	pmm->drain_zeroed();
+	pmm->drain_per_cpu();
+
+	if (freed() < target)
+	{
+		kmem::kmem_cache_reap();
+	}
+
+	if (freed() < target)
+	{
+		lock_guard g{ shrinker_lock };
+
+		list_head* iter = nullptr;
+		list_for(iter, &shrinker_head)
+		{
+			auto s = list_entry(iter, shrinker, link);
+
+			auto done = freed();
+			if (done >= target)
+			{
+				break;
+			}
+
+			s->scan(s, target - done);
+		}
+	}
+
+	// pages freed by the steps above may sit in the per-CPU cache again
+	pmm->drain_per_cpu();
+
+	auto ret = freed();
+
+	__atomic_store_n(&reclaim_due, false, __ATOMIC_RELAXED);
+	__atomic_store_n(&reclaiming, false, __ATOMIC_RELEASE);
+
+	return ret;
+}
+
+void memory::reclaim_kick()
+{
+	__atomic_store_n(&reclaim_due, true, __ATOMIC_RELAXED);
+}
+
+void memory::reclaim_if_needed()
+{
+	if (!__atomic_load_n(&reclaim_due, __ATOMIC_RELAXED))
+	{
+		return;
+	}
+
+	auto free = physical_memory_manager::instance()->free_count();
+	if (free < RECLAIM_HIGH_WATERMARK)
+	{
+		reclaim(RECLAIM_HIGH_WATERMARK - free);
+	}
+	else
+	{
+		__atomic_store_n(&reclaim_due, false, __ATOMIC_RELAXED);
+	}
+}
@@ -0,0 +1,65 @@
+#include "memory/zeroing.hpp"
+#include "memory/pmm.hpp"
+
+#include "debug/kdebug.h"
+
+#include "task/thread/thread.hpp"
+#include "task/scheduler/scheduler.hpp"
+
+#include "kbl/lock/lock_guard.hpp"
+#include "kbl/lock/semaphore.hpp"
+
+using namespace memory;
+using namespace kbl;
+
+using lock::lock_guard;
+
+static semaphore zeroing_sem{};
+
+// set when the pool drops below its target, the idle loop then wakes the thread.
+// the allocations taking from the pool may hold any lock, so they don't signal the semaphore themselves
+static bool zeroing_due{ true };
+
+[[noreturn]] static error_code zeroing_routine([[maybe_unused]] void* arg)
+{
+	for (;;)
+	{
+		[[maybe_unused]] auto ret = zeroing_sem.wait();
+
+		// the kernel isn't preempted, so the CPU is given up after each pass
+		while (physical_memory_manager::instance()->refill_zeroed(ZEROING_BATCH_PAGES))
+		{
+			task::scheduler::current::reschedule();
+		}
+	}
+}
+
+void memory::zeroing_kick()
+{
+	__atomic_store_n(&zeroing_due, true, __ATOMIC_RELAXED);
+}
+
+void memory::zeroing_wake_if_needed()
+{
+	if (__atomic_exchange_n(&zeroing_due, false, __ATOMIC_ACQ_REL))
+	{
+		zeroing_sem.signal();
+	}
+}
+
+void memory::zeroing_init()
+{
+	auto ret = task::thread::create(nullptr, "zeroing", zeroing_routine, nullptr);
+	if (has_error(ret))
+	{
+		KDEBUG_GERNERALPANIC_CODE(get_error_code(ret));
+	}
+
+	auto t = get_result(ret);
+
+	// zeroing ahead of time only pays off if it doesn't take the CPU from anything else
+	t->get_scheduler_state()->set_background(true);
+
+	lock_guard g{ task::global_thread_lock };
+	task::scheduler::current::unblock(t);
+}
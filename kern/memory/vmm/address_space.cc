@@ -19,14 +19,22 @@
 // SOFTWARE.
 
 #include "memory/address_space.hpp"
+#include "arch/amd64/cpu/string.hpp"
 #include "memory/pmm.hpp"
+#include "memory/tlb.hpp"
+#include "memory/teardown.hpp"
 
 #include "system/memlayout.h"
 #include "system/mmu.h"
+#include "system/pmm.h"
 
+#include <algorithm>
+#include <cstring>
 #include <utility>
 
 #include "kbl/checker/allocate_checker.hpp"
+#include "kbl/atomic/atomic_ref.hpp"
+#include "kbl/data/pod_list.h"
 
 using namespace memory;
 using namespace vmm;
@@ -34,6 +42,11 @@ using namespace vmm;
 using namespace kbl;
 using namespace lock;
 
+// address spaces that have a page table. A reverse mapping may outlive its address space,
+// so it is looked up here before being followed, and the lock keeps the address space alive meanwhile
+static list_head live_spaces{ &live_spaces, &live_spaces };
+static spinlock live_lock{ "address_space_live" };
+
 address_space_segment::address_space_segment(uintptr_t vm_start, uintptr_t vm_end, uint64_t vm_flags)
 	: start_(vm_start), end_(vm_end), flags_(vm_flags)
 {
@@ -43,7 +56,8 @@ address_space_segment::address_space_segment(uintptr_t vm_start, uintptr_t vm_en
 address_space_segment::address_space_segment(address_space_segment&& another)
 	: start_(std::exchange(another.start_, 0)),
 	  end_(std::exchange(another.end_, 0)),
-	  flags_(std::exchange(another.flags_, 0))
+	  flags_(std::exchange(another.flags_, 0)),
+	  backing_(std::exchange(another.backing_, file_backing{ nullptr, 0, 0 }))
 {
 	KDEBUG_ASSERT(start_ < end_);
 }
@@ -77,6 +91,38 @@ error_code address_space_segment::resize(uintptr_t start, uintptr_t end)
 	return ERROR_SUCCESS;
 }
 
+void address_space_segment::set_backing(const uint8_t* image, uintptr_t file_start, size_t size)
+{
+	lock_guard g{ lock_ };
+
+	backing_ = file_backing{ image, file_start, size };
+}
+
+void address_space_segment::fill(uintptr_t va, uint8_t* dst, size_t len) const
+{
+	// only [copy_start, copy_end) comes from the image
+	uintptr_t copy_start = va + len, copy_end = va + len;
+	if (backing_.image != nullptr)
+	{
+		copy_start = std::clamp(backing_.start, va, va + len);
+		copy_end = std::clamp(backing_.start + backing_.size, copy_start, va + len);
+	}
+
+	arch::fast_memset(dst, 0, copy_start - va);
+	if (copy_start < copy_end)
+	{
+		arch::fast_memcpy(dst + (copy_start - va), backing_.image + (copy_start - backing_.start), copy_end - copy_start);
+	}
+	arch::fast_memset(dst + (copy_end - va), 0, va + len - copy_end);
+}
+
+bool address_space_segment::backed(uintptr_t va, size_t len) const
+{
+	return backing_.image != nullptr &&
+		backing_.start < va + len &&
+		va < backing_.start + backing_.size;
+}
+
 address_space::address_space()
 {
 }
@@ -84,18 +130,40 @@ address_space::address_space()
 address_space::address_space(address_space&& another)
 	: uheap_begin_(std::exchange(another.uheap_begin_, 0)),
 	  uheap_end_(std::exchange(another.uheap_end_, 0)),
-	  pgdir_(std::exchange(another.pgdir_, nullptr))
+	  pgdir_(std::exchange(another.pgdir_, nullptr)),
+	  segments(std::move(another.segments)),
+	  segment_tree_(std::move(another.segment_tree_))
 {
-	for (auto& seg:another.segments)
+	another.search_cache_ = nullptr;
+
+	for (auto& seg:segments)
 	{
-		segments.push_back(seg);
+		seg.parent_ = this;
 	}
 
-	another.segments.clear();
+	lock_guard g{ live_lock };
+	if (another.live_link_.next != nullptr)
+	{
+		kbl::list_replace(&another.live_link_, &live_link_);
+		another.live_link_ = list_head{ nullptr, nullptr };
+	}
 }
 
 address_space::~address_space()
 {
+	{
+		lock_guard g{ live_lock };
+		if (live_link_.next != nullptr)
+		{
+			kbl::list_remove(&live_link_);
+		}
+	}
+
+	// compaction can't reach the page table any longer, so the pages can be dropped behind our back
+	if (pgdir_ != nullptr)
+	{
+		memory::teardown_defer(std::exchange(pgdir_, nullptr));
+	}
 }
 
 error_code_with_result<address_space_segment*> address_space::map(uintptr_t addr, size_t len, uint64_t flags)
@@ -112,8 +180,15 @@ error_code_with_result<address_space_segment*> address_space::map(uintptr_t addr
 
 	lock_guard g{ lock_ };
 
+	return map_locked(start, end, flags);
+}
+
+error_code_with_result<address_space_segment*> address_space::map_locked(uintptr_t start,
+	uintptr_t end,
+	uint64_t flags)
+{
 	address_space_segment* vma = nullptr;
-	if ((vma = find_vma_locked(start)) != nullptr && end > vma->start())
+	if (segment_tree_.first_overlap(start, end) != nullptr)
 	{
 		// the vma exists
 		return -ERROR_ALREADY_EXIST;
@@ -139,6 +214,143 @@ error_code_with_result<address_space_segment*> address_space::map(uintptr_t addr
 	return vma;
 }
 
+error_code_with_result<address_space_segment*> address_space::map_anywhere(uintptr_t hint,
+	size_t len,
+	size_t align,
+	uint64_t flags)
+{
+	KDEBUG_ASSERT(align % PAGE_SIZE == 0);
+
+	if (len == 0 || len % align != 0 || len > USER_MMAP_END - USER_MMAP_BASE)
+	{
+		return -ERROR_INVALID;
+	}
+
+	if (hint < USER_MMAP_BASE || hint >= USER_MMAP_END)
+	{
+		hint = USER_MMAP_BASE;
+	}
+
+	lock_guard g{ lock_ };
+
+	uintptr_t start = roundup(hint, align);
+	bool wrapped = false;
+	for (;;)
+	{
+		// back where the search began without finding room
+		if (wrapped && start >= hint)
+		{
+			return -ERROR_MEMORY_ALLOC;
+		}
+
+		if (start > USER_MMAP_END - len)
+		{
+			if (wrapped)
+			{
+				return -ERROR_MEMORY_ALLOC;
+			}
+
+			start = roundup(USER_MMAP_BASE, align);
+			wrapped = true;
+			continue;
+		}
+
+		auto overlap = segment_tree_.first_overlap(start, start + len);
+		if (overlap == nullptr)
+		{
+			break;
+		}
+
+		start = roundup(overlap->end_, align);
+	}
+
+	return map_locked(start, start + len, flags);
+}
+
+error_code address_space::populate(uintptr_t start, uintptr_t end)
+{
+	start = PAGE_ROUNDDOWN(start);
+	end = PAGE_ROUNDUP(end);
+
+	if (!VALID_USER_REGION(start, end))
+	{
+		return -ERROR_INVALID;
+	}
+
+	auto pmm = physical_memory_manager::instance();
+
+	lock_guard g{ lock_ };
+
+	for (uintptr_t va = start; va < end;)
+	{
+		auto vma = find_vma_locked(va);
+		if (vma == nullptr || vma->start_ > va)
+		{
+			return -ERROR_VMA_NOT_FOUND;
+		}
+
+		// already faulted in
+		auto pte = vmm::walk_pgdir(pgdir_, va, false);
+		if (pte != nullptr && ((*pte) & PG_P))
+		{
+			va = ((*pte) & PG_PS) ? LARGE_PAGE_ROUNDDOWN(va) + LARGE_PAGE_SIZE : va + PAGE_SIZE;
+			continue;
+		}
+
+		size_t perm = PG_U;
+		if (vma->flags_ & VM_WRITE)
+		{
+			perm |= PG_W;
+		}
+
+		// the same choice as the fault handler: only whole 2MB pages inside the segment,
+		// where no page table of 4K pages is already there
+		auto pde = vmm::walk_pgdir_large(pgdir_, va, false);
+		bool pde_empty = pde == nullptr || !((*pde) & PG_P);
+
+		if ((vma->flags_ & VM_LARGE_PAGE) && pde_empty && (va % LARGE_PAGE_SIZE) == 0 && va + LARGE_PAGE_SIZE <= vma->end_)
+		{
+			if (auto pg = pmm->allocate_zeroed(LARGE_PAGE_PAGES);pg != nullptr)
+			{
+				if (pmm->insert_page(pg, va, perm | PG_PS, pgdir_, false) == ERROR_SUCCESS)
+				{
+					va += LARGE_PAGE_SIZE;
+					continue;
+				}
+
+				pmm->free(pg, LARGE_PAGE_PAGES);
+			}
+
+			// fall back to 4K pages when no 2MB block is free
+		}
+
+		auto pg = pmm->allocate_zeroed();
+		if (pg == nullptr)
+		{
+			return -ERROR_MEMORY_ALLOC;
+		}
+
+		if (auto ret = pmm->insert_page(pg, va, perm, pgdir_, false);ret != ERROR_SUCCESS)
+		{
+			pmm->free(pg);
+
+			// a fault from another thread got there first
+			if (ret != -ERROR_REWRITE)
+			{
+				return ret;
+			}
+		}
+		else
+		{
+			page_set_rmap(pg, this, va);
+		}
+
+		va += PAGE_SIZE;
+	}
+
+	return ERROR_SUCCESS;
+}
+
 error_code_with_result<address_space_segment*> address_space::mm_fpage_map(address_space* to,
 	const task::ipc::fpage& send,
 	const task::ipc::fpage& receive)
@@ -162,16 +374,26 @@ error_code_with_result<address_space_segment*> address_space::mm_fpage_map(addre
 	lock_guard g1{ lock_ };
 	lock_guard g2{ to->lock_ };
 
-	for (auto start = send.get_base_address(); start + PAGE_SIZE <= send.get_base_address() + send.get_size();
-	     start += PAGE_SIZE)
+	for (auto start = send.get_base_address(); start + PAGE_SIZE <= send.get_base_address() + send.get_size();)
 	{
 		auto pde = vmm::walk_pgdir(pgdir_, start, false);
+		const bool large = pde != nullptr && (*pde & PG_PS);
 
-		auto to_pde = vmm::walk_pgdir(to->pgdir_, start - send.get_base_address() + receive.get_base_address(), true);
+		if (pde != nullptr && (*pde & PG_P))
+		{
+			auto to_va = start - send.get_base_address() + receive.get_base_address();
+			auto to_pde = large ? vmm::walk_pgdir_large(to->pgdir_, to_va, true) : vmm::walk_pgdir(to->pgdir_, to_va, true);
+			if (to_pde == nullptr)
+			{
+				return -ERROR_MEMORY_ALLOC;
+			}
 
-		*to_pde = *pde;
+			// a new entry can't be cached by any TLB, so nothing is invalidated
+			*to_pde = *pde;
+			page_ref_inc(pmm::pde_to_page(pde));
+		}
 
-		memory::physical_memory_manager::instance()->flush_tlb(to->pgdir_, start);
+		start += large ? LARGE_PAGE_SIZE : PAGE_SIZE;
 	}
 
 	return ERROR_SUCCESS;
@@ -200,24 +422,42 @@ error_code_with_result<address_space_segment*> address_space::fpage_grant(addres
 		return get_error_code(ret);
 	}
 
+	// declared before the guards, so that the other CPUs are waited for after the locks are released, as in unmap
+	memory::tlb_batch batch{ pgdir() };
+
 	// do real map and unmap
 	lock_guard g1{ lock_ };
 	lock_guard g2{ to->lock_ };
 
-	for (auto start = send.get_base_address(); start + PAGE_SIZE <= send.get_base_address() + send.get_size();
-	     start += PAGE_SIZE)
+	for (auto start = send.get_base_address(); start + PAGE_SIZE <= send.get_base_address() + send.get_size();)
 	{
 		auto pde = vmm::walk_pgdir(pgdir_, start, false);
+		const bool large = pde != nullptr && (*pde & PG_PS);
 
-		auto to_pde = vmm::walk_pgdir(to->pgdir_, start - send.get_base_address() + receive.get_base_address(), true);
+		if (pde != nullptr && (*pde & PG_P))
+		{
+			auto to_va = start - send.get_base_address() + receive.get_base_address();
+			auto to_pde = large ? vmm::walk_pgdir_large(to->pgdir_, to_va, true) : vmm::walk_pgdir(to->pgdir_, to_va, true);
+			if (to_pde == nullptr)
+			{
+				return -ERROR_MEMORY_ALLOC;
+			}
 
-		*to_pde = *pde;
+			*to_pde = *pde;
 
-		*pde = 0;
+			*pde = 0;
 
-		memory::physical_memory_manager::instance()->flush_tlb(pgdir_, start);
+			// the page changes hands without another reference
+			if (!large)
+			{
+				page_set_rmap(pmm::pde_to_page(to_pde), to, to_va);
+			}
 
-		memory::physical_memory_manager::instance()->flush_tlb(to->pgdir_, start);
+			// only the source entry may be cached, the one in to is new
+			batch.add_range(start, start + (large ? LARGE_PAGE_SIZE : PAGE_SIZE));
+		}
+
+		start += large ? LARGE_PAGE_SIZE : PAGE_SIZE;
 	}
 
 	return ERROR_SUCCESS;
@@ -233,83 +473,90 @@ error_code address_space::unmap(uintptr_t addr, size_t len)
 		return -ERROR_INVALID;
 	}
 
+	// declared before the guard, so that the other CPUs are waited for after the lock is released
+	memory::tlb_batch batch{ pgdir() };
+
 	lock_guard g{ lock_ };
 
-	auto vma = find_vma_locked(start);
-	if (vma == nullptr || end < vma->start_)
-	{
-		return ERROR_SUCCESS; // no need to remove
-	}
+	return unmap_locked(start, end, batch);
+}
 
-	if (vma->start_ < start && end < vma->end_)
+error_code address_space::unmap_locked(uintptr_t start, uintptr_t end, memory::tlb_batch& batch) TA_ASSERT(lock_)
+{
+	// a 2MB page is unmapped as a whole, so the range may only end inside a segment backed by them at a 2MB boundary.
+	// checked for every segment before any is changed
+	for (auto vma = segment_tree_.first_overlap(start, end);
+	     vma != nullptr && vma->start_ < end;
+	     vma = vma->link_.next_->parent_)
 	{
-		//           range to remove
-		//    [       [***********]       ]
-		//     |------|      ^    |-------|
-		//	  Create new     |     Shrink old
-		//                   |
-		//                 unmap
-		kbl::allocate_checker ck{};
-		auto new_vma = new(&ck) address_space_segment(vma->start_, start, vma->flags_);
-
-		KDEBUG_ASSERT(uintptr_t(& new_vma) != uintptr_t (&ck));
-
-		if (!ck.check())
+		if (!(vma->flags_ & VM_LARGE_PAGE))
 		{
-			return -ERROR_MEMORY_ALLOC;
+			continue;
 		}
 
-		auto ret = vma->resize(end, vma->end_);
-		if (ret != ERROR_SUCCESS)
+		if ((start > vma->start_ && (start % LARGE_PAGE_SIZE) != 0) ||
+			(end < vma->end_ && (end % LARGE_PAGE_SIZE) != 0))
 		{
-			return ret;
+			return -ERROR_INVALID;
 		}
+	}
 
-		insert_vma_locked(new_vma);
+	address_space_segment* vma = nullptr;
+	while ((vma = segment_tree_.first_overlap(start, end)) != nullptr)
+	{
+		if (vma->start_ < start && end < vma->end_)
+		{
+			//           range to remove
+			//    [       [***********]       ]
+			//     |------|      ^    |-------|
+			//	  Create new     |     Shrink old
+			//                   |
+			//                 unmap
+			kbl::allocate_checker ck{};
+			auto new_vma = new(&ck) address_space_segment(vma->start_, start, vma->flags_);
+
+			KDEBUG_ASSERT(uintptr_t(& new_vma) != uintptr_t (&ck));
+
+			if (!ck.check())
+			{
+				return -ERROR_MEMORY_ALLOC;
+			}
 
-		unmap_range(pgdir_, start, end);
+			new_vma->backing_ = vma->backing_;
 
-		return ERROR_SUCCESS;
-	}
+			remove_vma_locked(vma);
 
-	segment_list_type freelist{};
+			auto ret = vma->resize(end, vma->end_);
+			KDEBUG_ASSERT(ret == ERROR_SUCCESS);
 
-	for (segment_list_type::iterator_type iter{ &vma->link_ }; iter != segments.end(); iter++)
-	{
-		if (iter->start_ >= end)
-		{
-			break;
-		}
+			insert_vma_locked(vma);
+			insert_vma_locked(new_vma);
 
-		freelist.push_back(&(*iter));
-	}
+			unmap_range(pgdir_, start, end, batch);
 
-	for (auto& entry:freelist)
-	{
-		segments.remove(entry);
+			return ret;
+		}
 
-		uintptr_t unmap_start = entry.start(), unmap_end = entry.end();
+		uintptr_t unmap_start = std::max(start, vma->start_), unmap_end = std::min(end, vma->end_);
 
-		if (entry.start() < start)
+		remove_vma_locked(vma);
+
+		if (vma->start_ < start)
+		{
+			vma->resize(vma->start_, start);
+			insert_vma_locked(vma);
+		}
+		else if (end < vma->end_)
 		{
-			unmap_start = start;
-			entry.resize(entry.start_, start);
-			insert_vma_locked(&entry);
+			vma->resize(end, vma->end_);
+			insert_vma_locked(vma);
 		}
 		else
 		{
-			if (end < entry.end())
-			{
-				unmap_end = end;
-				entry.resize(end, entry.end());
-				insert_vma_locked(&entry);
-			}
-			else
-			{
-				delete &entry;
-			}
+			delete vma;
 		}
-		unmap_range(pgdir_, unmap_start, unmap_end);
+
+		unmap_range(pgdir_, unmap_start, unmap_end, batch);
 	}
 
 	return ERROR_SUCCESS;
@@ -317,8 +564,6 @@ error_code address_space::unmap(uintptr_t addr, size_t len)
 
 error_code_with_result<address_space*> address_space::duplicate()
 {
-	lock_guard g{ lock_ };
-
 	allocate_checker ck{};
 	auto to = new(&ck) address_space{};
 	KDEBUG_ASSERT(uintptr_t(& ck)!=uintptr_t(to));
@@ -328,19 +573,64 @@ error_code_with_result<address_space*> address_space::duplicate()
 		return -ERROR_MEMORY_ALLOC;
 	}
 
-	for (auto& seg:segments)
+	// initializing and deleting to take live_lock, which compaction holds while taking lock_, so neither is locked
+	if (auto ret = to->initialize();ret != ERROR_SUCCESS)
 	{
-		auto new_seg = new(&ck) address_space_segment(seg.start_, seg.end_, seg.flags_);
-		KDEBUG_ASSERT(uintptr_t(& ck)!=uintptr_t(new_seg));
+		delete to;
+		return ret;
+	}
 
-		if (!ck.check())
+	error_code ret = ERROR_SUCCESS;
+	{
+		// declared before the guards, so the write access the parent loses is invalidated once they are released,
+		// as in unmap
+		memory::tlb_batch batch{ pgdir() };
+
+		lock_guard g{ lock_ };
+		lock_guard g2{ to->lock_ };
+
+		to->uheap_ = uheap_;
+		to->uheap_begin_ = uheap_begin_;
+		to->uheap_end_ = uheap_end_;
+
+		for (auto& seg:segments)
 		{
-			return -ERROR_MEMORY_ALLOC;
+			auto new_seg = new(&ck) address_space_segment(seg.start_, seg.end_, seg.flags_);
+			KDEBUG_ASSERT(uintptr_t(& ck)!=uintptr_t(new_seg));
+
+			if (!ck.check())
+			{
+				ret = -ERROR_MEMORY_ALLOC;
+				break;
+			}
+
+			new_seg->backing_ = seg.backing_;
+
+			to->insert_vma_locked(new_seg);
+
+			if (ret = copy_range(pgdir_, to->pgdir_, seg.start_, seg.end_, batch);ret != ERROR_SUCCESS)
+			{
+				break;
+			}
 		}
 
-		to->insert_vma_locked(new_seg);
+		// the pages shared so far are released with the page table of to.
+		// the parent keeps them copy-on-write, and its next write to one upgrades it in place
+		if (ret != ERROR_SUCCESS)
+		{
+			while (!to->segments.empty())
+			{
+				auto seg = to->segments.front_ptr();
+				to->remove_vma_locked(seg);
+				delete seg;
+			}
+		}
+	}
 
-		copy_range(pgdir_, to->pgdir_, seg.start_, seg.end_);
+	if (ret != ERROR_SUCCESS)
+	{
+		delete to;
+		return ret;
 	}
 
 	return to;
@@ -348,8 +638,10 @@ error_code_with_result<address_space*> address_space::duplicate()
 
 error_code address_space::resize(uintptr_t addr, size_t len)
 {
+	memory::tlb_batch batch{ pgdir() };
+
 	lock_guard g{ lock_ };
-	return resize_locked(addr, len);
+	return resize_locked(addr, len, batch);
 
 }
 
@@ -371,12 +663,7 @@ address_space_segment* address_space::intersect_vma(uintptr_t start, uintptr_t e
 {
 	lock_guard g{ lock_ };
 
-	auto vma = find_vma_locked(start);
-	if (vma != nullptr && end <= vma->start_)
-	{
-		return nullptr;
-	}
-	return vma;
+	return segment_tree_.first_overlap(start, end);
 }
 
 void address_space::assert_segment_overlap(address_space_segment* prev, address_space_segment* next)
@@ -401,39 +688,137 @@ error_code address_space::initialize()
 
 	pgdir_ = pgdir;
 
+	lock_guard g2{ live_lock };
+	kbl::list_add(&live_link_, &live_spaces);
+
 	return ERROR_SUCCESS;
 }
 
-void address_space::insert_vma_locked(address_space_segment* vma)
+bool address_space::is_live_locked(address_space* as)
 {
-	if (segments.empty())
+	list_head* iter = nullptr;
+	list_for(iter, &live_spaces)
 	{
-		segments.push_back(vma);
-		return;
+		if (iter == &as->live_link_)
+		{
+			return true;
+		}
 	}
 
-	address_space_segment* prev = nullptr;
-	segment_list_type::iterator_type prev_iter;
-	for (auto iter = segments.begin(); iter != segments.end(); iter++)
+	return false;
+}
+
+error_code address_space::migrate_page(page* from, page* to)
+{
+	auto owner = from->rmap_owner;
+	auto va = from->rmap_va;
+
+	pde_t entry = 0, protected_entry = 0;
+	vmm::pde_ptr_t pgdir = nullptr;
+
+	// take write access away, so that the copy below can't miss a write
 	{
-		if (iter->start_ > vma->start_)
+		lock_guard g{ live_lock };
+		if (owner == nullptr || !is_live_locked(owner))
 		{
-			break;
+			return -ERROR_INVALID;
+		}
+
+		lock_guard g2{ owner->lock_ };
+
+		auto pte = vmm::walk_pgdir(owner->pgdir_, va, false);
+		if (pte == nullptr || !((*pte) & PG_P) || ((*pte) & PG_PS) ||
+			pmm::pde_to_page(pte) != from || page_ref_count(from) != 1)
+		{
+			return -ERROR_INVALID;
+		}
+
+		// a write fault upgrades a copy-on-write page that isn't shared in place, which fails the exchange below
+		entry = *pte;
+		protected_entry = (entry & ~PG_W) | PG_COW;
+		if (!integral_atomic_ref<pde_t>{ *pte }.compare_exchange_strong(entry, protected_entry))
+		{
+			return -ERROR_BUSY;
+		}
+
+		pgdir = owner->pgdir_;
+	}
+
+	memory::tlb_flush_page(pgdir, va);
+
+	arch::fast_memcpy((void*)pmm::page_to_va(to), (void*)pmm::page_to_va(from), PAGE_SIZE);
+
+	{
+		lock_guard g{ live_lock };
+		if (!is_live_locked(owner))
+		{
+			return -ERROR_INVALID;
+		}
+
+		lock_guard g2{ owner->lock_ };
+
+		// duplicate() shared the page meanwhile, which leaves it copy-on-write as it is now
+		if (page_ref_count(from) != 1)
+		{
+			return -ERROR_BUSY;
 		}
-		prev = &(*iter);
-		prev_iter = iter;
+
+		auto pte = vmm::walk_pgdir(owner->pgdir_, va, false);
+		auto expected = protected_entry;
+		if (pte == nullptr ||
+			!integral_atomic_ref<pde_t>{ *pte }.compare_exchange_strong(expected,
+				(entry & ~PTE_ADDR_MASK) | pmm::page_to_pa(to)))
+		{
+			return -ERROR_BUSY;
+		}
+
+		page_ref_inc(to);
+		page_set_rmap(to, owner, va);
+
+		page_ref_dec(from);
+		page_clear_rmap(from);
 	}
 
-	auto next = prev->link_.next_->parent_;
+	// CPUs may still read from the old page through read-only entries
+	memory::tlb_flush_page(pgdir, va);
+
+	return ERROR_SUCCESS;
+}
+
+void address_space::insert_vma_locked(address_space_segment* vma)
+{
+	// the list position comes from the tree, so that inserting takes O(log n) as well
+	auto prev = segment_tree_.floor(vma->start_);
+	auto next = prev != nullptr ? prev->link_.next_->parent_ : (segments.empty() ? nullptr : segments.front_ptr());
 
 	assert_segment_overlap(prev, vma);
 	assert_segment_overlap(vma, next);
 
-	segments.insert(prev_iter, vma);
+	if (prev == nullptr)
+	{
+		segments.push_front(vma);
+	}
+	else
+	{
+		segments.insert(segment_list_type::iterator_type{ &prev->link_ }, vma);
+	}
+
+	segment_tree_.insert(vma, vma->start_, vma->end_);
 
 	vma->parent_ = this;
 }
 
+void address_space::remove_vma_locked(address_space_segment* vma)
+{
+	segments.remove(vma);
+	segment_tree_.remove(vma);
+
+	if (search_cache_ == vma)
+	{
+		search_cache_ = nullptr;
+	}
+}
+
 address_space_segment* address_space::find_vma_locked(uintptr_t addr)
 {
 	auto ret = search_cache_;
@@ -442,15 +827,7 @@ address_space_segment* address_space::find_vma_locked(uintptr_t addr)
 		ret->start() <= addr &&
 		ret->end() > addr))
 	{
-		ret = nullptr;
-		for (auto& seg:segments)
-		{
-			if (seg.start() <= addr && seg.end() > addr)
-			{
-				ret = &seg;
-				break;
-			}
-		}
+		ret = segment_tree_.find(addr);
 	}
 
 	if (ret != nullptr)
@@ -460,7 +837,7 @@ address_space_segment* address_space::find_vma_locked(uintptr_t addr)
 
 	return ret;
 }
-error_code address_space::resize_locked(uintptr_t addr, size_t len) TA_ASSERT(lock_)
+error_code address_space::resize_locked(uintptr_t addr, size_t len, memory::tlb_batch& batch) TA_ASSERT(lock_)
 {
 	uintptr_t start = PAGE_ROUNDDOWN(addr), end = PAGE_ROUNDUP((addr + len));
 	if (!VALID_USER_REGION(start, end))
@@ -470,7 +847,7 @@ error_code address_space::resize_locked(uintptr_t addr, size_t len) TA_ASSERT(lo
 
 	error_code ret = ERROR_SUCCESS;
 
-	if ((ret = unmap(start, end - start)) != ERROR_SUCCESS)
+	if ((ret = unmap_locked(start, end, batch)) != ERROR_SUCCESS)
 	{
 		return ret;
 	}
@@ -480,7 +857,11 @@ error_code address_space::resize_locked(uintptr_t addr, size_t len) TA_ASSERT(lo
 	auto vma = find_vma_locked(start - 1);
 	if (vma != nullptr && vma->end_ == start && vma->flags_ == VM_FLAGS)
 	{
+		// the range is part of the key, so take it out of the tree while growing it
+		remove_vma_locked(vma);
 		vma->end_ = end;
+		insert_vma_locked(vma);
+
 		return ERROR_SUCCESS;
 	}
 
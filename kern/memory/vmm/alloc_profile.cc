@@ -0,0 +1,215 @@
+#include "memory/alloc_profile.hpp"
+
+#include "system/kmem.hpp"
+
+#include "drivers/acpi/cpu.h"
+#include "debug/kdebug.h"
+
+#include "kbl/lock/lock_guard.hpp"
+
+#include <algorithm>
+
+#include <gsl/util>
+
+using namespace memory;
+using namespace memory::kmem;
+
+using lock::lock_guard;
+
+static_assert((ALLOC_PROFILE_SITE_COUNT & (ALLOC_PROFILE_SITE_COUNT - 1)) == 0);
+
+struct site_table
+{
+	alloc_site sites[ALLOC_PROFILE_SITE_COUNT];
+	size_t dropped;
+};
+
+// only written by the owner CPU with interrupts disabled, and read without locking by snapshots
+static site_table site_tables[CPU_COUNT_LIMIT];
+
+// sites of every CPU may differ, so the merged table has room for more of them
+constexpr size_t DUMP_SITE_COUNT = ALLOC_PROFILE_SITE_COUNT * 2;
+
+static alloc_site dump_sites[DUMP_SITE_COUNT];
+static lock::spinlock dump_lock{ "alloc_profile_dump" };
+
+static inline bool site_empty(const alloc_site* s)
+{
+	return s->caller == 0 && s->cache == nullptr;
+}
+
+static inline size_t site_hash(uintptr_t caller, kmem_cache* cache)
+{
+	uintptr_t key = caller ^ ((uintptr_t)cache >> 4);
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdull;
+	key ^= key >> 33;
+
+	return key;
+}
+
+// find the slot of a site, or claim an empty one for it. nullptr if none is found within probes slots
+static inline alloc_site* site_lookup(alloc_site* sites, size_t count, size_t probes,
+	uintptr_t caller, kmem_cache* cache)
+{
+	auto h = site_hash(caller, cache);
+	for (size_t i = 0; i < probes; i++)
+	{
+		auto s = &sites[(h + i) % count];
+		if (s->caller == caller && s->cache == cache)
+		{
+			return s;
+		}
+
+		if (site_empty(s))
+		{
+			s->caller = caller;
+			s->cache = cache;
+			return s;
+		}
+	}
+
+	return nullptr;
+}
+
+static inline void site_record(uintptr_t caller, kmem_cache* cache, size_t bytes, bool alloc)
+{
+	auto state = arch_interrupt_save();
+	auto _ = gsl::finally([&state]()
+	{
+	  arch_interrupt_restore(state);
+	});
+
+	// only the boot processor runs before the CPU-local storage is set up
+	auto table = &site_tables[cpu.is_valid() ? cpu->id : 0];
+
+	auto s = site_lookup(table->sites, ALLOC_PROFILE_SITE_COUNT, ALLOC_PROFILE_PROBE_LIMIT, caller, cache);
+	if (s == nullptr)
+	{
+		table->dropped++;
+		return;
+	}
+
+	if (alloc)
+	{
+		s->allocs++;
+		s->bytes_allocated += bytes;
+	}
+	else
+	{
+		s->frees++;
+		s->bytes_freed += bytes;
+	}
+}
+
+void memory::alloc_profile_alloc(uintptr_t caller, kmem_cache* cache, size_t bytes)
+{
+	site_record(caller, cache, bytes, true);
+}
+
+void memory::alloc_profile_free(uintptr_t caller, kmem_cache* cache, size_t bytes)
+{
+	site_record(caller, cache, bytes, false);
+}
+
+size_t memory::alloc_profile_snapshot(alloc_site* out, size_t n)
+{
+	if (n == 0)
+	{
+		return 0;
+	}
+
+	std::fill(out, out + n, alloc_site{});
+
+	for (auto& table: site_tables)
+	{
+		for (auto& s: table.sites)
+		{
+			if (site_empty(&s))
+			{
+				continue;
+			}
+
+			auto merged = site_lookup(out, n, n, s.caller, s.cache);
+			if (merged == nullptr)
+			{
+				break;
+			}
+
+			merged->allocs += s.allocs;
+			merged->frees += s.frees;
+			merged->bytes_allocated += s.bytes_allocated;
+			merged->bytes_freed += s.bytes_freed;
+		}
+	}
+
+	auto end = std::remove_if(out, out + n, [](const alloc_site& s)
+	{
+	  return site_empty(&s);
+	});
+
+	std::sort(out, end, [](const alloc_site& a, const alloc_site& b)
+	{
+	  return (int64_t)(a.bytes_allocated - a.bytes_freed) > (int64_t)(b.bytes_allocated - b.bytes_freed);
+	});
+
+	return end - out;
+}
+
+size_t memory::alloc_profile_dropped()
+{
+	size_t count = 0;
+	for (auto& table: site_tables)
+	{
+		count += table.dropped;
+	}
+
+	return count;
+}
+
+static void dump_cache(kmem_cache* cache, [[maybe_unused]] void* arg)
+{
+	kmem_cache_statistics st{};
+	kmem_cache_stats(cache, &st);
+
+	size_t slab_bytes = (st.slabs_full + st.slabs_partial + st.slabs_free) * st.slab_size;
+	size_t live_bytes = st.objs_inuse * st.obj_size;
+
+	// share of the slab memory that holds no live object
+	size_t fragmentation = slab_bytes ? (slab_bytes - live_bytes) * 100 / slab_bytes : 0;
+
+	kdebug::kdebug_log("  %s: object %lld bytes, slab %lld bytes, slabs %lld full %lld partial %lld free\n",
+		cache->name, st.obj_size, st.slab_size, st.slabs_full, st.slabs_partial, st.slabs_free);
+
+	kdebug::kdebug_log("    objects %lld in use %lld in magazines %lld total, %lld%% fragmented\n",
+		st.objs_inuse, st.objs_cached, st.objs_total, fragmentation);
+
+	kdebug::kdebug_log("    magazine allocs %lld hit %lld missed, frees %lld hit %lld missed\n",
+		st.alloc_hits, st.alloc_misses, st.free_hits, st.free_misses);
+}
+
+void memory::alloc_profile_dump()
+{
+	if constexpr (alloc_profile_enabled())
+	{
+		lock_guard g{ dump_lock };
+
+		auto count = alloc_profile_snapshot(dump_sites, DUMP_SITE_COUNT);
+
+		kdebug::kdebug_log("allocation sites: %lld, records dropped: %lld\n", count, alloc_profile_dropped());
+
+		for (size_t i = 0; i < count; i++)
+		{
+			auto s = &dump_sites[i];
+			kdebug::kdebug_log("  0x%p %s: %lld allocs %lld frees, %lld bytes allocated %lld freed\n",
+				s->caller, s->cache ? s->cache->name : "pages", s->allocs, s->frees, s->bytes_allocated, s->bytes_freed);
+		}
+	}
+	else
+	{
+		kdebug::kdebug_log("allocation profiling is disabled, build with KERNEL_ENABLE_ALLOC_PROFILE\n");
+	}
+
+	kdebug::kdebug_log("kmem caches:\n");
+	kmem_cache_for_each(dump_cache, nullptr);
+}
@@ -138,7 +138,7 @@ void vmm::install_gdt()
 	current_cpu->kernel_gs = cpu_kernel_gs;
 
 	current_cpu->tss.iopb_offset = sizeof(current_cpu->tss);
-	current_cpu->tss.ist1 = reinterpret_cast<uintptr_t>(double_fault_stack); // stack for double fault handling
+	current_cpu->tss.ist1 = reinterpret_cast<uintptr_t>(double_fault_stack + PAGE_SIZE); // stack for double fault handling
 
 	set_gdt_entry(&current_cpu->gdt_table.kernel_code, 0, 0, DPL_KERNEL, true, false);
 	set_gdt_entry(&current_cpu->gdt_table.kernel_data, 0, 0, DPL_KERNEL, false, true);
@@ -25,6 +25,11 @@
 #include "system/pmm.h"
 
 #include "memory/pmm.hpp"
+#include "memory/alloc_profile.hpp"
+
+#include "compiler/compiler_extensions.hpp"
+
+#include "debug/kdebug.h"
 
 // slab
 using memory::kmem::kmem_bufctl;
@@ -49,13 +54,19 @@ enum class allocator_types
 {
 	// not start from zero for the sake of debugging
 	PMM = 0x1,
-	SLAB
+	SLAB,
+	VMALLOC,
 };
 
 struct memory_block
 {
 	allocator_types type;
 
+#ifdef _KERNEL_ENABLE_ALLOC_PROFILE
+	// the call site the block is charged to
+	uintptr_t caller;
+#endif
+
 	union
 	{
 		struct
@@ -68,29 +79,61 @@ struct memory_block
 			size_t size;
 			kmem_cache* cache;
 		} slab;
+
+		struct
+		{
+			size_t size;
+		} vmalloc;
 	} alloc_info;
 
 	uint8_t mem[0];
 };
 
-static inline kmem_cache* cache_from_size(size_t sz)
+// every size class is a multiple of it, so sizes rounded up to it share a class
+constexpr size_t SIZE_CLASS_GRANULE = 16;
+
+struct size_class_table
 {
-	kmem_cache* cache = nullptr;
+	uint8_t index[memory::kmem::KMEM_MAX_SIZED_CACHE_SIZE / SIZE_CLASS_GRANULE + 1];
+};
 
-	// assumption: sized_caches are sorted ascending.
-	for (auto c : sized_caches)
+// maps a size, in granules, to the smallest class that holds it
+static constexpr size_class_table make_size_class_table()
+{
+	size_class_table table{};
+
+	size_t cls = 0;
+	for (size_t granules = 0; granules < sizeof(table.index); granules++)
 	{
-		if (sz <= c->obj_size)
+		while (granules * SIZE_CLASS_GRANULE > memory::kmem::KMEM_SIZE_CLASSES[cls])
 		{
-			cache = c;
-			break;
+			cls++;
 		}
+
+		table.index[granules] = static_cast<uint8_t>(cls);
 	}
 
-	return cache;
+	return table;
+}
+
+constexpr size_class_table size_class_lookup = make_size_class_table();
+
+static_assert(memory::kmem::KMEM_SIZED_CACHE_COUNT <= UINT8_MAX);
+static_assert(size_class_lookup.index[1] == 0);
+static_assert(size_class_lookup.index[sizeof(size_class_lookup.index) - 1] == KMEM_SIZED_CACHE_COUNT - 1);
+
+static inline kmem_cache* cache_from_size(size_t sz)
+{
+	KDEBUG_ASSERT(sz <= memory::kmem::KMEM_MAX_SIZED_CACHE_SIZE);
+	return sized_caches[size_class_lookup.index[(sz + SIZE_CLASS_GRANULE - 1) / SIZE_CLASS_GRANULE]];
 }
 
-void* memory::kmalloc(size_t sz, [[maybe_unused]] size_t flags)
+void* memory::kmalloc(size_t sz, size_t flags)
+{
+	return kmalloc_from(sz, flags, (uintptr_t)__GET_CALLER());
+}
+
+void* memory::kmalloc_from(size_t sz, [[maybe_unused]] size_t flags, uintptr_t caller)
 {
 	memory_block* ret = nullptr;
 
@@ -102,21 +145,53 @@ void* memory::kmalloc(size_t sz, [[maybe_unused]] size_t flags)
 
 		size_t npages = roundup(actual_size, PAGE_SIZE) / PAGE_SIZE;
 
-		ret = reinterpret_cast<decltype(ret)>(pmm::page_to_va(physical_memory_manager::instance()->allocate(npages)));
+		if (auto pg = physical_memory_manager::instance()->allocate(npages);pg != nullptr)
+		{
+			ret = reinterpret_cast<decltype(ret)>(pmm::page_to_va(pg));
+
+			ret->type = allocator_types::PMM;
+			ret->alloc_info.pmm.page_count = npages;
 
-		ret->type = allocator_types::PMM;
-		ret->alloc_info.pmm.page_count = npages;
+#ifdef _KERNEL_ENABLE_ALLOC_PROFILE
+			alloc_profile_alloc(caller, nullptr, npages * PAGE_SIZE);
+#endif
+		}
+		else
+		{
+			// no free block is large enough, but single pages may still be
+			ret = reinterpret_cast<decltype(ret)>(vmalloc(actual_size));
+			if (ret == nullptr)
+			{
+				return nullptr;
+			}
+
+			ret->type = allocator_types::VMALLOC;
+			ret->alloc_info.vmalloc.size = actual_size;
+
+#ifdef _KERNEL_ENABLE_ALLOC_PROFILE
+			alloc_profile_alloc(caller, nullptr, actual_size);
+#endif
+		}
 	}
 	else
 	{
 		// use slab
 		auto cache = cache_from_size(actual_size);
 
-		ret = reinterpret_cast<decltype(ret)>(kmem_cache_alloc(cache));
+		ret = reinterpret_cast<decltype(ret)>(memory::kmem::kmem_cache_alloc_from(cache, caller));
+		if (ret == nullptr)
+		{
+			return nullptr;
+		}
+
 		ret->type = allocator_types::SLAB;
 		ret->alloc_info.slab = decltype(ret->alloc_info.slab){ .size = cache->obj_size, .cache = cache };
 	}
 
+#ifdef _KERNEL_ENABLE_ALLOC_PROFILE
+	ret->caller = caller;
+#endif
+
 	return ret->mem;
 }
 
@@ -127,12 +202,29 @@ void memory::kfree(void* ptr)
 
 	if (block->type == allocator_types::PMM)
 	{
+#ifdef _KERNEL_ENABLE_ALLOC_PROFILE
+		alloc_profile_free(block->caller, nullptr, block->alloc_info.pmm.page_count * PAGE_SIZE);
+#endif
+
 		physical_memory_manager::instance()->free(pmm::va_to_page((uintptr_t)ptr), block->alloc_info.pmm.page_count);
 
 	}
 	else if (block->type == allocator_types::SLAB)
 	{
 		auto cache = block->alloc_info.slab.cache;
-		kmem_cache_free(cache, block);
+
+#ifdef _KERNEL_ENABLE_ALLOC_PROFILE
+		alloc_profile_free(block->caller, cache, cache->obj_size);
+#endif
+
+		memory::kmem::kmem_cache_free_untracked(cache, block);
+	}
+	else if (block->type == allocator_types::VMALLOC)
+	{
+#ifdef _KERNEL_ENABLE_ALLOC_PROFILE
+		alloc_profile_free(block->caller, nullptr, block->alloc_info.vmalloc.size);
+#endif
+
+		vfree(block);
 	}
 }
\ No newline at end of file
@@ -0,0 +1,243 @@
+// Copyright (c) 2021 SmartPolarBear
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "memory/kstack.hpp"
+#include "memory/pmm.hpp"
+#include "memory/reclaim.hpp"
+#include "memory/teardown.hpp"
+
+#include "system/mmu.h"
+#include "system/pmm.h"
+#include "system/vmm.h"
+
+#include "drivers/acpi/cpu.h"
+
+#include "debug/kdebug.h"
+
+#include "kbl/lock/lock_guard.hpp"
+
+#include <gsl/util>
+
+using namespace memory;
+using namespace lock;
+
+namespace
+{
+
+// only touched by its owner CPU with interrupts disabled
+struct kstack_cpu_cache
+{
+	void* stacks[KSTACK_CACHE_SIZE];
+	size_t count;
+};
+
+kstack_cpu_cache cpu_caches[CPU_COUNT_LIMIT]{};
+
+constexpr size_t BITS_PER_WORD = sizeof(uint64_t) * 8;
+
+spinlock slot_lock{ "kstack_slot" };
+
+// a set bit marks a slot in use
+uint64_t slot_bitmap[KSTACK_SLOT_COUNT / BITS_PER_WORD] TA_GUARDED(slot_lock){};
+
+// the word to start searching from
+size_t slot_hint TA_GUARDED(slot_lock){ 0 };
+
+}
+
+static inline uintptr_t slot_to_stack(size_t slot)
+{
+	return KSTACK_VIRTUALBASE + slot * KSTACK_SLOT_SIZE + PAGE_SIZE;
+}
+
+static inline size_t stack_to_slot(uintptr_t stack)
+{
+	return (stack - PAGE_SIZE - KSTACK_VIRTUALBASE) / KSTACK_SLOT_SIZE;
+}
+
+// returns KSTACK_SLOT_COUNT when all slots are in use
+static size_t slot_allocate()
+{
+	lock_guard g{ slot_lock };
+
+	constexpr size_t WORD_COUNT = KSTACK_SLOT_COUNT / BITS_PER_WORD;
+	for (size_t i = 0; i < WORD_COUNT; i++)
+	{
+		auto word = (slot_hint + i) % WORD_COUNT;
+		if (slot_bitmap[word] == UINT64_MAX)
+		{
+			continue;
+		}
+
+		auto bit = __builtin_ctzll(~slot_bitmap[word]);
+		slot_bitmap[word] |= (1ull << bit);
+		slot_hint = word;
+
+		return word * BITS_PER_WORD + bit;
+	}
+
+	return KSTACK_SLOT_COUNT;
+}
+
+static void slot_free(size_t slot)
+{
+	lock_guard g{ slot_lock };
+
+	KDEBUG_ASSERT(slot_bitmap[slot / BITS_PER_WORD] & (1ull << (slot % BITS_PER_WORD)));
+	slot_bitmap[slot / BITS_PER_WORD] &= ~(1ull << (slot % BITS_PER_WORD));
+}
+
+// called by the teardown thread once the stack is unmapped, so the slot isn't reused while a CPU may still reach it
+static void stack_release(uintptr_t stack, [[maybe_unused]] uintptr_t end)
+{
+	slot_free(stack_to_slot(stack));
+}
+
+// stacks are freed from schedule() and from reclaim, which may hold locks that other CPUs spin on with interrupts off,
+// so the shootdown of the kernel page table is left to the teardown thread
+static void stack_unmap(uintptr_t stack, uintptr_t end)
+{
+	if (stack == end)
+	{
+		slot_free(stack_to_slot(stack));
+		return;
+	}
+
+	teardown_defer_kernel_range(stack, end, stack_release);
+}
+
+static void* stack_create()
+{
+	auto slot = slot_allocate();
+	if (slot == KSTACK_SLOT_COUNT)
+	{
+		return nullptr;
+	}
+
+	// the guard page below the stack is never mapped
+	auto stack = slot_to_stack(slot);
+	for (uintptr_t va = stack; va < stack + KSTACK_SIZE; va += PAGE_SIZE)
+	{
+		auto pg = physical_memory_manager::instance()->allocate();
+		if (pg == nullptr ||
+			physical_memory_manager::instance()->insert_page(pg, va, PG_W, vmm::g_kpml4t, false) != ERROR_SUCCESS)
+		{
+			if (pg != nullptr)
+			{
+				physical_memory_manager::instance()->free(pg);
+			}
+
+			stack_unmap(stack, va);
+
+			return nullptr;
+		}
+	}
+
+	return reinterpret_cast<void*>(stack);
+}
+
+static void stack_destroy(void* stack)
+{
+	auto addr = reinterpret_cast<uintptr_t>(stack);
+
+	stack_unmap(addr, addr + KSTACK_SIZE);
+}
+
+static size_t kstack_shrinker_scan([[maybe_unused]] shrinker* self, size_t target)
+{
+	if (!cpu.is_valid())
+	{
+		return 0;
+	}
+
+	auto state = arch_interrupt_save();
+	auto _ = gsl::finally([&state]()
+	{
+	  arch_interrupt_restore(state);
+	});
+
+	// the caches of other CPUs are only touched by their owners
+	auto& cache = cpu_caches[cpu->id];
+
+	// the pages come back once the teardown thread has unmapped the stacks
+	size_t freed = 0;
+	while (cache.count > 0 && freed < target)
+	{
+		stack_destroy(cache.stacks[--cache.count]);
+		freed += KSTACK_SIZE / PAGE_SIZE;
+	}
+
+	return freed;
+}
+
+static shrinker kstack_shrinker{
+	.name = "kstack",
+	.scan = kstack_shrinker_scan,
+	.link = {},
+};
+
+void memory::kstack_init()
+{
+	register_shrinker(&kstack_shrinker);
+}
+
+void* memory::kstack_allocate()
+{
+	if (cpu.is_valid())
+	{
+		auto state = arch_interrupt_save();
+		auto _ = gsl::finally([&state]()
+		{
+		  arch_interrupt_restore(state);
+		});
+
+		auto& cache = cpu_caches[cpu->id];
+		if (cache.count > 0)
+		{
+			return cache.stacks[--cache.count];
+		}
+	}
+
+	return stack_create();
+}
+
+void memory::kstack_free(void* stack)
+{
+	auto addr = reinterpret_cast<uintptr_t>(stack);
+	KDEBUG_ASSERT(addr >= KSTACK_VIRTUALBASE && addr < KSTACK_VIRTUALEND);
+
+	if (cpu.is_valid())
+	{
+		auto state = arch_interrupt_save();
+		auto _ = gsl::finally([&state]()
+		{
+		  arch_interrupt_restore(state);
+		});
+
+		auto& cache = cpu_caches[cpu->id];
+		if (cache.count < KSTACK_CACHE_SIZE)
+		{
+			cache.stacks[cache.count++] = stack;
+			return;
+		}
+	}
+
+	stack_destroy(stack);
+}
@@ -34,22 +34,153 @@
 #include "drivers/console/console.h"
 #include "debug/kdebug.h"
 
+#include "arch/amd64/cpu/string.hpp"
+
 #include "memory/pmm.hpp"
 #include "memory/address_space.hpp"
 
 #include "task/process/process.hpp"
 #include "task/thread//thread.hpp"
 
+#include "kbl/atomic/atomic_ref.hpp"
+#include "kbl/lock/lock_guard.hpp"
+
 #include <cstring>
 #include <algorithm>
 
 using namespace vmm;
 using namespace memory;
 
+// pages shared by address_space::duplicate are mapped read-only with PG_COW.
+// the first write copies the page, unless no one else maps it any longer.
+static inline error_code copy_on_write(address_space* as, vmm::pde_ptr_t pgdir, uintptr_t addr, tlb_batch& batch)
+{
+	auto pte = vmm::walk_pgdir(pgdir, addr, false);
+	if (pte == nullptr || !((*pte) & PG_P) || !((*pte) & PG_COW))
+	{
+		return -ERROR_ACCESS;
+	}
+
+	const bool large = (*pte) & PG_PS;
+	const size_t page_count = large ? LARGE_PAGE_PAGES : 1;
+
+	addr = large ? LARGE_PAGE_ROUNDDOWN(addr) : PAGE_ROUNDDOWN(addr);
+
+	auto old_page = pmm::pde_to_page(pte);
+	if (page_ref_count(old_page) == 1)
+	{
+		// compaction may be moving the page, and either this or the move fails the exchange.
+		// in both cases the write is retried against the entry that won
+		auto entry = *pte;
+		if (kbl::integral_atomic_ref<pde_t>{ *pte }.compare_exchange_strong(entry, (entry & ~PG_COW) | PG_W))
+		{
+			if (!large)
+			{
+				page_set_rmap(old_page, as, addr);
+			}
+
+			batch.add_range(addr, addr + page_count * PAGE_SIZE);
+		}
+
+		return ERROR_SUCCESS;
+	}
+
+	auto new_page = physical_memory_manager::instance()->allocate(page_count);
+	if (new_page == nullptr)
+	{
+		return -ERROR_MEMORY_ALLOC;
+	}
+
+	arch::fast_memcpy((void*)pmm::page_to_va(new_page), (void*)pmm::page_to_va(old_page), page_count * PAGE_SIZE);
+
+	// insert_page drops the reference to the old page
+	auto perm = ((*pte) & ~(PTE_ADDR_MASK | PG_COW | PG_P | PG_A | PG_D)) | PG_W;
+	if (auto ret = physical_memory_manager::instance()->insert_page(new_page, addr, perm, pgdir, true, batch);
+		ret != ERROR_SUCCESS)
+	{
+		physical_memory_manager::instance()->free(new_page, page_count);
+		return ret;
+	}
+
+	if (!large)
+	{
+		page_set_rmap(new_page, as, addr);
+	}
+
+	return ERROR_SUCCESS;
+}
+
+// the page is filled from the segment before it's mapped, so no other thread can see it half-filled
+static inline error_code map_filled_page(address_space* as,
+	vmm::pde_ptr_t pgdir,
+	const address_space_segment* vma,
+	uintptr_t va,
+	size_t perm,
+	size_t page_count,
+	bool allow_rewrite,
+	tlb_batch& batch)
+{
+	const size_t len = page_count * PAGE_SIZE;
+
+	// pages with nothing from the image come pre-zeroed
+	page* pg = nullptr;
+	if (vma->backed(va, len))
+	{
+		pg = physical_memory_manager::instance()->allocate(page_count);
+		if (pg != nullptr)
+		{
+			vma->fill(va, reinterpret_cast<uint8_t*>(pmm::page_to_va(pg)), len);
+		}
+	}
+	else
+	{
+		pg = physical_memory_manager::instance()->allocate_zeroed(page_count);
+	}
+
+	if (pg == nullptr)
+	{
+		return -ERROR_MEMORY_ALLOC;
+	}
+
+	if (auto ret = physical_memory_manager::instance()->insert_page(pg, va, perm, pgdir, allow_rewrite, batch);
+		ret != ERROR_SUCCESS)
+	{
+		physical_memory_manager::instance()->free(pg, page_count);
+		return ret;
+	}
+
+	// 2MB pages aren't migrated
+	if (page_count == 1)
+	{
+		page_set_rmap(pg, as, va);
+	}
+
+	return ERROR_SUCCESS;
+}
+
 static inline error_code page_fault_impl(size_t err, uintptr_t addr)
 {
-	auto proc = cur_proc.get();
-	auto vma = proc->address_space()->find_vma(addr);
+	// the kernel faults on user memory when a syscall stores to it, which is handled like a fault of the user.
+	// with CR0.WP set, a store to a copy-on-write page faults as well, and gets its own copy before it's written.
+	// any other kernel fault is a bug
+	if (!(err & 0b100) && !VALID_USER_PTR(addr))
+	{
+		return -ERROR_VMA_NOT_FOUND;
+	}
+
+	auto as = cur_proc->address_space();
+
+	// declared before the guard, so that the other CPUs are waited for after the lock is released.
+	// another thread of the process spinning for the lock in its fault has interrupts off, and couldn't answer
+	memory::tlb_batch batch{ as->pgdir() };
+
+	// held until the page is in place, so that an unmap from another thread can't free the segment,
+	// or have the page put into the range it just unmapped
+	lock::lock_guard g{ *as->get_lock() };
+
+	auto pgdir = as->pgdir_locked();
+
+	auto vma = as->find_vma_locked(addr);
 	if (vma == nullptr || vma->start() > addr)
 	{
 		return -ERROR_VMA_NOT_FOUND;
@@ -57,6 +188,12 @@ static inline error_code page_fault_impl(size_t err, uintptr_t addr)
 
 	switch (err & 0b11)
 	{
+	case 0b11: // write, persent
+		if (!(vma->flags() & VM_WRITE))
+		{
+			return -ERROR_ACCESS;
+		}
+		return copy_on_write(as, pgdir, addr, batch);
 	default:
 	case 0b10: // write, not persent
 		if (!(vma->flags() & VM_WRITE))
@@ -83,15 +220,45 @@ static inline error_code page_fault_impl(size_t err, uintptr_t addr)
 
 	addr = rounddown(addr, PAGE_SIZE);
 
-	auto page_ret =
-		memory::physical_memory_manager::instance()->allocate(addr, page_perm, proc->address_space()->pgdir(), true);
-	if (has_error(page_ret)) // map to any free space
+	// large pages are opt-in, and only used when the whole 2MB page is inside the vma
+	if (vma->flags() & VM_LARGE_PAGE)
 	{
-		return get_error_code(page_ret);
+		auto large_addr = LARGE_PAGE_ROUNDDOWN(addr);
+
+		// a page table there holds 4K pages faulted in before, which a 2MB page can't replace.
+		// checked first so that a 2MB block isn't allocated and filled only to be freed on every fault
+		auto pde = vmm::walk_pgdir_large(pgdir, large_addr, false);
+		bool pde_empty = pde == nullptr || !((*pde) & PG_P);
+
+		if (pde_empty && large_addr >= vma->start() && large_addr + LARGE_PAGE_SIZE <= vma->end())
+		{
+			if (map_filled_page(as,
+				pgdir,
+				vma,
+				large_addr,
+				page_perm | PG_PS,
+				LARGE_PAGE_PAGES,
+				false,
+				batch) == ERROR_SUCCESS)
+			{
+				return ERROR_SUCCESS;
+			}
+
+			// fall back to a 4K page when no 2MB block is free
+		}
 	}
 
-	return ERROR_SUCCESS;
+	// file-backed segments are filled from their image, and anonymous ones with zero
+	auto ret = map_filled_page(as, pgdir, vma, addr, page_perm, 1, false, batch);
 
+	// the page was mapped before the lock was taken, by another thread or by populate, and is kept.
+	// map_filled_page already freed the one filled here
+	if (ret == -ERROR_REWRITE)
+	{
+		return ERROR_SUCCESS;
+	}
+
+	return ret;
 }
 
 error_code handle_pgfault([[maybe_unused]] trap::trap_frame info)
@@ -126,6 +293,13 @@ error_code handle_pgfault([[maybe_unused]] trap::trap_frame info)
 			false,
 			"Address: 0x%p\n", addr);
 	}
+	else if (ret == -ERROR_ACCESS)
+	{
+		KDEBUG_RICHPANIC("Write to a read-only page.",
+			"KERNEL PANIC: PAGE FAULT",
+			false,
+			"Address: 0x%p\n", addr);
+	}
 	else if (ret == -ERROR_UNKOWN)
 	{
 		KDEBUG_RICHPANIC("Unkown error in paging",
@@ -37,13 +37,19 @@
 #include "debug/kdebug.h"
 
 #include "memory/pmm.hpp"
+#include "memory/tlb.hpp"
+#include "memory/reclaim.hpp"
 
 #include "ktl/span.hpp"
 
+#include "kbl/atomic/atomic_ref.hpp"
+
 #include "../../libs/basic_io/include/builtin_text_io.hpp"
 #include <cstring>
 #include <algorithm>
 
+#include <gsl/util>
+
 using namespace ktl;
 
 using namespace vmm;
@@ -56,167 +62,82 @@ using namespace kbl;
 // global variable for the sake of access and dynamically mapping
 pde_ptr_t vmm::g_kpml4t;
 
-// global cache for pgdir
-kmem_cache* pgdir_cache = nullptr;
-
-// remove all flags_ in entries to expose the address of the next level
-static inline constexpr size_t remove_flags(vmm::pde_t pde)
-{
-	constexpr size_t FLAGS_SHIFT = 8;
-	return (pde >> FLAGS_SHIFT) << FLAGS_SHIFT;
-}
-
-static inline void do_free_range_pgdir(pde_ptr_t pdpte)
+// get the table the entry points to, allocating it if it isn't present and create_if_not_exist = true
+static inline pde_ptr_t next_level(pde_ptr_t entry, bool create_if_not_exist, size_t perm)
 {
-	auto pgdir = reinterpret_cast<decltype(pdpte)>(P2V(remove_flags(*pdpte)));
-
-	*pgdir = 0;
-	vmm::pgdir_entry_free(pgdir);
-}
-
-static inline void do_free_range_pdpt(pde_ptr_t pml4e, uintptr_t st, uintptr_t ed)
-{
-	auto pdpt = reinterpret_cast<decltype(pml4e)>(P2V(remove_flags(*pml4e)));
-
-	for (uintptr_t addr = st; addr <= ed; addr += PDPT_SIZE)
+	if (!(*entry & PG_P))
 	{
-		auto pdpte = &pdpt[P3X(addr)];
-		do_free_range_pgdir(pdpte);
-
-		*pdpte = 0;
-		vmm::pgdir_entry_free(pdpte);
-	}
-}
-
-static inline void do_free_range_pml4t(pde_ptr_t pml4t, uintptr_t st, uintptr_t ed)
-{
-// traversal all the pml4e concerned
-	for (uintptr_t addr = st; addr <= ed; addr += PML4T_SIZE)
-	{
-		pde_ptr_t pml4e = &pml4t[P4X(addr)];
-		if ((*pml4e) & PG_P)
+		if (!create_if_not_exist)
 		{
-			do_free_range_pdpt(pml4e, st, ed);
+			return nullptr;
+		}
 
-			*pml4e = 0;
-			vmm::pgdir_entry_free(pml4e);
+		auto table = vmm::pgdir_entry_alloc();
+		KDEBUG_ASSERT(table != nullptr);
+		if (table == nullptr)
+		{
+			return nullptr;
 		}
+
+		*entry = ((V2P((uintptr_t)table)) | PG_P | PG_U | perm);
 	}
+
+	return reinterpret_cast<pde_ptr_t>(P2V(*entry & PTE_ADDR_MASK));
 }
 
-// find the pde corresponding to the given va
+// find the pte corresponding to the given va
 // perm is only valid when create_if_not_exist = true
+// if large = true, or the va is already covered by a 2mb page, the pde in page directory is returned instead.
 static inline pde_ptr_t walk_pgdir(const pde_ptr_t pml4t,
 	uintptr_t vaddr,
 	bool create_if_not_exist = false,
-	size_t perm = 0)
+	size_t perm = 0,
+	bool large = false)
 {
-	// #define WALK_PGDIR_PRINT_INTERMEDIATE_VAL
-
 	// the pml4, which's the content of CR3, is held in kpml4t
 	// firstly find the 3rd page directory (PDPT) from it.
-	pde_ptr_t pml4e = &pml4t[P4X(vaddr)],
-		pdpt = nullptr,
-		pdpte = nullptr,
-		pgdir = nullptr,
-		pde = nullptr;
-
-#ifdef WALK_PGDIR_PRINT_INTERMEDIATE_VAL
-	if (vaddr == 0x10000000)
-	{
-		printf("pml4e=0x%p\n", pml4e);
-	}
-#endif
-
-	if (!(*pml4e & PG_P))
-	{
-		if (!create_if_not_exist)
-		{
-			return nullptr;
-		}
-
-		pdpt = vmm::pgdir_entry_alloc();
-		KDEBUG_ASSERT(pdpt != nullptr);
-		if (pdpt == nullptr)
-		{
-			return nullptr;
-		}
-
-		memset(pdpt, 0, PGTABLE_SIZE);
-		*pml4e = ((V2P((uintptr_t)pdpt)) | PG_P | PG_U | perm);
-	}
-	else
-	{
-		pdpt = reinterpret_cast<decltype(pdpt)>(P2V(remove_flags(*pml4e)));
-	}
-
-#ifdef WALK_PGDIR_PRINT_INTERMEDIATE_VAL
-	if (vaddr == 0x10000000)
+	auto pdpt = next_level(&pml4t[P4X(vaddr)], create_if_not_exist, perm);
+	if (pdpt == nullptr)
 	{
-		printf("pdpt=0x%p\n", pdpt);
+		return nullptr;
 	}
-#endif
 
 	// find the 2nd page directory from PGPT
-	pdpte = &pdpt[P3X(vaddr)];
-	if (!(*pdpte & PG_P))
+	auto pgdir = next_level(&pdpt[P3X(vaddr)], create_if_not_exist, perm);
+	if (pgdir == nullptr)
 	{
-		if (!create_if_not_exist)
-		{
-			return nullptr;
-		}
-
-		pgdir = vmm::pgdir_entry_alloc();
-
-		KDEBUG_ASSERT(pgdir != nullptr);
-		if (pgdir == nullptr)
-		{
-			return nullptr;
-		}
-
-		memset(pgdir, 0, PGTABLE_SIZE);
-		*pdpte = ((V2P((uintptr_t)pgdir)) | PG_P | PG_U | perm);
-	}
-	else
-	{
-		pgdir = reinterpret_cast<decltype(pgdir)>(P2V(remove_flags(*pdpte)));
+		return nullptr;
 	}
 
-#ifdef WALK_PGDIR_PRINT_INTERMEDIATE_VAL
-	if (vaddr == 0x10000000)
+	auto pde = &pgdir[P2X(vaddr)];
+	if (large || ((*pde & PG_P) && (*pde & PG_PS)))
 	{
-		printf("pdpte=0x%p\n", pdpte);
+		return pde;
 	}
-#endif
 
-	// find the page from 2nd page directory.
-	// because we use page size extension (2mb pages)
-	// this is the last level.
-	pde = &pgdir[P2X(vaddr)];
-
-#ifdef WALK_PGDIR_PRINT_INTERMEDIATE_VAL
-	if (vaddr == 0x10000000)
+	// find the page from the page table, which is the last level for 4k pages
+	auto pgtable = next_level(pde, create_if_not_exist, perm);
+	if (pgtable == nullptr)
 	{
-		printf("pde=0x%p\n", pde);
+		return nullptr;
 	}
-#endif
 
-	return pde;
+	return &pgtable[P1X(vaddr)];
 }
 
-// this method maps the specific va
-static inline error_code map_page(pde_ptr_t pml4, uintptr_t va, uintptr_t pa, size_t perm)
+// this method maps the specific va, with a 2mb page if large = true
+static inline error_code map_page(pde_ptr_t pml4, uintptr_t va, uintptr_t pa, size_t perm, bool large)
 {
-	auto pde = walk_pgdir(pml4, va, true, perm);
+	auto pte = walk_pgdir(pml4, va, true, perm, large);
 
-	if (pde == nullptr)
+	if (pte == nullptr)
 	{
 		return -ERROR_MEMORY_ALLOC;
 	}
 
-	if (!(*pde & PG_P))
+	if (!(*pte & PG_P))
 	{
-		*pde = ((pa) | PG_PS | PG_P | PG_U | perm);
+		*pte = ((pa) | PG_P | PG_U | perm | (large ? PG_PS : 0));
 	}
 	else
 	{
@@ -230,16 +151,19 @@ static inline error_code map_pages(pde_ptr_t pml4,
 	uintptr_t va_start,
 	uintptr_t pa_start,
 	uintptr_t pa_end,
-	uint64_t perm)
+	uint64_t perm,
+	bool large = false)
 {
 	error_code ret = ERROR_SUCCESS;
 
+	const size_t step = large ? LARGE_PAGE_SIZE : PAGE_SIZE;
+
 	// map the kernel memory
 	for (uintptr_t pa = pa_start, va = va_start;
-	     pa < pa_end && pa + PAGE_SIZE <= pa_end;
-	     pa += PAGE_SIZE, va += PAGE_SIZE)
+	     pa < pa_end && pa + step <= pa_end;
+	     pa += step, va += step)
 	{
-		ret = map_page(pml4, va, pa, /*PG_W | PG_U*/ perm);
+		ret = map_page(pml4, va, pa, /*PG_W | PG_U*/ perm, large);
 
 		if (ret != -ERROR_SUCCESS)
 		{
@@ -250,61 +174,308 @@ static inline error_code map_pages(pde_ptr_t pml4,
 	return ret;
 }
 
-void pgdir_cache_init()
+static inline bool table_empty(pde_ptr_t table)
+{
+	for (size_t i = 0; i < PTENTRIES_COUNT; i++)
+	{
+		if (table[i] & PG_P)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// the span mapped by an entry of a table at the given level, where page tables are at level 1 and the PML4 at 4
+static inline constexpr uintptr_t entry_span(size_t level)
+{
+	return PAGE_SIZE << (9 * (level - 1));
+}
+
+// free the tables below table, which is at level and maps from base, that map nothing and lie wholly in [start, end).
+// the others may be in use by faults next to the range.
+// \return whether table is empty afterwards
+static bool release_empty_tables(pde_ptr_t table,
+	size_t level,
+	uintptr_t base,
+	uintptr_t start,
+	uintptr_t end,
+	memory::tlb_batch& batch)
+{
+	const uintptr_t span = entry_span(level);
+
+	size_t first = (std::max(start, base) - base) / span;
+	size_t last = (std::min(end, base + span * PTENTRIES_COUNT) - 1 - base) / span;
+
+	for (size_t i = first; i <= last; i++)
+	{
+		auto entry = &table[i];
+		if (!((*entry) & PG_P) || ((*entry) & PG_PS) || level == 1)
+		{
+			continue;
+		}
+
+		// the lower half of the kernel page table is shared by every address space
+		if (level == 4 && *entry == g_kpml4t[i])
+		{
+			continue;
+		}
+
+		uintptr_t entry_base = base + i * span;
+		auto next = reinterpret_cast<pde_ptr_t>(P2V((*entry) & PTE_ADDR_MASK));
+
+		if (release_empty_tables(next, level - 1, entry_base, start, end, batch) &&
+			start <= entry_base && entry_base + span <= end)
+		{
+			*entry = 0;
+			batch.defer_free_table(next, entry_base, entry_base + span);
+		}
+	}
+
+	return table_empty(table);
+}
+
+// fill the PML4 entries of a kernel region mapped after boot.
+// address spaces copy the PML4 of the kernel when they are created, so that they share the lower tables,
+// and see whatever is mapped in the region later on
+static inline void reserve_kernel_region(pde_ptr_t pml4t, uintptr_t start, uintptr_t end)
 {
-	pgdir_cache = kmem_cache_create("pgdir", 4_KB, nullptr, nullptr, KMEM_CACHE_4KALIGN);
+	KDEBUG_ASSERT(start % PML4T_SIZE == 0 && end % PML4T_SIZE == 0);
+
+	for (uintptr_t addr = start; addr < end; addr += PML4T_SIZE)
+	{
+		if (next_level(&pml4t[P4X(addr)], true, PG_W) == nullptr)
+		{
+			KDEBUG_GENERALPANIC("Can't allocate enough space for paging.\n");
+		}
+	}
+}
+
+// Page tables are whole zeroed pages, cached per CPU in front of the pre-zeroed pool.
+// A table is empty when it's freed, so it goes back to the cache without being zeroed again.
+
+static void pgtable_refill(memory::per_cpu_pages& pcp)
+{
+	auto pmm = memory::physical_memory_manager::instance();
+	for (size_t i = 0; i < memory::per_cpu_pages::BATCH; i++)
+	{
+		auto pg = pmm->allocate_zeroed();
+		if (pg == nullptr)
+		{
+			break;
+		}
+
+		pcp.push_cold(pg);
+	}
+
+	pcp.stats().refills++;
+}
+
+static size_t pgtable_drain(memory::per_cpu_pages& pcp, size_t count)
+{
+	size_t drained = 0;
+	for (page* pg = nullptr; drained < count && (pg = pcp.pop_cold()) != nullptr; drained++)
+	{
+		memory::physical_memory_manager::instance()->free(pg);
+	}
+
+	pcp.stats().drains++;
+
+	return drained;
+}
+
+static size_t pgtable_shrinker_scan([[maybe_unused]] memory::shrinker* self, size_t target)
+{
+	if (!cpu.is_valid())
+	{
+		return 0;
+	}
+
+	auto state = arch_interrupt_save();
+	auto _ = gsl::finally([&state]()
+	{
+	  arch_interrupt_restore(state);
+	});
+
+	// only the cache of this CPU can be touched
+	return pgtable_drain(cpu->pgtable_cache, target);
+}
+
+static memory::shrinker pgtable_shrinker{
+	.name = "pgtable",
+	.scan = pgtable_shrinker_scan,
+	.link = {},
+};
+
+void pgtable_cache_init()
+{
+	memory::register_shrinker(&pgtable_shrinker);
 }
 
 vmm::pde_ptr_t vmm::pgdir_entry_alloc()
 {
-	return (vmm::pde_ptr_t)kmem_cache_alloc(pgdir_cache);
+	page* pg = nullptr;
+	if (cpu.is_valid())
+	{
+		auto state = arch_interrupt_save();
+		auto _ = gsl::finally([&state]()
+		{
+		  arch_interrupt_restore(state);
+		});
+
+		auto& pcp = cpu->pgtable_cache;
+		if (pcp.empty())
+		{
+			pcp.stats().alloc_misses++;
+			pgtable_refill(pcp);
+		}
+		else
+		{
+			pcp.stats().alloc_hits++;
+		}
+
+		pg = pcp.pop_hot();
+	}
+	else
+	{
+		pg = memory::physical_memory_manager::instance()->allocate_zeroed();
+	}
+
+	if (pg == nullptr)
+	{
+		return nullptr;
+	}
+
+	return reinterpret_cast<vmm::pde_ptr_t>(pmm::page_to_va(pg));
 }
 
 void vmm::pgdir_entry_free(vmm::pde_ptr_t entry)
 {
-	kmem_cache_free(pgdir_cache, entry);
+	KDEBUG_ASSERT(table_empty(entry));
+
+	auto pg = pmm::va_to_page((uintptr_t)entry);
+
+	if (!cpu.is_valid())
+	{
+		memory::physical_memory_manager::instance()->free(pg);
+		return;
+	}
+
+	auto state = arch_interrupt_save();
+	auto _ = gsl::finally([&state]()
+	{
+	  arch_interrupt_restore(state);
+	});
+
+	auto& pcp = cpu->pgtable_cache;
+
+	pcp.push_hot(pg);
+	pcp.stats().free_hits++;
+
+	if (pcp.above_high())
+	{
+		pgtable_drain(pcp, memory::per_cpu_pages::BATCH);
+	}
 }
 
 void vmm::unmap_range(pde_ptr_t pgdir, uintptr_t start, uintptr_t end)
+{
+	memory::tlb_batch batch{ pgdir };
+	unmap_range(pgdir, start, end, batch);
+}
+
+void vmm::unmap_range(pde_ptr_t pgdir, uintptr_t start, uintptr_t end, memory::tlb_batch& batch)
 {
 	KDEBUG_ASSERT(start % PAGE_SIZE == 0 && end % PAGE_SIZE == 0);
 	KDEBUG_ASSERT(VALID_USER_REGION(start, end));
 
-	for (uintptr_t addr = start; addr <= end; addr += PAGE_SIZE)
+	for (uintptr_t addr = start; addr < end;)
 	{
 		auto pte = walk_pgdir(pgdir, addr, false);
 
-		if ((*pte) & PG_P)
+		// a 2mb page is unmapped as a whole
+		size_t step = (pte != nullptr && (*pte & PG_PS)) ? LARGE_PAGE_SIZE : PAGE_SIZE;
+		if (step == LARGE_PAGE_SIZE)
 		{
-			*pte = 0;
-			memory::physical_memory_manager::instance()->flush_tlb(pgdir, addr);
+			addr = LARGE_PAGE_ROUNDDOWN(addr);
 		}
+
+		if (pte != nullptr && ((*pte) & PG_P))
+		{
+			// drop the reference, so that a page shared copy-on-write is freed by its last user
+			memory::physical_memory_manager::instance()->remove_page(addr, pgdir, batch);
+		}
+
+		addr += step;
 	}
+
+	free_range(pgdir, start, end, batch);
 }
 
 // the range must be unmapped
+// free the page tables that no longer map anything and lie wholly in the range
 void vmm::free_range(pde_ptr_t pml4t, uintptr_t start, uintptr_t end)
+{
+	memory::tlb_batch batch{ pml4t };
+	free_range(pml4t, start, end, batch);
+}
+
+void vmm::free_range(pde_ptr_t pml4t, uintptr_t start, uintptr_t end, memory::tlb_batch& batch)
 {
 	KDEBUG_ASSERT(start % PAGE_SIZE == 0 && end % PAGE_SIZE == 0);
 	KDEBUG_ASSERT(VALID_USER_REGION(start, end));
 
-	do_free_range_pml4t(pml4t, start, end);
+	release_empty_tables(pml4t, 4, 0, start, end, batch);
 }
 
-void vmm::copy_range(pde_ptr_t from, pde_ptr_t to, uintptr_t start, uintptr_t end)
+error_code vmm::copy_range(pde_ptr_t from, pde_ptr_t to, uintptr_t start, uintptr_t end, memory::tlb_batch& batch)
 {
-	for (uintptr_t addr = start; addr <= end; addr += PAGE_SIZE)
+	for (uintptr_t addr = start; addr < end;)
 	{
 		auto pte = walk_pgdir(from, addr, false);
 
-		if ((*pte) & PG_P)
+		size_t step = (pte != nullptr && (*pte & PG_PS)) ? LARGE_PAGE_SIZE : PAGE_SIZE;
+		if (step == LARGE_PAGE_SIZE)
 		{
-			auto perm = *pte & (PG_P | PG_W | PG_U);
+			addr = LARGE_PAGE_ROUNDDOWN(addr);
+		}
+
+		if (pte != nullptr && ((*pte) & PG_P))
+		{
+			// writable pages are shared read-only by both sides, and copied on the first write to them
+			auto entry = *pte;
+			const bool shared = entry & (PG_W | PG_COW);
+
+			auto perm = (entry & (PG_U | PG_PS)) | (shared ? PG_COW : 0);
+
+			// the child's reference is taken before the parent loses write access,
+			// so that a write fault of the parent never sees the page copy-on-write but unshared
+			if (auto ret = memory::physical_memory_manager::instance()->insert_page(pmm::pde_to_page(pte),
+					addr,
+					perm,
+					to,
+					false);
+				ret != ERROR_SUCCESS)
+			{
+				return ret;
+			}
+
+			// the accessed and dirty bits are set by the hardware meanwhile, and mustn't be lost
+			if (shared)
+			{
+				while (!kbl::integral_atomic_ref<pde_t>{ *pte }.compare_exchange_strong(entry,
+					(entry & ~PG_W) | PG_COW))
+				{
+				}
 
-			memory::physical_memory_manager::instance()->insert_page(pmm::pde_to_page(pte), addr, perm, to, true);
-//			pmm::page_insert(to, true, pmm::pde_to_page(pte), addr, perm);
+				batch.add_range(addr, addr + step);
+			}
 		}
+
+		addr += step;
 	}
+
+	return ERROR_SUCCESS;
 }
 
 error_code vmm::map_range(pde_ptr_t pgdir, uintptr_t va_start, uintptr_t pa_start, size_t len)
@@ -317,6 +488,11 @@ error_code vmm::map_range(pde_ptr_t pgdir, uintptr_t va_start, uintptr_t pa_star
 
 void vmm::install_kernel_pml4t()
 {
+	if (cpu.is_valid())
+	{
+		memory::tlb_activate(g_kpml4t);
+	}
+
 	lcr3(V2P((uintptr_t)g_kpml4t));
 }
 
@@ -332,8 +508,7 @@ void vmm::duplicate_kernel_pml4t(OUT pde_ptr_t pml4t)
 
 uintptr_t vmm::pde_to_pa(pde_ptr_t pde)
 {
-	constexpr size_t FLAGS_SHIFT = 8;
-	return ((((*pde) >> FLAGS_SHIFT) << FLAGS_SHIFT) & (~PG_PS));
+	return (*pde) & PTE_ADDR_MASK;
 }
 
 pde_ptr_t vmm::walk_pgdir(pde_ptr_t pgdir, size_t va, bool create)
@@ -341,6 +516,11 @@ pde_ptr_t vmm::walk_pgdir(pde_ptr_t pgdir, size_t va, bool create)
 	return ::walk_pgdir(pgdir, va, create, PG_U | PG_W);
 }
 
+pde_ptr_t vmm::walk_pgdir_large(pde_ptr_t pgdir, size_t va, bool create)
+{
+	return ::walk_pgdir(pgdir, va, create, PG_U | PG_W, true);
+}
+
 // When called by pmm, first map [0,2GiB] to [KERNEL_VIRTUALBASE,KERNEL_VIRTUALEND]
 // and then map all the memories to PHYREMAP_VIRTUALBASE
 
@@ -349,7 +529,8 @@ void vmm::paging_init()
 	constexpr auto PAGING_INIT_DEFAULT_PERM = PG_W | PG_U;
 
 	// map the kernel memory: [0,2GiB] to [KERNEL_VIRTUALBASE,KERNEL_VIRTUALEND]
-	if (auto ret = map_pages(g_kpml4t, KERNEL_VIRTUALBASE, 0, KERNEL_SIZE, PAGING_INIT_DEFAULT_PERM);ret
+	// the kernel and the physical memory remapping are covered by 2mb pages to save page tables
+	if (auto ret = map_pages(g_kpml4t, KERNEL_VIRTUALBASE, 0, KERNEL_SIZE, PAGING_INIT_DEFAULT_PERM, true);ret
 		== -ERROR_MEMORY_ALLOC)
 	{
 		KDEBUG_GENERALPANIC("Can't allocate enough space for paging.\n");
@@ -374,9 +555,10 @@ void vmm::paging_init()
 	{
 		max_pa = std::max(max_pa, std::min(entry.addr + entry.len, (unsigned long long)PHYMEMORY_SIZE));
 	}
+	max_pa = LARGE_PAGE_ROUNDUP(max_pa);
 
 	// remap all the physical memory
-	if (auto ret = map_pages(g_kpml4t, PHYREMAP_VIRTUALBASE, 0, max_pa, PAGING_INIT_DEFAULT_PERM); ret
+	if (auto ret = map_pages(g_kpml4t, PHYREMAP_VIRTUALBASE, 0, max_pa, PAGING_INIT_DEFAULT_PERM, true); ret
 		== -ERROR_MEMORY_ALLOC)
 	{
 		KDEBUG_GENERALPANIC("Can't allocate enough space for paging.\n");
@@ -394,13 +576,20 @@ void vmm::paging_init()
 		if (entry.type != MULTIBOOT_MEMORY_AVAILABLE)
 		{
 			auto perm = PAGING_INIT_DEFAULT_PERM | PG_PWT | PG_PCD;
-			auto vaddr = PAGE_ROUNDDOWN(P2V_PHYREMAP(entry.addr)),
-				vend = PAGE_ROUNDDOWN(P2V_PHYREMAP(entry.addr + entry.len));
-			for (uintptr_t addr = vaddr; addr <= vend; addr += PAGE_SIZE)
+			auto vaddr = LARGE_PAGE_ROUNDDOWN(P2V_PHYREMAP(entry.addr)),
+				vend = LARGE_PAGE_ROUNDDOWN(P2V_PHYREMAP(entry.addr + entry.len));
+			for (uintptr_t addr = vaddr; addr <= vend; addr += LARGE_PAGE_SIZE)
 			{
-				auto pte = walk_pgdir(g_kpml4t, addr, false);
-				*pte |= perm;
+				auto pde = walk_pgdir(g_kpml4t, addr, false, 0, true);
+				if (pde != nullptr && (*pde & PG_P))
+				{
+					*pde |= perm;
+				}
 			}
 		}
 	}
+
+	// regions mapped after boot
+	reserve_kernel_region(g_kpml4t, KSTACK_VIRTUALBASE, KSTACK_VIRTUALEND);
+	reserve_kernel_region(g_kpml4t, VMALLOC_VIRTUALBASE, VMALLOC_VIRTUALEND);
 }
@@ -0,0 +1,243 @@
+#include "memory/teardown.hpp"
+#include "memory/tlb.hpp"
+#include "memory/page.hpp"
+#include "memory/pmm.hpp"
+
+#include "system/mmu.h"
+#include "system/pmm.h"
+#include "system/vmm.h"
+
+#include "drivers/acpi/cpu.h"
+#include "debug/kdebug.h"
+
+#include "task/thread/thread.hpp"
+#include "task/scheduler/scheduler.hpp"
+
+#include "kbl/lock/lock_guard.hpp"
+#include "kbl/lock/semaphore.hpp"
+#include "kbl/data/pod_list.h"
+
+#include <cstring>
+
+using namespace memory;
+using namespace kbl;
+
+using lock::lock_guard;
+
+// page tables waiting for the thread, chained by page_link of the page holding their PML4
+static list_head dead_pgdirs{ &dead_pgdirs, &dead_pgdirs };
+static lock::spinlock dead_lock{ "teardown" };
+
+// kernel ranges waiting to be unmapped, each kept in the range itself
+static list_head dead_ranges{ &dead_ranges, &dead_ranges };
+
+static semaphore dead_sem{};
+
+// set when a page table was queued by a CPU holding the thread lock, which can't signal the semaphore
+static bool wake_due{ false };
+
+// the level of the tables a PML4 entry points to, the page tables themselves are at level 1
+constexpr size_t PDPT_LEVEL = 3;
+
+static void wait_inactive(vmm::pde_ptr_t pgdir)
+{
+	auto pa = V2P((uintptr_t)pgdir);
+
+	// nothing can load the page table again, and CPUs drop it on their next switch.
+	// CR3 reloads discard the user entries, so there is nothing left to shoot down afterwards.
+	// yield only asks for a switch, which the kernel doesn't act on before returning to user mode, so switch out here
+	for (auto& core: valid_cpus)
+	{
+		while (__atomic_load_n(&core.tlb.active_pgdir, __ATOMIC_SEQ_CST) == pa)
+		{
+			task::scheduler::current::reschedule();
+		}
+	}
+}
+
+// drop the pages mapped through table and free it along with the tables below it
+static void release_table(vmm::pde_ptr_t table, size_t level, tlb_batch& batch, size_t& released)
+{
+	for (size_t i = 0; i < PTENTRIES_COUNT; i++)
+	{
+		auto entry = &table[i];
+		if (!((*entry) & PG_P))
+		{
+			continue;
+		}
+
+		if (level > 1 && !((*entry) & PG_PS))
+		{
+			release_table(reinterpret_cast<vmm::pde_ptr_t>(P2V((*entry) & PTE_ADDR_MASK)), level - 1, batch, released);
+			*entry = 0;
+			continue;
+		}
+
+		bool large = (*entry) & PG_PS;
+		KDEBUG_ASSERT(!large || level == 2);
+
+		auto pg = pmm::pde_to_page(entry);
+		*entry = 0;
+
+		// pages shared copy-on-write live on in the other address spaces
+		if (page_ref_dec(pg) == 0)
+		{
+			batch.defer_free(pg, large ? LARGE_PAGE_PAGES : 1);
+		}
+
+		released += large ? LARGE_PAGE_PAGES : 1;
+		if (released >= TEARDOWN_BATCH_PAGES)
+		{
+			batch.flush();
+			released = 0;
+
+			task::scheduler::current::reschedule();
+		}
+	}
+
+	vmm::pgdir_entry_free(table);
+}
+
+static void teardown(vmm::pde_ptr_t pml4t)
+{
+	wait_inactive(pml4t);
+
+	tlb_batch batch{ pml4t };
+	size_t released = 0;
+
+	// the kernel half, and whatever the kernel maps below it, is shared with every address space
+	for (size_t i = 0; i <= P4X(USER_TOP); i++)
+	{
+		if (!(pml4t[i] & PG_P) || pml4t[i] == vmm::g_kpml4t[i])
+		{
+			continue;
+		}
+
+		release_table(reinterpret_cast<vmm::pde_ptr_t>(P2V(pml4t[i] & PTE_ADDR_MASK)), PDPT_LEVEL, batch, released);
+		pml4t[i] = 0;
+	}
+
+	batch.flush();
+
+	// tables are freed all zero
+	memset(pml4t, 0, PGTABLE_SIZE);
+	vmm::pgdir_entry_free(pml4t);
+}
+
+static void unmap_kernel_range(uintptr_t start, uintptr_t end)
+{
+	tlb_batch batch{ vmm::g_kpml4t };
+
+	for (uintptr_t va = start; va < end; va += PAGE_SIZE)
+	{
+		physical_memory_manager::instance()->remove_page(va, vmm::g_kpml4t, batch);
+	}
+
+	batch.flush();
+}
+
+static void release_kernel_ranges()
+{
+	for (;;)
+	{
+		kernel_range range{};
+		{
+			lock_guard g{ dead_lock };
+			if (list_empty(&dead_ranges))
+			{
+				break;
+			}
+
+			// copied out, because the node goes away with the first page of the range
+			auto node = list_entry(dead_ranges.next, kernel_range, link);
+			list_remove(&node->link);
+			range = *node;
+		}
+
+		unmap_kernel_range(range.start, range.end);
+		range.release(range.start, range.end);
+	}
+}
+
+[[noreturn]] static error_code teardown_routine([[maybe_unused]] void* arg)
+{
+	for (;;)
+	{
+		[[maybe_unused]] auto ret = dead_sem.wait();
+
+		release_kernel_ranges();
+
+		for (;;)
+		{
+			page* pg = nullptr;
+			{
+				lock_guard g{ dead_lock };
+				if (list_empty(&dead_pgdirs))
+				{
+					break;
+				}
+
+				pg = list_entry(dead_pgdirs.next, page, page_link);
+				list_remove(&pg->page_link);
+			}
+
+			teardown(reinterpret_cast<vmm::pde_ptr_t>(pmm::page_to_va(pg)));
+		}
+	}
+}
+
+static void wake()
+{
+	if (task::global_thread_lock.holding())
+	{
+		__atomic_store_n(&wake_due, true, __ATOMIC_RELEASE);
+		return;
+	}
+
+	dead_sem.signal();
+}
+
+void memory::teardown_defer(vmm::pde_ptr_t pgdir)
+{
+	{
+		lock_guard g{ dead_lock };
+		list_add_tail(&pmm::va_to_page((uintptr_t)pgdir)->page_link, &dead_pgdirs);
+	}
+
+	wake();
+}
+
+void memory::teardown_defer_kernel_range(uintptr_t start, uintptr_t end, void (*release)(uintptr_t, uintptr_t))
+{
+	KDEBUG_ASSERT(start % PAGE_SIZE == 0 && start < end);
+
+	auto node = reinterpret_cast<kernel_range*>(start);
+	*node = kernel_range{ start, end, release, {}};
+
+	{
+		lock_guard g{ dead_lock };
+		list_add_tail(&node->link, &dead_ranges);
+	}
+
+	wake();
+}
+
+void memory::teardown_wake_if_needed()
+{
+	if (__atomic_exchange_n(&wake_due, false, __ATOMIC_ACQ_REL))
+	{
+		dead_sem.signal();
+	}
+}
+
+void memory::teardown_init()
+{
+	auto ret = task::thread::create(nullptr, "teardown", teardown_routine, nullptr);
+	if (has_error(ret))
+	{
+		KDEBUG_GERNERALPANIC_CODE(get_error_code(ret));
+	}
+
+	lock_guard g{ task::global_thread_lock };
+	task::scheduler::current::unblock(get_result(ret));
+}
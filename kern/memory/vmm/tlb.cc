@@ -0,0 +1,300 @@
+// Copyright (c) 2021 SmartPolarBear
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "memory/tlb.hpp"
+#include "memory/pmm.hpp"
+
+#include "arch/amd64/cpu/x86.h"
+#include "arch/amd64/cpu/intrinsics.hpp"
+
+#include "system/memlayout.h"
+#include "system/mmu.h"
+#include "system/pmm.h"
+
+#include "drivers/acpi/cpu.h"
+#include "drivers/apic/traps.h"
+#include "drivers/apic/local_apic.hpp"
+
+#include "debug/kdebug.h"
+
+#include "kbl/data/pod_list.h"
+
+#include <gsl/util>
+
+using namespace memory;
+
+namespace
+{
+
+// the shootdown in flight. It is written by the initiator before any IPI is sent,
+// and stays unchanged until every target has acknowledged it.
+struct shootdown_request
+{
+	// 0 to target every CPU, for the kernel page table shared by all address spaces
+	uintptr_t pgdir_pa;
+
+	uintptr_t starts[tlb_batch::MAX_RANGES];
+	uintptr_t ends[tlb_batch::MAX_RANGES];
+	size_t range_count;
+
+	bool full;
+
+	// targets yet to acknowledge
+	size_t pending;
+} request{};
+
+// only one shootdown is in flight at a time
+bool in_flight{ false };
+
+}
+
+static void invalidate_local(uintptr_t pgdir_pa,
+	const uintptr_t* starts,
+	const uintptr_t* ends,
+	size_t count,
+	bool full)
+{
+	// a CPU that has switched to another page table has lost the entries when it reloaded CR3
+	if (pgdir_pa != 0 && rcr3() != pgdir_pa)
+	{
+		return;
+	}
+
+	if (full)
+	{
+		lcr3(rcr3());
+		return;
+	}
+
+	for (size_t i = 0; i < count; i++)
+	{
+		for (uintptr_t va = starts[i]; va < ends[i]; va += PAGE_SIZE)
+		{
+			invlpg((void*)va);
+		}
+	}
+}
+
+// answer the request if the initiator has marked this CPU
+static void handle_pending()
+{
+	if (!__atomic_exchange_n(&cpu->tlb.pending, false, __ATOMIC_ACQ_REL))
+	{
+		return;
+	}
+
+	invalidate_local(request.pgdir_pa, request.starts, request.ends, request.range_count, request.full);
+
+	__atomic_fetch_sub(&request.pending, 1, __ATOMIC_RELEASE);
+}
+
+static error_code tlb_shootdown_trap_handle([[maybe_unused]] trap::trap_frame info)
+{
+	handle_pending();
+	return ERROR_SUCCESS;
+}
+
+static void begin_shootdown()
+{
+	while (__atomic_exchange_n(&in_flight, true, __ATOMIC_ACQUIRE))
+	{
+		// the CPU in flight may be waiting for this one, which has interrupts disabled
+		handle_pending();
+		arch::cpu_yield();
+	}
+}
+
+static void end_shootdown()
+{
+	__atomic_store_n(&in_flight, false, __ATOMIC_RELEASE);
+}
+
+void memory::tlb_init()
+{
+	trap::trap_handle_register(trap::IRQ_TO_TRAPNUM(trap::IRQ_TLB_SHOOTDOWN), trap::trap_handle{
+		.handle = tlb_shootdown_trap_handle,
+		.enable = true });
+}
+
+void memory::tlb_activate(vmm::pde_ptr_t pgdir)
+{
+	// pairs with the fence in tlb_batch::flush, so that either the initiator sees this CPU as a target,
+	// or this CPU loads CR3 after the page table has been changed
+	__atomic_store_n(&cpu->tlb.active_pgdir, V2P((uintptr_t)pgdir), __ATOMIC_SEQ_CST);
+}
+
+void memory::tlb_flush_page(vmm::pde_ptr_t pgdir, uintptr_t va)
+{
+	tlb_batch batch{ pgdir };
+	batch.add_range(PAGE_ROUNDDOWN(va), PAGE_ROUNDDOWN(va) + PAGE_SIZE);
+	batch.flush();
+}
+
+tlb_batch::tlb_batch(vmm::pde_ptr_t pgdir)
+	: pgdir_{ pgdir }
+{
+	kbl::list_init(&free_list_);
+	kbl::list_init(&table_list_);
+}
+
+tlb_batch::~tlb_batch()
+{
+	flush();
+}
+
+void tlb_batch::add_range(uintptr_t start, uintptr_t end)
+{
+	KDEBUG_ASSERT(start % PAGE_SIZE == 0 && end % PAGE_SIZE == 0);
+
+	if (full_ || start >= end)
+	{
+		return;
+	}
+
+	page_count_ += (end - start) / PAGE_SIZE;
+	if (page_count_ > FULL_FLUSH_THRESHOLD)
+	{
+		full_ = true;
+		return;
+	}
+
+	if (range_count_ > 0 && ranges_[range_count_ - 1].end == start)
+	{
+		ranges_[range_count_ - 1].end = end;
+		return;
+	}
+
+	if (range_count_ == MAX_RANGES)
+	{
+		full_ = true;
+		return;
+	}
+
+	ranges_[range_count_++] = range{ start, end };
+}
+
+void tlb_batch::defer_free(page* pg, size_t n)
+{
+	pg->property = n;
+	kbl::list_add_tail(&pg->page_link, &free_list_);
+}
+
+void tlb_batch::defer_free_table(vmm::pde_ptr_t table, uintptr_t start, uintptr_t end)
+{
+	add_range(start, end);
+	kbl::list_add_tail(&pmm::va_to_page((uintptr_t)table)->page_link, &table_list_);
+}
+
+void tlb_batch::flush()
+{
+	if (!empty())
+	{
+		auto state = arch_interrupt_save();
+		auto _ = gsl::finally([&state]()
+		{
+		  arch_interrupt_restore(state);
+		});
+
+		uintptr_t starts[MAX_RANGES]{}, ends[MAX_RANGES]{};
+		for (size_t i = 0; i < range_count_; i++)
+		{
+			starts[i] = ranges_[i].start;
+			ends[i] = ranges_[i].end;
+		}
+
+		bool kernel = pgdir_ == vmm::g_kpml4t;
+		uintptr_t pgdir_pa = kernel ? 0 : V2P((uintptr_t)pgdir_);
+
+		invalidate_local(pgdir_pa, starts, ends, range_count_, full_);
+
+		if (cpu.is_valid() && valid_cpus.size() > 1)
+		{
+			// the entries must be cleared before deciding which CPUs may still cache them
+			__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+			begin_shootdown();
+
+			request.pgdir_pa = pgdir_pa;
+			request.range_count = range_count_;
+			request.full = full_;
+			for (size_t i = 0; i < range_count_; i++)
+			{
+				request.starts[i] = starts[i];
+				request.ends[i] = ends[i];
+			}
+
+			cpu_struct* targets[CPU_COUNT_LIMIT]{};
+			size_t target_count = 0;
+			for (auto& core: valid_cpus)
+			{
+				if (&core == cpu.get() || !core.started)
+				{
+					continue;
+				}
+
+				if (!kernel && __atomic_load_n(&core.tlb.active_pgdir, __ATOMIC_SEQ_CST) != pgdir_pa)
+				{
+					continue;
+				}
+
+				targets[target_count++] = &core;
+			}
+
+			__atomic_store_n(&request.pending, target_count, __ATOMIC_RELEASE);
+
+			for (size_t i = 0; i < target_count; i++)
+			{
+				__atomic_store_n(&targets[i]->tlb.pending, true, __ATOMIC_RELEASE);
+				apic::local_apic::apic_send_ipi(targets[i]->apicid,
+					apic::local_apic::DLM_FIXED,
+					trap::IRQ_TO_TRAPNUM(trap::IRQ_TLB_SHOOTDOWN));
+			}
+
+			while (__atomic_load_n(&request.pending, __ATOMIC_ACQUIRE) != 0)
+			{
+				arch::cpu_yield();
+			}
+
+			end_shootdown();
+		}
+	}
+
+	// no CPU can reach the pages now
+	while (!kbl::list_empty(&free_list_))
+	{
+		auto entry = free_list_.next;
+		kbl::list_remove(entry);
+
+		auto pg = list_entry(entry, page, page_link);
+		physical_memory_manager::instance()->free(pg, pg->property);
+	}
+
+	while (!kbl::list_empty(&table_list_))
+	{
+		auto entry = table_list_.next;
+		kbl::list_remove(entry);
+
+		vmm::pgdir_entry_free(reinterpret_cast<vmm::pde_ptr_t>(pmm::page_to_va(list_entry(entry, page, page_link))));
+	}
+
+	range_count_ = 0;
+	page_count_ = 0;
+	full_ = false;
+}
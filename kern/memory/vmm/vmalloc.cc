@@ -0,0 +1,196 @@
+// Copyright (c) 2021 SmartPolarBear
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "system/kmalloc.hpp"
+#include "system/memlayout.h"
+#include "system/mmu.h"
+#include "system/pmm.h"
+#include "system/vmm.h"
+
+#include "memory/pmm.hpp"
+#include "memory/teardown.hpp"
+
+#include "debug/kdebug.h"
+
+#include "kbl/checker/allocate_checker.hpp"
+#include "kbl/lock/spinlock.h"
+#include "kbl/lock/lock_guard.hpp"
+
+using namespace memory;
+using namespace lock;
+
+struct vmalloc_area
+{
+	uintptr_t start;
+	size_t page_count;
+
+	list_head link;
+};
+
+static spinlock vmalloc_lock{ "vmalloc" };
+
+// areas in use, sorted by address
+static list_head vmalloc_areas TA_GUARDED(vmalloc_lock){ &vmalloc_areas, &vmalloc_areas };
+
+// find a free range for page_count pages and a guard page after them, first fit
+static error_code reserve_range(vmalloc_area* area)
+{
+	lock_guard g{ vmalloc_lock };
+
+	const size_t size = (area->page_count + 1) * PAGE_SIZE;
+
+	uintptr_t candidate = VMALLOC_VIRTUALBASE;
+	list_head* prev = &vmalloc_areas;
+
+	list_head* iter = nullptr;
+	list_for(iter, &vmalloc_areas)
+	{
+		auto used = list_entry(iter, vmalloc_area, link);
+		if (candidate + size <= used->start)
+		{
+			break;
+		}
+
+		candidate = used->start + (used->page_count + 1) * PAGE_SIZE;
+		prev = iter;
+	}
+
+	if (candidate + size > VMALLOC_VIRTUALEND)
+	{
+		return -ERROR_MEMORY_ALLOC;
+	}
+
+	area->start = candidate;
+	kbl::list_add(&area->link, prev);
+
+	return ERROR_SUCCESS;
+}
+
+static vmalloc_area* find_area_locked(uintptr_t start) TA_REQ(vmalloc_lock)
+{
+	list_head* iter = nullptr;
+	list_for(iter, &vmalloc_areas)
+	{
+		auto used = list_entry(iter, vmalloc_area, link);
+		if (used->start == start)
+		{
+			return used;
+		}
+	}
+
+	return nullptr;
+}
+
+// called by the teardown thread once the area is unmapped, so the range isn't reused while a CPU may still reach it
+static void release_area(uintptr_t start, [[maybe_unused]] uintptr_t end)
+{
+	vmalloc_area* area = nullptr;
+	{
+		lock_guard g{ vmalloc_lock };
+
+		area = find_area_locked(start);
+		KDEBUG_ASSERT(area != nullptr);
+
+		kbl::list_remove(&area->link);
+	}
+
+	delete area;
+}
+
+// kfree falls back to vfree, and is called with locks held and interrupts off all over the kernel.
+// the shootdown of the kernel page table waits for every CPU, so it's left to the teardown thread
+static void unmap_area_range(vmalloc_area* area, uintptr_t end)
+{
+	if (area->start == end)
+	{
+		release_area(area->start, end);
+		return;
+	}
+
+	teardown_defer_kernel_range(area->start, end, release_area);
+}
+
+void* memory::vmalloc(size_t sz)
+{
+	if (sz == 0)
+	{
+		return nullptr;
+	}
+
+	kbl::allocate_checker ck{};
+	auto area = new(&ck) vmalloc_area{ 0, PAGE_ROUNDUP(sz) / PAGE_SIZE, {}};
+	if (!ck.check())
+	{
+		return nullptr;
+	}
+
+	if (reserve_range(area) != ERROR_SUCCESS)
+	{
+		delete area;
+		return nullptr;
+	}
+
+	// single frames, so that fragmentation of the buddy allocator doesn't matter
+	const uintptr_t end = area->start + area->page_count * PAGE_SIZE;
+	for (uintptr_t va = area->start; va < end; va += PAGE_SIZE)
+	{
+		auto pg = physical_memory_manager::instance()->allocate();
+		if (pg == nullptr ||
+			physical_memory_manager::instance()->insert_page(pg, va, PG_W, vmm::g_kpml4t, false) != ERROR_SUCCESS)
+		{
+			if (pg != nullptr)
+			{
+				physical_memory_manager::instance()->free(pg);
+			}
+
+			unmap_area_range(area, va);
+
+			return nullptr;
+		}
+	}
+
+	return reinterpret_cast<void*>(area->start);
+}
+
+void memory::vfree(void* ptr)
+{
+	if (ptr == nullptr)
+	{
+		return;
+	}
+
+	auto addr = reinterpret_cast<uintptr_t>(ptr);
+	KDEBUG_ASSERT(addr >= VMALLOC_VIRTUALBASE && addr < VMALLOC_VIRTUALEND);
+
+	vmalloc_area* area = nullptr;
+	{
+		lock_guard g{ vmalloc_lock };
+
+		area = find_area_locked(addr);
+		if (area == nullptr)
+		{
+			KDEBUG_RICHPANIC("vfree of memory that isn't from vmalloc", "KERNEL PANIC: VMALLOC", false,
+				"Address: 0x%p\n", addr);
+		}
+	}
+
+	// the range stays reserved until it's unmapped
+	unmap_area_range(area, area->start + area->page_count * PAGE_SIZE);
+}
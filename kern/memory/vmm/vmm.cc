@@ -37,6 +37,9 @@
 #include "drivers/console/console.h"
 #include "debug/kdebug.h"
 
+#include "memory/tlb.hpp"
+#include "memory/kstack.hpp"
+
 #include <cstring>
 #include <algorithm>
 
@@ -64,16 +67,18 @@ using lock::spinlock_holding;
 void vmm::init_vmm(void)
 {
 	// create the global pml4t
-	pgdir_cache_init();
+	pgtable_cache_init();
 
 	g_kpml4t = pgdir_entry_alloc();
 
-	memset(g_kpml4t, 0, PGTABLE_SIZE);
-
 	// register the page fault handle
 	trap::trap_handle_register(trap::TRAP_PGFLT, trap::trap_handle{
 		.handle = handle_pgfault,
 		.enable = true });
+
+	memory::tlb_init();
+
+	memory::kstack_init();
 }
 
 //bool vmm::check_user_memory(IN mm_struct* mm, uintptr_t addr, size_t len, bool writable)
@@ -13,7 +13,7 @@ extern vmm::pde_ptr_t g_kpml4t;
 // page_fualt.cc
 extern error_code handle_pgfault([[maybe_unused]] trap::trap_frame info);
 
-// pgdir_cache.cc
-void pgdir_cache_init();
+// paging.cc
+void pgtable_cache_init();
 
 
@@ -7,6 +7,7 @@
 #include "task/process/process.hpp"
 
 
+// segments are filled from bin on demand, so it must stay resident as long as the process lives
 error_code load_binary(IN task::process* proc,
 	IN uint8_t* bin,
 	IN size_t bin_sz,
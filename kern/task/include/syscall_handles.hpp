@@ -21,6 +21,7 @@ DEF_SYSCALL_HANDLE(default_syscall);
 DEF_SYSCALL_HANDLE(sys_hello);
 DEF_SYSCALL_HANDLE(sys_put_str);
 DEF_SYSCALL_HANDLE(sys_put_char);
+DEF_SYSCALL_HANDLE(sys_dump_alloc_profile);
 
 DEF_SYSCALL_HANDLE(sys_get_current_process);
 DEF_SYSCALL_HANDLE(sys_get_process_by_id);
@@ -28,6 +29,8 @@ DEF_SYSCALL_HANDLE(sys_get_process_by_name);
 
 DEF_SYSCALL_HANDLE(sys_exit);
 DEF_SYSCALL_HANDLE(sys_set_heap);
+DEF_SYSCALL_HANDLE(sys_mmap);
+DEF_SYSCALL_HANDLE(sys_munmap);
 
 DEF_SYSCALL_HANDLE(sys_get_current_thread);
 DEF_SYSCALL_HANDLE(sys_get_thread_by_id);
@@ -21,87 +21,57 @@ using namespace executable;
 
 using namespace memory;
 
-static inline auto parse_ph_flags(const Elf64_Phdr& prog_header)
+static inline size_t parse_ph_flags(const Elf64_Phdr& prog_header)
 {
-	size_t vm_flags = 0, perms = PG_U;
+	size_t vm_flags = 0;
 
-	if (prog_header.p_type & PF_X)
+	if (prog_header.p_flags & PF_X)
 	{
 		vm_flags |= VM_EXEC;
 	}
 
-	if (prog_header.p_type & PF_R)
+	if (prog_header.p_flags & PF_R)
 	{
 		vm_flags |= VM_READ;
 	}
 
-	if (prog_header.p_type & PF_W)
+	if (prog_header.p_flags & PF_W)
 	{
 		vm_flags |= VM_WRITE;
-		perms |= PG_W;
 	}
 
-	return std::make_pair(vm_flags, perms);
+	return vm_flags;
 }
 
+// the segment is only registered here. its pages are filled from bin on the first access to them
 static error_code load_ph(IN const Elf64_Phdr& prog_header,
 	IN const uint8_t* bin,
 	IN task::process* proc)
 {
-	auto[vm_flags, perms] = parse_ph_flags(prog_header);
+	auto vm_flags = parse_ph_flags(prog_header);
 
-//	auto proc_mm = proc->get_mm();
 	auto as = proc->address_space();
 
-//	if ((ret = vmm::mm_map(proc_mm, prog_header.p_vaddr, prog_header.p_memsz, vm_flags, nullptr)) != ERROR_SUCCESS)
-//	{
-//		//TODO do clean-ups
-//		return ret;
-//	}
-
-
 	auto map_ret = as->map(prog_header.p_vaddr, prog_header.p_memsz, vm_flags);
 	if (has_error(map_ret))
 	{
 		return get_error_code(map_ret);
 	}
 
-
-//	if (proc_mm->brk_start < prog_header.p_vaddr + prog_header.p_memsz)
-//	{
-//		proc_mm->brk_start = prog_header.p_vaddr + prog_header.p_memsz;
-//	}
+	// ph->p_filesz <= ph->p_memsz, the remaining is zero-filled
+	get_result(map_ret)->set_backing(bin + prog_header.p_offset, prog_header.p_vaddr, prog_header.p_filesz);
 
 	if (as->heap_begin() < prog_header.p_vaddr + prog_header.p_memsz)
 	{
 		as->set_heap_begin(prog_header.p_vaddr + prog_header.p_memsz);
 	}
 
-	// ph->p_filesz <= ph->p_memsz
-	size_t page_count = PAGE_ROUNDUP(prog_header.p_memsz) / PAGE_SIZE;
-
-	auto alloc_ret =
-		physical_memory_manager::instance()->allocate(prog_header.p_vaddr,
-			page_count,
-			perms,
-			as->pgdir(),
-			false);
-
-	if (has_error(alloc_ret))
-	{
-		return get_error_code(alloc_ret);
-	}
-
-	auto pages = get_result(alloc_ret);
-	memset((uint8_t*)pmm::page_to_va(pages), 0, page_count * PAGE_SIZE);
-	memmove((uint8_t*)pmm::page_to_va(pages), bin + prog_header.p_offset, prog_header.p_filesz);
-
 	return ERROR_SUCCESS;
 }
 
-static inline auto parse_sh_flags(const Elf64_Shdr& shdr)
+static inline size_t parse_sh_flags(const Elf64_Shdr& shdr)
 {
-	size_t vm_flags = VM_READ, perms = PG_U;
+	size_t vm_flags = VM_READ;
 
 	if (shdr.sh_flags & SHF_EXECINSTR)
 	{
@@ -111,64 +81,30 @@ static inline auto parse_sh_flags(const Elf64_Shdr& shdr)
 	if (shdr.sh_flags & SHF_WRITE)
 	{
 		vm_flags |= VM_WRITE;
-		perms |= PG_W;
 	}
 
-	return std::make_pair(vm_flags, perms);
+	return vm_flags;
 }
 
+// the section is registered as a zero-fill segment, unless a PT_LOAD segment covers it already
 static error_code alloc_sh(IN const Elf64_Shdr& shdr,
 	IN  [[maybe_unused]] uint8_t* bin,
 	IN task::process* proc)
 {
-	error_code ret = ERROR_SUCCESS;
-
-	auto[vm_flags, perms] = parse_sh_flags(shdr);
-//	auto proc_mm = proc->get_mm();
-
-//	if ((ret = vmm::mm_map(proc_mm, shdr.sh_addr, shdr.sh_size, vm_flags, nullptr)) != ERROR_SUCCESS)
-//	{
-//		//TODO do clean-ups
-//		return ret;
-//	}
+	auto vm_flags = parse_sh_flags(shdr);
 
+	auto map_ret = proc->address_space()->map(shdr.sh_addr, shdr.sh_size, vm_flags);
+	if (has_error(map_ret) && get_error_code(map_ret) != -ERROR_ALREADY_EXIST)
 	{
-		auto map_ret = proc->address_space()->map(shdr.sh_addr, shdr.sh_size, vm_flags);
-		if (has_error(map_ret))
-		{
-			return ret;
-		}
+		return get_error_code(map_ret);
 	}
 
-//	if (proc_mm->brk_start < shdr.sh_addr + shdr.sh_size)
-//	{
-//		proc_mm->brk_start = shdr.sh_addr + shdr.sh_size;
-//	}
 	if (proc->address_space()->heap_begin() < shdr.sh_addr + shdr.sh_size)
 	{
 		proc->address_space()->set_heap_begin(shdr.sh_addr + shdr.sh_size);
 	}
 
-	size_t page_count = PAGE_ROUNDUP(shdr.sh_size) / PAGE_SIZE;
-
-//	auto alloc_ret =
-//		physical_memory_manager::instance()->allocate(shdr.sh_addr, page_count, perms, proc_mm->pgdir, true);
-	auto alloc_ret =
-		physical_memory_manager::instance()->allocate(shdr.sh_addr,
-			page_count,
-			perms,
-			proc->address_space()->pgdir(),
-			true);
-
-	if (has_error(alloc_ret))
-	{
-		return get_error_code(alloc_ret);
-	}
-
-	// set to zero
-	memset((uint8_t*)pmm::page_to_va(get_result(alloc_ret)), 0, page_count * PAGE_SIZE);
-
-	return ret;
+	return ERROR_SUCCESS;
 }
 
 error_code load_elf_binary(IN task::process* proc,
@@ -84,8 +84,8 @@ error_code_with_result<void*> task::process_user_stack_state::make_next_user_sta
 	{
 		uintptr_t va = current_top - USTACK_USABLE_SIZE_PER_THREAD + i * PAGE_SIZE;
 
-		auto alloc_ret = memory::physical_memory_manager::instance()->allocate(va,
-			PG_W | PG_U | PG_PS | PG_P,
+		auto alloc_ret = memory::physical_memory_manager::instance()->allocate_zeroed(va,
+			PG_W | PG_U | PG_P,
 			as->pgdir(),
 			true);
 
@@ -93,11 +93,13 @@ error_code_with_result<void*> task::process_user_stack_state::make_next_user_sta
 		{
 			return get_error_code(alloc_ret);
 		}
+
+		page_set_rmap(get_result(alloc_ret), as, va);
 	}
 
 	auto guard_page_ret =
-		memory::physical_memory_manager::instance()->allocate(current_top - USTACK_TOTAL_PAGES_PER_THREAD,
-			PG_U | PG_PS | PG_P,
+		memory::physical_memory_manager::instance()->allocate_zeroed(current_top - USTACK_TOTAL_SIZE,
+			PG_U | PG_P,
 			as->pgdir(),
 			true);
 
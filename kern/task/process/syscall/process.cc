@@ -14,6 +14,8 @@
 
 #include "task/process/process.hpp"
 
+#include "memory/address_space.hpp"
+
 #include "object/object_manager.hpp"
 
 #include "builtin_text_io.hpp"
@@ -37,6 +39,74 @@ error_code sys_set_heap(const syscall_regs* regs)
 	return cur_proc->resize_heap(heap_ptr);
 }
 
+error_code sys_mmap(const syscall_regs* regs)
+{
+	auto addr_ptr = args_get<uintptr_t*, 0>(regs);
+	auto len = args_get<size_t, 1>(regs);
+	auto flags = args_get<uint64_t, 2>(regs);
+
+	if (!arg_valid_pointer(addr_ptr) || len == 0)
+	{
+		return -ERROR_INVALID;
+	}
+
+	// pages are faulted in lazily unless MMAP_POPULATE asks otherwise
+	uint64_t vm_flags = 0;
+	if (flags & MMAP_READ)vm_flags |= memory::VM_READ;
+	if (flags & MMAP_WRITE)vm_flags |= memory::VM_WRITE;
+	if (flags & MMAP_EXEC)vm_flags |= memory::VM_EXEC;
+	if (flags & MMAP_HUGE)vm_flags |= memory::VM_LARGE_PAGE;
+
+	const size_t align = (flags & MMAP_HUGE) ? LARGE_PAGE_SIZE : PAGE_SIZE;
+	len = roundup(len, align);
+
+	// fixed mappings stay in the same window as the others, which munmap is restricted to
+	uintptr_t addr = *addr_ptr;
+	if ((flags & MMAP_FIXED) &&
+		((addr % align) != 0 || addr < USER_MMAP_BASE || addr > USER_MMAP_END || len > USER_MMAP_END - addr))
+	{
+		return -ERROR_INVALID;
+	}
+
+	auto as = cur_proc->address_space();
+
+	auto ret = (flags & MMAP_FIXED) ? as->map(addr, len, vm_flags) : as->map_anywhere(addr, len, align, vm_flags);
+	if (has_error(ret))
+	{
+		return get_error_code(ret);
+	}
+
+	addr = get_result(ret)->start();
+
+	if (flags & MMAP_POPULATE)
+	{
+		if (auto err = as->populate(addr, addr + len);err != ERROR_SUCCESS)
+		{
+			as->unmap(addr, len);
+			return err;
+		}
+	}
+
+	*addr_ptr = addr;
+
+	return ERROR_SUCCESS;
+}
+
+error_code sys_munmap(const syscall_regs* regs)
+{
+	auto addr = args_get<uintptr_t, 0>(regs);
+	auto len = args_get<size_t, 1>(regs);
+
+	// the heap and the stacks have their own bookkeeping
+	if ((addr % PAGE_SIZE) != 0 || len == 0 ||
+		addr < USER_MMAP_BASE || addr > USER_MMAP_END || len > USER_MMAP_END - addr)
+	{
+		return -ERROR_INVALID;
+	}
+
+	return cur_proc->address_space()->unmap(addr, len);
+}
+
 error_code sys_get_current_process(const syscall_regs* regs)
 {
 	if (!cur_proc.is_valid())
@@ -0,0 +1,121 @@
+#include "internals/thread.hpp"
+
+#include "task/scheduler/scheduler.hpp"
+#include "task/scheduler/topology.hpp"
+
+#include "system/scheduler.h"
+
+#include "drivers/acpi/cpu.h"
+
+#include "ktl/algorithm.hpp"
+
+using namespace task;
+
+bool task::scheduler::cache_hot(const thread* t) const
+{
+	auto& st = t->scheduler_state_;
+	return st.last_cpu_ == owner_cpu->id &&
+		__atomic_load_n(&ticks_, __ATOMIC_RELAXED) - st.last_ran_tick_ < CACHE_HOT_TICKS;
+}
+
+cpu_struct* task::scheduler::find_busiest(cpu_struct* self, topology_level level, size_type& busiest_load)
+{
+	cpu_struct* busiest = nullptr;
+	busiest_load = 0;
+
+	for (auto& c: valid_cpus)
+	{
+		if (&c == self || !topology_shares(self, &c, level))
+		{
+			continue;
+		}
+
+		// sampled one run queue at a time. a stale load at worst costs a pass that moves nothing
+		auto load = c.scheduler->workload_size();
+		if (load > busiest_load)
+		{
+			busiest = &c;
+			busiest_load = load;
+		}
+	}
+
+	return busiest;
+}
+
+void task::scheduler::balance()
+{
+	auto now = __atomic_add_fetch(&ticks_, 1, __ATOMIC_RELAXED);
+
+	for (size_t i = 0; i < TOPOLOGY_LEVEL_COUNT; i++)
+	{
+		auto level = (topology_level)i;
+		auto& st = balance_states_[level];
+
+		auto base_interval = BALANCE_INTERVAL_MIN << level;
+		if (st.interval == 0)
+		{
+			st.interval = base_interval;
+		}
+
+		if (now < st.next_tick)
+		{
+			continue;
+		}
+
+		size_type busiest_load = 0;
+		auto busiest = find_busiest(owner_cpu, level, busiest_load);
+		auto load = workload_size();
+
+		// moving one thread out of a difference of one only swaps the roles, so at least two are needed.
+		// beyond that, the difference must be large relative to the load, so that it doesn't flip back and forth
+		bool imbalanced = busiest != nullptr &&
+			busiest_load >= load + 2 &&
+			busiest_load * 100 > load * (100 + BALANCE_IMBALANCE_PERCENT[level]);
+
+		if (!imbalanced)
+		{
+			st.failures = 0;
+			st.interval = ktl::min(st.interval * 2, base_interval * BALANCE_BACKOFF_MAX);
+			st.next_tick = now + st.interval;
+			continue;
+		}
+
+		// threads keep their cache when moved within a last level cache. beyond it, the ones
+		// that ran recently stay, unless nothing else could be moved for a while
+		bool allow_hot = !topology_crosses_cache(level) || st.failures >= BALANCE_FAILURES_MAX;
+
+		st.interval = base_interval;
+		st.next_tick = now + st.interval;
+
+		if (!migrate(busiest->scheduler, this, allow_hot))
+		{
+			st.failures++;
+			continue;
+		}
+
+		st.failures = 0;
+
+		// a thread a tick, so that the closer levels see the new loads before the farther ones act
+		break;
+	}
+}
+
+void task::scheduler::balance_idle()
+{
+	for (size_t i = 0; i < TOPOLOGY_LEVEL_COUNT; i++)
+	{
+		auto level = (topology_level)i;
+
+		size_type busiest_load = 0;
+		auto busiest = find_busiest(owner_cpu, level, busiest_load);
+		if (busiest == nullptr)
+		{
+			continue;
+		}
+
+		if (migrate(busiest->scheduler, this, !topology_crosses_cache(level)))
+		{
+			return;
+		}
+	}
+}
@@ -19,26 +19,11 @@ using namespace lock;
 
 void task::fcfs_scheduler_class::enqueue(task::thread* thread)
 {
-	KDEBUG_ASSERT(cpu->id == parent_->owner_cpu->id);
-
-	lock_guard lk_this{ lock_ };
-
-	if (thread->state == thread::thread_states::DYING)
-	{
-		zombie_queue_.push_back(thread);
-	}
-	else
-	{
-		run_queue_.push_back(thread);
-	}
+	run_queue_.push_back(thread);
 }
 
 void task::fcfs_scheduler_class::dequeue(task::thread* thread)
 {
-	KDEBUG_ASSERT(cpu->id == parent_->owner_cpu->id);
-
-	lock_guard lk_this{ lock_ };
-
 	KDEBUG_ASSERT(thread->run_queue_link.is_valid());
 
 	if (!thread->run_queue_link.is_empty_or_detached())
@@ -51,8 +36,6 @@ task::thread* task::fcfs_scheduler_class::fetch()
 {
 	KDEBUG_ASSERT(cpu->id == parent_->owner_cpu->id);
 
-	lock_guard lk_this{ lock_ };
-
 	if (run_queue_.empty())
 	{
 		return nullptr;
@@ -68,24 +51,11 @@ void task::fcfs_scheduler_class::tick()
 {
 	KDEBUG_ASSERT(cpu->id == parent_->owner_cpu->id);
 
-	lock_guard lk_this{ lock_ };
-
-	while (!zombie_queue_.empty())
-	{
-		auto t = zombie_queue_.front_ptr();
-		zombie_queue_.pop_front();
-
-		t->finish_dead_transition();
-	}
-
 	cur_thread->get_scheduler_state()->set_need_reschedule(true);
 }
 
-task::thread* task::fcfs_scheduler_class::steal(cpu_struct* stealer_cpu)
+task::thread* task::fcfs_scheduler_class::steal(cpu_struct* stealer_cpu, bool allow_hot)
 {
-
-	lock_guard lk_this{ lock_ };
-
 	if (run_queue_.empty())
 	{
 		return nullptr;
@@ -97,7 +67,8 @@ task::thread* task::fcfs_scheduler_class::steal(cpu_struct* stealer_cpu)
 		if (cur_thread.get() != &t &&
 			t.state == thread::thread_states::READY &&
 			(t.flags_ & thread::thread_flags::FLAG_IDLE) == 0 &&
-			(t.flags_ & thread::thread_flags::FLAG_INIT) == 0)
+			(t.flags_ & thread::thread_flags::FLAG_INIT) == 0 &&
+			(allow_hot || !parent_->cache_hot(&t)))
 		{
 			if (t.scheduler_state_.affinity()->cpu == stealer_cpu->id)
 			{
@@ -112,7 +83,8 @@ task::thread* task::fcfs_scheduler_class::steal(cpu_struct* stealer_cpu)
 		if (cur_thread.get() != &t &&
 			t.state == thread::thread_states::READY &&
 			(t.flags_ & thread::thread_flags::FLAG_IDLE) == 0 &&
-			(t.flags_ & thread::thread_flags::FLAG_INIT) == 0)
+			(t.flags_ & thread::thread_flags::FLAG_INIT) == 0 &&
+			(allow_hot || !parent_->cache_hot(&t)))
 		{
 			if (t.scheduler_state_.affinity()->type == cpu_affinity_type::SOFT)
 			{
@@ -128,7 +100,8 @@ task::thread* task::fcfs_scheduler_class::steal(cpu_struct* stealer_cpu)
 		if (cur_thread.get() != &t &&
 			t.state == thread::thread_states::READY &&
 			(t.flags_ & thread::thread_flags::FLAG_IDLE) == 0 &&
-			(t.flags_ & thread::thread_flags::FLAG_INIT) == 0)
+			(t.flags_ & thread::thread_flags::FLAG_INIT) == 0 &&
+			(allow_hot || !parent_->cache_hot(&t)))
 		{
 			if (t.scheduler_state_.affinity()->type == cpu_affinity_type::HARD)
 			{
@@ -142,7 +115,5 @@ task::thread* task::fcfs_scheduler_class::steal(cpu_struct* stealer_cpu)
 }
 task::scheduler_class::size_type task::fcfs_scheduler_class::workload_size() const
 {
-	lock_guard lk_this{ lock_ };
-
 	return run_queue_.size();
 }
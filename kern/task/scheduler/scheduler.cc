@@ -4,7 +4,12 @@
 
 #include "system/scheduler.h"
 
-#include "drivers/cmos/rtc.hpp"
+#include "drivers/clocksource/clocksource.hpp"
+
+#include "memory/reclaim.hpp"
+#include "memory/compaction.hpp"
+#include "memory/teardown.hpp"
+#include "memory/zeroing.hpp"
 
 #include "kbl/lock/lock_guard.hpp"
 
@@ -15,111 +20,107 @@
 using namespace lock;
 using namespace trap;
 
-// TODO: cpu scheduler ( load balance )
-
-
 // Helpers to interact with scheduler class
 
-void task::scheduler::enqueue(task::thread* t)
+void task::scheduler::enqueue(task::thread* t) TA_NO_THREAD_SAFETY_ANALYSIS
 {
 	if (t->state == thread::thread_states::DYING && t == cpu->idle)
 	{
 		KDEBUG_GENERALPANIC("idle thread exiting.\n");
 	}
+	else if (t->state == thread::thread_states::DYING)
+	{
+		// dying threads only come from schedule(), which holds global_thread_lock
+		global_thread_lock.assert_held();
+		zombie_queue_.push_back(t);
+	}
 	else
 	{
+		lock_guard g{ run_queue_lock_ };
 		scheduler_class.enqueue(t);
 	}
 }
 
 void task::scheduler::dequeue(task::thread* t)
 {
+	lock_guard g{ run_queue_lock_ };
 	scheduler_class.dequeue(t);
 }
 
 task::thread* task::scheduler::fetch()
 {
+	lock_guard g{ run_queue_lock_ };
 	return scheduler_class.fetch();
 }
 
-task::thread* task::scheduler::steal()
+bool task::scheduler::migrate(scheduler* from, scheduler* to, bool allow_hot) TA_NO_THREAD_SAFETY_ANALYSIS
 {
-	return scheduler_class.steal(cpu.get());
-}
-
-// Scheduler timer implementation
+	if (from == to)
+	{
+		return false;
+	}
 
-void task::scheduler::check_timers_locked()
-{
-	if (timer_list.empty())return;
+	auto first = from->owner_cpu->id < to->owner_cpu->id ? from : to;
+	auto second = first == from ? to : from;
 
-	auto timer = timer_list.front_ptr();
-	--timer->expires;
+	lock_guard g1{ first->run_queue_lock_ };
+	lock_guard g2{ second->run_queue_lock_ };
 
-	while (!timer->expires)
+	auto victim = from->scheduler_class.steal(to->owner_cpu, allow_hot);
+	if (victim == nullptr)
 	{
-		auto next = timer->link.next_->parent_;
-
-		timer->callback(timer, cmos::cmos_read_rtc_timestamp(), timer->arg);
-
-		remove_timer(timer);
-		if (!next) break;
-		timer = next;
+		return false;
 	}
+
+	to->scheduler_class.enqueue(victim);
+	return true;
 }
 
-void task::scheduler::timer_tick_handle()
+void task::scheduler::reap_zombies()
 {
-	timer_lock.assert_not_held();
-
+	while (!zombie_queue_.empty())
 	{
-		lock_guard g2{ timer_lock };
-		check_timers_locked();
-	}
+		auto t = zombie_queue_.front_ptr();
+		zombie_queue_.pop_front();
 
-	tick(cur_thread.get());
+		t->finish_dead_transition();
+	}
 }
 
-void task::scheduler::add_timer(task::scheduler_timer* timer)
+void task::scheduler::finish_switch()
 {
-	lock_guard g{ timer_lock };
+	KDEBUG_ASSERT(arch_ints_disabled());
 
-	auto iter = timer_list.begin();
-	while (iter != timer_list.end())
-	{
-		if (timer->expires < iter->expires)
-		{
-			iter->expires -= timer->expires;
-			break;
-		}
-
-		timer->expires -= iter->expires;
-		iter++;
-	}
+	auto prev = switched_from_;
+	switched_from_ = nullptr;
 
-	if (iter != timer_list.begin())iter--;
-
-	timer_list.insert(iter, timer);
+	// pairs with the wait in switch_to, so that whoever runs prev next sees its saved context
+	__atomic_store_n(&prev->scheduler_state_.on_cpu_, false, __ATOMIC_RELEASE);
 }
 
-void task::scheduler::remove_timer(task::scheduler_timer* timer)
+// Scheduler timer implementation
+
+void task::scheduler::timer_tick_handle()
 {
-	lock_guard g{ timer_lock };
+	timer_wheel_.advance(clocksource::now());
 
-	if (timer_list.empty())return;
+	tick(cur_thread.get());
+}
 
-	if (timer->expires != 0)
-	{
-		auto next = timer->link.next_->parent_;
-		if (next != nullptr)
-		{
-			next->expires += timer->expires;
-		}
-	}
+void task::scheduler::add_timer(task::scheduler_timer* timer, uint64_t ticks)
+{
+	timer_wheel_.add(timer, ticks);
+}
 
-	timer_list.remove(timer);
+bool task::scheduler::cancel_timer(task::scheduler_timer* timer)
+{
+	return timer_wheel::cancel(timer);
 }
 
+void task::scheduler::migrate_timers(scheduler* from, scheduler* to)
+{
+	timer_wheel::migrate(&from->timer_wheel_, &to->timer_wheel_);
+}
 
 // Scheduler itself's implementation
 
@@ -131,8 +132,6 @@ void task::scheduler::insert(task::thread* t)
 
 void task::scheduler::tick(task::thread* t)
 {
-	lock_guard g{ global_thread_lock };
-
 	auto state = arch_interrupt_save();
 	auto _ = gsl::finally([&state]()
 	{
@@ -141,6 +140,10 @@ void task::scheduler::tick(task::thread* t)
 
 	if (t != cpu->idle)
 	{
+		// run time is charged per tick, so that it stays right for threads running across several ticks
+		t->scheduler_state_.on_tick();
+
+		lock_guard g{ run_queue_lock_ };
 		scheduler_class.tick();
 	}
 	else if (t != nullptr) // idle is running
@@ -148,31 +151,7 @@ void task::scheduler::tick(task::thread* t)
 		t->scheduler_state_.set_need_reschedule(true);
 	}
 
-	// Push migrating approach to load balancing
-	cpu_struct* max_cpu = &(*valid_cpus.begin()), * min_cpu = &(*valid_cpus.begin());
-
-	for (auto& c: valid_cpus)
-	{
-		if (c.scheduler->workload_size_locked() > max_cpu->scheduler->workload_size_locked())
-		{
-			max_cpu = &c;
-		}
-
-		if (c.scheduler->workload_size_locked() < min_cpu->scheduler->workload_size_locked())
-		{
-			min_cpu = &c;
-		}
-	}
-
-	if (max_cpu != min_cpu
-		&& max_cpu->scheduler->workload_size_locked() > min_cpu->scheduler->workload_size_locked() + 1)
-	{
-		if (auto victim = max_cpu->scheduler->steal();victim != nullptr)
-		{
-			min_cpu->scheduler->enqueue(victim);
-		}
-	}
-
+	balance();
 }
 
 void task::scheduler::reschedule()
@@ -219,27 +198,19 @@ void task::scheduler::yield_locked() TA_REQ(global_thread_lock)
 
 void task::scheduler::unblock_locked(task::thread* t)
 {
-	KDEBUG_ASSERT(cpu->id == owner_cpu->id);
-
+	// other CPUs may wake threads bound to this one, the run queue lock covers them
 	t->state = thread::thread_states::READY;
 	enqueue(t);
 }
 
 void task::scheduler::insert_locked(task::thread* t) TA_REQ(global_thread_lock)
 {
-	KDEBUG_ASSERT(cpu->id == owner_cpu->id);
-
 	enqueue(t);
 }
 
 task::scheduler::size_type task::scheduler::workload_size() const
 {
-	lock_guard g{ global_thread_lock };
-	return workload_size_locked();
-}
-
-task::scheduler::size_type task::scheduler::workload_size_locked() const
-{
+	lock_guard g{ run_queue_lock_ };
 	return scheduler_class.workload_size();
 }
 
@@ -249,38 +220,17 @@ error_code task::scheduler::idle(void* arg __UNUSED) TA_NO_THREAD_SAFETY_ANALYSI
 	{
 		auto this_cpu = cpu.get();
 
-		// Pull migration approach to load balancing
-
-		lock_guard g2{ global_thread_lock };
+		// nothing else runs, so give back cached memory if it's short, rebuild 2MB blocks
+		// if they ran out, and wake the teardown of dead address spaces and the zeroing of pages
+		memory::reclaim_if_needed();
+		memory::compact_if_needed();
+		memory::teardown_wake_if_needed();
+		memory::zeroing_wake_if_needed();
 
-		auto intr = arch_ints_disabled();
-
-		if (!intr)
-		{
-			cli();
-		}
-
-		cpu_struct* max_cpu = &valid_cpus[0];
-
-		for (auto& c: valid_cpus)
-		{
-			if (c.scheduler->workload_size_locked() > max_cpu->scheduler->workload_size_locked() &&
-				this_cpu != &c)
-			{
-				max_cpu = &c;
-			}
-		}
-
-		if (auto t = max_cpu->scheduler->steal();t != nullptr)
-		{
-			this_cpu->scheduler->enqueue(t);
-		}
-
-		if (!intr)
-		{
-			sti();
-		}
+		// Pull migration approach to load balancing, from the closest CPU with a thread to spare
+		this_cpu->scheduler->balance_idle();
 
+		lock_guard g2{ global_thread_lock };
 		scheduler::current::reschedule_locked();
 	}
 
@@ -324,6 +274,7 @@ void task::scheduler::current::insert(task::thread* t)
 	{
 		KDEBUG_ASSERT(t->scheduler_state_.affinity()->cpu < valid_cpus.size());
 		valid_cpus[t->scheduler_state_.affinity()->cpu].scheduler->insert(t);
+		return;
 	}
 
 	cpu->scheduler->insert(t);
@@ -379,7 +330,8 @@ void task::scheduler::schedule()
 
 	cur->scheduler_state_.set_need_reschedule(false);
 
-	cur->scheduler_state_.on_tick();
+	// the threads that died here switched away for good, and cur isn't among them
+	reap_zombies();
 
 	if (cur->state == thread::thread_states::READY)
 	{
@@ -400,6 +352,10 @@ void task::scheduler::schedule()
 
 	if (next != cur)
 	{
+		// for the balancers to tell whether its cache is still warm here
+		cur->scheduler_state_.last_cpu_ = owner_cpu->id;
+		cur->scheduler_state_.last_ran_tick_ = ticks_;
+
 		next->switch_to(state);
 	}
 
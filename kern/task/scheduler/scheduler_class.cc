@@ -15,7 +15,8 @@
 using namespace kbl;
 using namespace task;
 
-[[maybe_unused]] thread* task::scheduler_class::steal([[maybe_unused]] cpu_struct* stealer_cpu)
+[[maybe_unused]] thread* task::scheduler_class::steal([[maybe_unused]] cpu_struct* stealer_cpu,
+	[[maybe_unused]] bool allow_hot)
 {
 	return nullptr;
 }
\ No newline at end of file
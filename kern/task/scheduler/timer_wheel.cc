@@ -0,0 +1,203 @@
+#include "task/scheduler/timer_wheel.hpp"
+
+#include "arch/amd64/cpu/intrinsics.hpp"
+
+#include "debug/kdebug.h"
+
+#include "kbl/lock/lock_guard.hpp"
+
+using namespace lock;
+
+// now + ticks, saturated instead of wrapping around
+static inline uint64_t expiry(uint64_t now, uint64_t ticks)
+{
+	return ticks >= UINT64_MAX - now ? UINT64_MAX : now + ticks;
+}
+
+void task::timer_wheel::place_locked(scheduler_timer* timer)
+{
+	__atomic_store_n(&timer->wheel, this, __ATOMIC_RELEASE);
+
+	if (timer->expires <= now_)
+	{
+		timer->level = LEVEL_EXPIRED;
+		timer->slot = 0;
+		expired_.push_back(timer);
+		return;
+	}
+
+	// a timer beyond the range waits in the farthest bucket, which is placed again when it's reached
+	auto when = timer->expires - now_ >= RANGE ? now_ + RANGE - 1 : timer->expires;
+	auto delta = when - now_;
+
+	size_t level = 0;
+	while ((delta >> (LEVEL_BITS * (level + 1))) != 0)
+	{
+		level++;
+	}
+
+	// the bucket is reached no earlier than now_, and at most a revolution of the level later
+	timer->level = level;
+	timer->slot = (when >> (LEVEL_BITS * level)) & (SLOTS - 1);
+	slots_[level][timer->slot].push_back(timer);
+}
+
+void task::timer_wheel::unlink_locked(scheduler_timer* timer)
+{
+	list_of(timer->level, timer->slot).remove(timer);
+}
+
+void task::timer_wheel::cascade_locked(size_t level)
+{
+	auto& bucket = slots_[level][(now_ >> (LEVEL_BITS * level)) & (SLOTS - 1)];
+
+	// the timers of a bucket are all due within the ticks of a bucket of the level below
+	timer_list_type list{};
+	list.splice(bucket);
+
+	while (!list.empty())
+	{
+		auto timer = list.front_ptr();
+		list.pop_front();
+
+		place_locked(timer);
+	}
+}
+
+void task::timer_wheel::add(scheduler_timer* timer, uint64_t ticks)
+{
+	lock_guard g{ lock_ };
+
+	KDEBUG_ASSERT(timer->link.is_empty_or_detached());
+
+	timer->canceled = false;
+	timer->expires = expiry(now_, ticks ? ticks : 1);
+
+	place_locked(timer);
+}
+
+bool task::timer_wheel::cancel(scheduler_timer* timer) TA_NO_THREAD_SAFETY_ANALYSIS
+{
+	for (;;)
+	{
+		auto wheel = __atomic_load_n(&timer->wheel, __ATOMIC_ACQUIRE);
+		if (wheel == nullptr)
+		{
+			return false;
+		}
+
+		wheel->lock_.lock();
+
+		// moved to another CPU before the lock was taken
+		if (timer->wheel != wheel)
+		{
+			wheel->lock_.unlock();
+			continue;
+		}
+
+		if (!timer->link.is_empty_or_detached())
+		{
+			wheel->unlink_locked(timer);
+			wheel->lock_.unlock();
+			return true;
+		}
+
+		bool running = wheel->running_ == timer;
+		if (running)
+		{
+			__atomic_store_n(&timer->canceled, true, __ATOMIC_RELEASE);
+		}
+
+		wheel->lock_.unlock();
+
+		// the timer may be freed once this returns, so the callback must be done with it
+		while (running && __atomic_load_n(&wheel->running_, __ATOMIC_ACQUIRE) == timer)
+		{
+			arch::cpu_yield();
+		}
+
+		return false;
+	}
+}
+
+void task::timer_wheel::advance(time_type time)
+{
+	{
+		lock_guard g{ lock_ };
+
+		now_++;
+
+		// a bucket of a level is reached when the ticks of the levels below wrap around
+		for (size_t level = 0; level < LEVELS; level++)
+		{
+			if (level > 0 && (now_ & ((1ull << (LEVEL_BITS * level)) - 1)) != 0)
+			{
+				break;
+			}
+
+			cascade_locked(level);
+		}
+	}
+
+	for (;;)
+	{
+		scheduler_timer* timer = nullptr;
+
+		{
+			lock_guard g{ lock_ };
+
+			__atomic_store_n(&running_, nullptr, __ATOMIC_RELEASE);
+
+			if (expired_.empty())
+			{
+				return;
+			}
+
+			timer = expired_.front_ptr();
+			expired_.pop_front();
+
+			__atomic_store_n(&running_, timer, __ATOMIC_RELEASE);
+		}
+
+		// the callback may free the timer, it's not touched after
+		timer->callback(timer, time, timer->arg);
+	}
+}
+
+void task::timer_wheel::migrate(timer_wheel* from, timer_wheel* to) TA_NO_THREAD_SAFETY_ANALYSIS
+{
+	if (from == to)
+	{
+		return;
+	}
+
+	auto first = from < to ? from : to;
+	auto second = first == from ? to : from;
+
+	lock_guard g1{ first->lock_ };
+	lock_guard g2{ second->lock_ };
+
+	auto move = [from, to](timer_list_type& list)
+	{
+		while (!list.empty())
+		{
+			auto timer = list.front_ptr();
+			list.pop_front();
+
+			auto left = timer->expires > from->now_ ? timer->expires - from->now_ : 0;
+			timer->expires = expiry(to->now_, left);
+
+			to->place_locked(timer);
+		}
+	};
+
+	for (auto& level: from->slots_)
+	{
+		for (auto& bucket: level)
+		{
+			move(bucket);
+		}
+	}
+
+	move(from->expired_);
+}
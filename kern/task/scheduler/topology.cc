@@ -0,0 +1,106 @@
+#include "task/scheduler/topology.hpp"
+
+#include "arch/amd64/cpu/cpuid.h"
+
+#include "drivers/acpi/cpu.h"
+#include "debug/kdebug.h"
+
+#include "ktl/algorithm.hpp"
+
+using namespace task;
+
+// leaf 0xb level types in ecx[15:8]
+constexpr uint64_t TOPOLOGY_LEVEL_TYPE_SMT = 1;
+
+// leaf 4 cache types in eax[4:0], 0 ends the list
+constexpr uint64_t CACHE_TYPE_NULL = 0;
+
+// the number of low APIC ID bits that tell apart count IDs
+static inline size_t id_bits(size_t count)
+{
+	size_t bits = 0;
+	while ((1ul << bits) < count)
+	{
+		bits++;
+	}
+
+	return bits;
+}
+
+static size_t smt_bits()
+{
+	auto[max_leaf, ebx0, ecx0, edx0] = cpuid(CPUID_GETVENDORSTRING);
+	if (max_leaf < CPUID_GETTOPOLOGY)
+	{
+		return 0;
+	}
+
+	// sub-leaf 0 describes the SMT level, eax[4:0] is how far to shift the APIC ID to get the core
+	auto[eax, ebx, ecx, edx] = cpuid(CPUID_GETTOPOLOGY, 0);
+	if (ebx == 0 || ((ecx >> 8) & 0xff) != TOPOLOGY_LEVEL_TYPE_SMT)
+	{
+		return 0;
+	}
+
+	return eax & 0x1f;
+}
+
+static size_t llc_bits()
+{
+	auto[max_leaf, ebx0, ecx0, edx0] = cpuid(CPUID_GETVENDORSTRING);
+	if (max_leaf < CPUID_GETCACHEPARAMS)
+	{
+		return 0;
+	}
+
+	size_t bits = 0, level = 0;
+	for (uint32_t i = 0;; i++)
+	{
+		auto[eax, ebx, ecx, edx] = cpuid(CPUID_GETCACHEPARAMS, i);
+		if ((eax & 0x1f) == CACHE_TYPE_NULL)
+		{
+			break;
+		}
+
+		// eax[7:5] is the cache level, eax[25:14] the number of logical processors sharing it less one
+		if (((eax >> 5) & 0x7) >= level)
+		{
+			level = (eax >> 5) & 0x7;
+			bits = id_bits(((eax >> 14) & 0xfff) + 1);
+		}
+	}
+
+	return bits;
+}
+
+void task::topology_init()
+{
+	// without leaf 4, as on AMD processors, every core counts as having a cache of its own
+	auto smt = smt_bits();
+	auto llc = ktl::max(smt, llc_bits());
+
+	for (auto& c: valid_cpus)
+	{
+		c.core_id = c.apicid >> smt;
+		c.llc_id = c.apicid >> llc;
+	}
+
+	kdebug::kdebug_log("topology: %lld APIC ID bits per core, %lld per last level cache\n", smt, llc);
+}
+
+bool task::topology_shares(const cpu_struct* a, const cpu_struct* b, topology_level level)
+{
+	// APIC IDs are unique across the packages, so the IDs derived from them are as well
+	switch (level)
+	{
+	case TOPOLOGY_SMT:
+		return a->core_id == b->core_id;
+	case TOPOLOGY_LLC:
+		return a->llc_id == b->llc_id;
+	case TOPOLOGY_NUMA:
+		return a->numa_node == b->numa_node;
+	case TOPOLOGY_SYSTEM:
+	default:
+		return true;
+	}
+}
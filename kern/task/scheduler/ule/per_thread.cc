@@ -4,14 +4,18 @@
 #include "task/scheduler/ule/ule.hpp"
 
 #include "drivers/apic/timer.h"
+#include "drivers/acpi/cpu.h"
 
 #include <ktl/algorithm.hpp>
 
 using namespace ktl;
 
+using ule = task::ule_scheduler_class;
+
 void task::ule_scheduler_state_base::on_tick()
 {
-	run_time_++;
+	run_time_ += 1ul << ule::HISTORY_SHIFT;
+	decay_history();
 }
 
 void task::ule_scheduler_state_base::on_sleep()
@@ -21,36 +25,95 @@ void task::ule_scheduler_state_base::on_sleep()
 
 void task::ule_scheduler_state_base::on_wakeup()
 {
-	sleep_time_ += timer::get_ticks() - sleep_tick_;
+	if (sleep_tick_ == 0)
+	{
+		return;
+	}
+
+	// every CPU advances the tick count, while run time is counted on one of them
+	auto slept = (timer::get_ticks() - sleep_tick_) / max(1ul, valid_cpus.size());
+
+	sleep_time_ += slept << ule::HISTORY_SHIFT;
 	sleep_tick_ = 0;
+
+	decay_history();
 }
 
-task::ule_scheduler_state_base::interactivity_score_type task::ule_scheduler_state_base::interactivity_score() const
+void task::ule_scheduler_state_base::set_nice(int32_t nice)
+{
+	nice_ = clamp(nice, NICE_MIN, NICE_MAX);
+}
+
+void task::ule_scheduler_state_base::decay_history()
 {
-	// if it's not likely to be interactive, avoid expensive computing
-	if (interactivity_ <= ule_scheduler_class::INTERACT_HALF
-		&& run_time_ >= sleep_time_)
-		return ule_scheduler_class::INTERACT_HALF;
-	else if (run_time_ == sleep_time_)
-		return ule_scheduler_class::INTERACT_HALF;
+	auto sum = run_time_ + sleep_time_;
+	if (sum < ule::HISTORY_MAX)
+	{
+		return;
+	}
 
-	if (run_time_ > sleep_time_)
+	// a long sleep or a long run wipes out what came before
+	if (sum > ule::HISTORY_MAX * 2)
+	{
+		if (run_time_ > sleep_time_)
+		{
+			run_time_ = ule::HISTORY_MAX;
+			sleep_time_ = 1;
+		}
+		else
+		{
+			sleep_time_ = ule::HISTORY_MAX;
+			run_time_ = 1;
+		}
+		return;
+	}
+
+	if (sum > ule::HISTORY_MAX / 5 * 6)
 	{
-		auto div = max(1ul, run_time_ / ule_scheduler_class::INTERACT_HALF);
-		return ule_scheduler_class::INTERACT_HALF +
-			(ule_scheduler_class::INTERACT_HALF - sleep_time_ / div);
+		run_time_ /= 2;
+		sleep_time_ /= 2;
+		return;
 	}
-	else
+
+	run_time_ = run_time_ / 5 * 4;
+	sleep_time_ = sleep_time_ / 5 * 4;
+}
+
+task::ule_scheduler_state_base::interactivity_score_type task::ule_scheduler_state_base::interactivity_score() const
+{
+	// threads sleeping more than running score below INTERACT_HALF, the others above it
+	if (sleep_time_ > run_time_)
 	{
-		auto div = max(1ul, sleep_time_ / ule_scheduler_class::INTERACT_HALF);
+		auto div = max(1ul, sleep_time_ / ule::INTERACT_HALF);
 		return run_time_ / div;
 	}
 
-	KDEBUG_GERNERALPANIC_CODE(-ERROR_SHOULD_NOT_REACH_HERE);
-	return 0;
+	if (run_time_ > sleep_time_)
+	{
+		auto div = max(1ul, run_time_ / ule::INTERACT_HALF);
+		return ule::INTERACT_HALF + (ule::INTERACT_HALF - sleep_time_ / div);
+	}
+
+	return run_time_ ? ule::INTERACT_HALF : 0;
 }
 
 task::ule_scheduler_state_base::priority_type task::ule_scheduler_state_base::priority() const
 {
-	return 0;
+	// background work sleeps most of the time, which mustn't make it interactive
+	if (background_)
+	{
+		return ule::PRI_MAX_TIMESHARE;
+	}
+
+	// nice moves a thread across the threshold as well as within its band
+	auto score = clamp<int64_t>((int64_t)interactivity_score() + nice_, 0, ule::INTERACT_MAX);
+
+	if (score < (int64_t)ule::INTERACT_THRESHOLD)
+	{
+		return ule::PRI_MIN_INTERACT +
+			(priority_type)(score * (ule::PRI_MAX_INTERACT - ule::PRI_MIN_INTERACT + 1) / ule::INTERACT_THRESHOLD);
+	}
+
+	return ule::PRI_MIN_TIMESHARE + (priority_type)((score - ule::INTERACT_THRESHOLD) *
+		(ule::PRI_MAX_TIMESHARE - ule::PRI_MIN_TIMESHARE + 1) / (ule::INTERACT_MAX - ule::INTERACT_THRESHOLD + 1));
 }
@@ -1,31 +1,182 @@
+#include "internals/thread.hpp"
+
 #include "task/scheduler/ule/ule.hpp"
 
+#include "task/scheduler/scheduler.hpp"
+#include "task/thread/thread.hpp"
+
+#include "drivers/acpi/cpu.h"
+
+#include "system/scheduler.h"
+
+#include "kbl/data/utility.hpp"
+
+#include "kbl/lock/lock_guard.hpp"
+#include "ktl/algorithm.hpp"
+
+using namespace kbl;
+using namespace lock;
+
+void task::ule_scheduler_class::run_queue_add(run_queue* rq, task::thread* t, priority_type pri)
+{
+	rq->lists[pri].push_back(t);
+	rq->bitmap |= 1ull << pri;
+	rq->count++;
+
+	t->scheduler_state_.queued_run_queue_ = rq - run_queues_;
+	t->scheduler_state_.queued_priority_ = pri;
+}
+
+void task::ule_scheduler_class::run_queue_remove(task::thread* t)
+{
+	auto rq = &run_queues_[t->scheduler_state_.queued_run_queue_];
+	auto pri = t->scheduler_state_.queued_priority_;
+
+	rq->lists[pri].remove(t);
+	if (rq->lists[pri].empty())
+	{
+		rq->bitmap &= ~(1ull << pri);
+	}
+	rq->count--;
+
+	t->scheduler_state_.queued_run_queue_ = -1;
+}
+
+task::thread* task::ule_scheduler_class::run_queue_choose(run_queue* rq)
+{
+	if (rq->bitmap == 0)
+	{
+		return nullptr;
+	}
+
+	auto t = rq->lists[__builtin_ctzll(rq->bitmap)].front_ptr();
+	run_queue_remove(t);
+
+	return t;
+}
+
+size_t task::ule_scheduler_class::slice() const
+{
+	// the thread running counts as well
+	auto load = current_->count + next_->count + 1;
+
+	if (load >= SLICE_MIN_DIVISOR)
+	{
+		return SLICE_MIN;
+	}
+
+	return SLICE_DEFAULT / load;
+}
+
 task::scheduler_class::size_type task::ule_scheduler_class::workload_size() const
 {
-	return 0;
+	return current_->count + next_->count;
 }
 
 void task::ule_scheduler_class::enqueue(task::thread* t)
 {
+	// the idle thread runs when both queues are empty, it would keep current_ from ever running out
+	if (t->is_idle())
+	{
+		return;
+	}
+
+	auto state = &t->scheduler_state_;
+	if (state->slice_left_ == 0)
+	{
+		state->slice_left_ = slice();
+	}
 
+	auto pri = state->priority();
+	run_queue_add(pri <= PRI_MAX_INTERACT ? current_ : next_, t, pri);
+
+	// an interactive thread waking up preempts whatever less urgent this CPU runs
+	if (parent_->owner_cpu == cpu.get() && pri <= PRI_MAX_INTERACT)
+	{
+		auto cur = cur_thread.get();
+		if (cur != nullptr && cur != t && (cur->is_idle() || pri < cur->scheduler_state_.priority()))
+		{
+			cur->scheduler_state_.set_need_reschedule(true);
+		}
+	}
 }
 
 void task::ule_scheduler_class::dequeue(task::thread* t)
 {
-
+	if (t->scheduler_state_.queued_run_queue_ >= 0)
+	{
+		run_queue_remove(t);
+	}
 }
 
 task::thread* task::ule_scheduler_class::fetch()
 {
-	return nullptr;
+	KDEBUG_ASSERT(cpu->id == parent_->owner_cpu->id);
+
+	if (current_->count == 0)
+	{
+		ktl::swap(current_, next_);
+	}
+
+	return run_queue_choose(current_);
 }
 
 void task::ule_scheduler_class::tick()
 {
+	KDEBUG_ASSERT(cpu->id == parent_->owner_cpu->id);
 
+	auto state = &cur_thread->scheduler_state_;
+	if (state->slice_left_ > 0)
+	{
+		state->slice_left_--;
+	}
+
+	if (state->slice_left_ == 0)
+	{
+		state->set_need_reschedule(true);
+	}
 }
 
-task::thread* task::ule_scheduler_class::steal(cpu_struct* stealer_cpu)
+task::thread* task::ule_scheduler_class::steal(cpu_struct* stealer_cpu, bool allow_hot)
 {
-	return scheduler_class::steal(stealer_cpu);
+	auto stealable = [this, stealer_cpu, allow_hot](thread& t, bool soft)
+	{
+		if (cur_thread.get() == &t ||
+			t.state != thread::thread_states::READY ||
+			(t.flags_ & thread::thread_flags::FLAG_IDLE) != 0 ||
+			(t.flags_ & thread::thread_flags::FLAG_INIT) != 0 ||
+			(!allow_hot && parent_->cache_hot(&t)))
+		{
+			return false;
+		}
+
+		auto aff = t.scheduler_state_.affinity();
+		return soft ? aff->type == cpu_affinity_type::SOFT : aff->cpu == stealer_cpu->id;
+	};
+
+	// threads bound to the stealer first, then the least urgent ones that may run anywhere
+	for (bool soft: { false, true })
+	{
+		for (auto rq: { next_, current_ })
+		{
+			for (auto pri = PRI_MAX_TIMESHARE; pri >= PRI_MIN_INTERACT; pri--)
+			{
+				if (!(rq->bitmap & (1ull << pri)))
+				{
+					continue;
+				}
+
+				for (auto& t: rq->lists[pri] | reversed)
+				{
+					if (stealable(t, soft))
+					{
+						run_queue_remove(&t);
+						return &t;
+					}
+				}
+			}
+		}
+	}
+
+	return nullptr;
 }
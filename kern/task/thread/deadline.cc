@@ -1,6 +1,6 @@
 #include "system/deadline.hpp"
 
-#include "drivers/cmos/rtc.hpp"
+#include "drivers/clocksource/clocksource.hpp"
 
 #include "debug/kdebug.h"
 
@@ -10,7 +10,7 @@ const deadline deadline::infinite_{ TIME_INFINITE, timer_slack::none() };
 
 deadline deadline::after(duration_type after, timer_slack slack)
 {
-	auto timestamp = time_add_duration(cmos::cmos_read_rtc_timestamp(), after);
+	auto timestamp = time_add_duration(clocksource::now(), after);
 	return deadline(timestamp, slack);
 }
 
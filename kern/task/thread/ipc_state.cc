@@ -1,4 +1,5 @@
 #include "../include/syscall.h"
+#include "arch/amd64/cpu/string.hpp"
 #include "internals/thread.hpp"
 
 #include "task/thread/thread.hpp"
@@ -60,7 +61,7 @@ error_code ipc_state::copy_string_locked(thread* from_t, uintptr_t from, thread*
 		return -ERROR_INVALID_ACCESS;
 	}
 
-	memmove((void*)to, (void*)from, len);
+	arch::fast_memmove((void*)to, (void*)from, len);
 
 	return ERROR_SUCCESS;
 }
@@ -11,6 +11,11 @@
 #include "system/scheduler.h"
 #include "system/deadline.hpp"
 
+#include "memory/tlb.hpp"
+#include "memory/kstack.hpp"
+
+#include "arch/amd64/cpu/intrinsics.hpp"
+
 #include "object/object_manager.hpp"
 
 #include "drivers/acpi/cpu.h"
@@ -55,16 +60,17 @@ ktl::unique_ptr<kernel_stack> task::kernel_stack::create(thread* parent,
 {
 	kbl::allocate_checker ck{};
 
-	auto stack_mem = memory::kmalloc(MAX_SIZE, 0);
-	auto ret = new(&ck) kernel_stack{ parent, stack_mem, start_routine, arg, tpl };
-
-	if (!ck.check())
+	auto stack_mem = memory::kstack_allocate();
+	if (stack_mem == nullptr)
 	{
 		return nullptr;
 	}
 
-	if (ret->bottom == nullptr)
+	auto ret = new(&ck) kernel_stack{ parent, stack_mem, start_routine, arg, tpl };
+
+	if (!ck.check())
 	{
+		memory::kstack_free(stack_mem);
 		return nullptr;
 	}
 
@@ -73,7 +79,7 @@ ktl::unique_ptr<kernel_stack> task::kernel_stack::create(thread* parent,
 
 kernel_stack::~kernel_stack()
 {
-	memory::kfree(bottom);
+	memory::kstack_free(bottom);
 }
 
 kernel_stack::kernel_stack(thread* parent_thread,
@@ -190,6 +196,7 @@ error_code thread::create_idle()
 	cpu->idle = th;
 
 	cur_thread = cpu->idle;
+	th->scheduler_state_.on_cpu_ = true;
 
 	return ERROR_SUCCESS;
 }
@@ -197,7 +204,8 @@ error_code thread::create_idle()
 
 void thread::default_trampoline() TA_NO_THREAD_SAFETY_ANALYSIS
 {
-	global_thread_lock.unlock();
+	// switch_to released global_thread_lock already, and the trap frame restores the interrupt state
+	cpu->scheduler->finish_switch();
 
 	// will return to thread_entry
 }
@@ -215,6 +223,14 @@ void thread::switch_to(interrupt_saved_state_type state_to_restore) TA_REQ(globa
 	  arch_interrupt_restore(state_to_restore);
 	});
 
+	// the thread may have been woken, or stolen, while the CPU it ran on is still switching away from it
+	while (__atomic_load_n(&scheduler_state_.on_cpu_, __ATOMIC_ACQUIRE))
+	{
+		arch::cpu_yield();
+	}
+
+	scheduler_state_.on_cpu_ = true;
+
 	{
 		lock_guard g{ lock_ };
 		state = thread_states::RUNNING;
@@ -243,23 +259,31 @@ void thread::switch_to(interrupt_saved_state_type state_to_restore) TA_REQ(globa
 //			this->get_mm()->pgdir));
 //	}
 
-	if (parent_)
-	{
-		lcr3(V2P((uintptr_t)address_space()->pgdir()));
-	}
-	else // it's a kernel thread
-	{
-		lcr3(V2P((uintptr_t)vmm::g_kpml4t));
-	}
+	auto pgdir = parent_ ? address_space()->pgdir() : vmm::g_kpml4t; // g_kpml4t for a kernel thread
+	memory::tlb_activate(pgdir);
+	lcr3(V2P((uintptr_t)pgdir));
 
 	auto prev = cur_thread.get();
 	cur_thread = this;
 
+	cpu->scheduler->switched_from_ = prev;
+
+	// the lock isn't handed over to this thread, so other CPUs can wake and schedule threads meanwhile.
+	// prev is kept from running anywhere else by its on_cpu_ until it's saved
+	auto caller_state = global_thread_lock.unlock_no_restore();
+
 	// manually restore interrupt state
 	arch_interrupt_restore(state_to_restore);
 
 	context_switch(&prev->kstack_->context, this->kstack_->context);
 
+	// the thread switched away from runs again here, maybe on another CPU, with the locals of that switch
+	cpu->scheduler->finish_switch();
+
+	// taken again for the caller, which saved its interrupt state when it took the lock
+	arch_interrupt_restore(caller_state);
+	global_thread_lock.lock();
+
 	// automatically restore interrupt state here
 }
 
@@ -7,7 +7,9 @@
 
 #include "system/deadline.hpp"
 
-#include "drivers/cmos/rtc.hpp"
+#include "drivers/clocksource/clocksource.hpp"
+
+#include "arch/amd64/cpu/intrinsics.hpp"
 
 #include "ktl/move.hpp"
 
@@ -69,7 +71,8 @@ error_code wait_queue::block_etc(const deadline& ddl,
 	KDEBUG_ASSERT(arch_ints_disabled());
 	KDEBUG_ASSERT(current_thread->state == thread::thread_states::RUNNING);
 
-	if (ddl.when() != TIME_INFINITE && ddl.when() < (time_type)cmos::cmos_read_rtc_timestamp())
+	auto now = clocksource::now();
+	if (ddl.when() != TIME_INFINITE && ddl.when() < now)
 	{
 		return ERROR_TIMEOUT;
 	}
@@ -102,19 +105,25 @@ error_code wait_queue::block_etc(const deadline& ddl,
 	cur_thread->wait_queue_state_.blocking_on_ = this;
 	cur_thread->wait_queue_state_.block_code_ = ERROR_SUCCESS;
 
-	if (ddl.when() != TIME_INFINITE)
-	{
-		scheduler_timer timer;
+	scheduler_timer timer{};
+	bool timed = ddl.when() != TIME_INFINITE;
 
+	if (timed)
+	{
 		timer.arg = current_thread;
 		timer.callback = timeout_handle;
-		timer.expires = ddl.when() - cmos::cmos_read_rtc_timestamp();
 
-		cpu->scheduler->add_timer(&timer);
+		cpu->scheduler->add_timer(&timer, clocksource::duration_to_ticks(time_sub_time(ddl.when(), now)));
 	}
 
 	scheduler::current::block_locked();
 
+	// woken either way, the timer must be off the wheel before this frame is gone
+	if (timed)
+	{
+		scheduler::cancel_timer(&timer);
+	}
+
 	current_thread->wait_queue_state_.interruptible_ = interruptible::No;
 
 	return current_thread->wait_queue_state_.block_code_;
@@ -202,9 +211,28 @@ void wait_queue::timeout_handle(scheduler_timer* timer, [[maybe_unused]] time_ty
 {
 	auto t = reinterpret_cast<thread*>(arg);
 
-	cpu->scheduler->remove_timer(timer);
+	// a thread woken otherwise cancels this timer with global_thread_lock held, and may be gone once it has.
+	// so the lock is only tried, until the cancel shows up
+	while (!global_thread_lock.try_lock())
+	{
+		if (__atomic_load_n(&timer->canceled, __ATOMIC_ACQUIRE))
+		{
+			return;
+		}
+
+		arch::cpu_yield();
+	}
+
+	if (t->wait_queue_state_.blocking_on_ != nullptr)
+	{
+		t->wait_queue_state_.blocking_on_->dequeue(t, ERROR_TIMEOUT);
 
-	unblock_thread(t, ERROR_TIMEOUT);
+		// this runs in the timer tick, the switch is left to the return from it
+		if (scheduler::current::unblock(t))
+		{
+			cur_thread->scheduler_state_.set_need_reschedule(true);
+		}
+	}
 
 	global_thread_lock.unlock();
 }
@@ -13,6 +13,8 @@
 
 #include "builtin_text_io.hpp"
 
+#include "memory/alloc_profile.hpp"
+
 error_code sys_put_str(const syscall_regs* regs)
 {
 //	char* strbuf = (char*)get_nth_arg(regs, 0);
@@ -29,5 +31,12 @@ error_code sys_put_char(const syscall_regs* regs)
 	auto c = syscall::args_get<char, 0>(regs);
 	put_char(c);
 
+	return ERROR_SUCCESS;
+}
+
+error_code sys_dump_alloc_profile([[maybe_unused]] const syscall_regs* regs)
+{
+	memory::alloc_profile_dump();
+
 	return ERROR_SUCCESS;
 }
\ No newline at end of file
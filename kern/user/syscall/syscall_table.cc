@@ -47,6 +47,7 @@ extern "C" syscall_entry syscall_table[SYSCALL_COUNT_MAX + 1] = {
 	[SYS_hello] = sys_hello,
 	[SYS_put_str] = sys_put_str,
 	[SYS_put_char] = sys_put_char,
+	[SYS_dump_alloc_profile] = sys_dump_alloc_profile,
 
 	[SYS_get_current_thread] = sys_get_current_thread,
 	[SYS_get_thread_by_id]=sys_get_thread_by_id,
@@ -54,6 +55,8 @@ extern "C" syscall_entry syscall_table[SYSCALL_COUNT_MAX + 1] = {
 
 	[SYS_exit] = sys_exit,
 	[SYS_set_heap_size]=sys_set_heap,
+	[SYS_mmap] = sys_mmap,
+	[SYS_munmap] = sys_munmap,
 	[SYS_get_current_process] = sys_get_current_process,
 	[SYS_get_process_by_id]=sys_get_process_by_id,
 	[SYS_get_process_by_name]=sys_get_process_by_name,
@@ -6,6 +6,11 @@
 extern "C" error_code terminate(error_code e);
 extern "C" error_code set_heap_size(uintptr_t* size);
 
+// map len bytes of zero-filled memory with syscall::MMAP_FLAGS. *addr is a hint, or the exact place with MMAP_FIXED,
+// and receives the address of the mapping
+extern "C" error_code mmap(IN OUT void** addr, size_t len, uint64_t flags);
+extern "C" error_code munmap(void* addr, size_t len);
+
 void heap_free(void* ap);
 void* heap_alloc(size_t size, [[maybe_unused]]uint64_t flags);
 
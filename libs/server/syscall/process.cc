@@ -18,3 +18,18 @@ extern "C" error_code set_heap_size(uintptr_t* size)
 	return make_syscall(syscall::SYS_set_heap_size, size);
 }
 
+extern "C" error_code mmap(IN OUT void** addr, size_t len, uint64_t flags)
+{
+	if (addr == nullptr)
+	{
+		return -ERROR_INVALID;
+	}
+
+	return make_syscall(syscall::SYS_mmap, addr, len, flags);
+}
+
+extern "C" error_code munmap(void* addr, size_t len)
+{
+	return make_syscall(syscall::SYS_munmap, addr, len);
+}
+
@@ -14,6 +14,11 @@
 DIONYSUS_API error_code terminate(error_code e);
 DIONYSUS_API error_code set_heap_size(uintptr_t* size);
 
+// map len bytes of zero-filled memory with syscall::MMAP_FLAGS. *addr is a hint, or the exact place with MMAP_FIXED,
+// and receives the address of the mapping
+DIONYSUS_API error_code mmap(IN OUT void** addr, size_t len, uint64_t flags);
+DIONYSUS_API error_code munmap(void* addr, size_t len);
+
 DIONYSUS_API void heap_free(void* ap);
 DIONYSUS_API void* heap_alloc(size_t size, [[maybe_unused]]uint64_t flags);
 
@@ -21,6 +26,9 @@ DIONYSUS_API size_t hello(size_t a, size_t b, size_t c, size_t d);
 DIONYSUS_API size_t put_str(const char* str);
 DIONYSUS_API size_t put_char(size_t ch);
 
+// print the kernel's allocation sites and kmem caches to its debug console
+DIONYSUS_API error_code dump_alloc_profile();
+
 void write_format(const char* fmt, ...);
 void write_format_a(const char* fmt, va_list ap);
 
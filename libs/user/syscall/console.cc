@@ -17,4 +17,9 @@ DIONYSUS_API size_t put_str(const char* str)
 DIONYSUS_API size_t put_char(size_t ch)
 {
 	return make_syscall(syscall::SYS_put_char, (uintptr_t)ch);
+}
+
+DIONYSUS_API error_code dump_alloc_profile()
+{
+	return make_syscall(syscall::SYS_dump_alloc_profile);
 }
\ No newline at end of file
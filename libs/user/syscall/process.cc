@@ -22,6 +22,21 @@ DIONYSUS_API error_code set_heap_size(uintptr_t* size)
 	return make_syscall(syscall::SYS_set_heap_size, size);
 }
 
+DIONYSUS_API error_code mmap(IN OUT void** addr, size_t len, uint64_t flags)
+{
+	if (addr == nullptr)
+	{
+		return -ERROR_INVALID;
+	}
+
+	return make_syscall(syscall::SYS_mmap, addr, len, flags);
+}
+
+DIONYSUS_API error_code munmap(void* addr, size_t len)
+{
+	return make_syscall(syscall::SYS_munmap, addr, len);
+}
+
 DIONYSUS_API error_code get_current_process(OUT object::handle_type* out)
 {
 	if (out == nullptr)